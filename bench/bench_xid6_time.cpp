@@ -0,0 +1,138 @@
+/**
+ * Benchmark of the XID6 time string conversion (FormatXID6Ticks/ParseXID6Ticks),
+ * next to the sprintf/strtod conversion it replaced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "SPCFile.h"
+
+#define XID6_TICK_UNIT  64000
+
+static volatile size_t sink;
+
+// The former implementation, for comparison: through double, sprintf and strtod.
+static size_t legacy_format(uint32_t ticks, char * str)
+{
+	double tv = (double)ticks / XID6_TICK_UNIT;
+	double seconds = fmod(tv, 60.0);
+	unsigned int minutes = (unsigned int)(tv - seconds) / 60;
+	unsigned int hours = minutes / 60;
+	minutes %= 60;
+
+	if (hours != 0) {
+		sprintf(str, "%u:%02u:%06.3f", hours, minutes, seconds);
+	}
+	else if (minutes != 0) {
+		sprintf(str, "%u:%06.3f", minutes, seconds);
+	}
+	else {
+		sprintf(str, "%.3f", seconds);
+	}
+
+	size_t len = strlen(str);
+	while (len > 0 && str[len - 1] == '0') {
+		str[--len] = '\0';
+	}
+	if (len > 0 && str[len - 1] == '.') {
+		str[--len] = '\0';
+	}
+	return len;
+}
+
+static uint32_t legacy_parse(const std::string & str)
+{
+	std::vector<std::string> tokens;
+	size_t current = 0;
+	size_t found;
+	while ((found = str.find_first_of(':', current)) != std::string::npos) {
+		tokens.push_back(std::string(str, current, found - current));
+		current = found + 1;
+	}
+	tokens.push_back(std::string(str, current, str.size() - current));
+
+	double seconds = strtod(tokens.back().c_str(), NULL);
+	long minutes = (tokens.size() >= 2) ? strtol(tokens[tokens.size() - 2].c_str(), NULL, 10) : 0;
+	long hours = (tokens.size() >= 3) ? strtol(tokens[0].c_str(), NULL, 10) : 0;
+	return (uint32_t)((hours * 3600 + minutes * 60 + seconds) * XID6_TICK_UNIT);
+}
+
+template <typename F>
+static double measure(const char * name, size_t iterations, F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; i++) {
+		f(i);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double ns = seconds * 1e9 / iterations;
+	printf("%-32s %8.1f ns/op\n", name, ns);
+	return ns;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t iterations = (argc >= 2) ? (size_t)strtoul(argv[1], NULL, 10) : 2000000;
+	if (iterations == 0) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// typical tag values: lengths and fades from a few seconds to several minutes, in ms steps
+	const size_t num_values = 4096;
+	std::vector<uint32_t> ticks(num_values);
+	std::vector<std::string> strings(num_values);
+	uint32_t seed = 12345;
+	for (size_t i = 0; i < num_values; i++) {
+		seed = seed * 1103515245 + 12345;
+		ticks[i] = (seed >> 8) % (600 * 1000) * (XID6_TICK_UNIT / 1000);
+
+		char str[SPCFile::XID6_TIME_STRING_MAX];
+		strings[i].assign(str, SPCFile::FormatXID6Ticks(ticks[i], false, str));
+	}
+
+	// every value has to survive the round trip before the timing means anything
+	for (size_t i = 0; i < num_values; i++) {
+		uint32_t parsed;
+		if (!SPCFile::ParseXID6Ticks(strings[i].data(), strings[i].data() + strings[i].size(), parsed) || parsed != ticks[i]) {
+			fprintf(stderr, "Error: \"%s\" does not round-trip\n", strings[i].c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	measure("FormatXID6Ticks", iterations, [&](size_t i) {
+		char str[SPCFile::XID6_TIME_STRING_MAX];
+		sink += SPCFile::FormatXID6Ticks(ticks[i % num_values], false, str);
+	});
+	measure("XID6TicksToTimeString", iterations, [&](size_t i) {
+		sink += SPCFile::XID6TicksToTimeString(ticks[i % num_values], false).size();
+	});
+	measure("legacy sprintf format", iterations, [&](size_t i) {
+		char str[64];
+		sink += legacy_format(ticks[i % num_values], str);
+	});
+
+	measure("ParseXID6Ticks", iterations, [&](size_t i) {
+		const std::string & str = strings[i % num_values];
+		uint32_t parsed;
+		SPCFile::ParseXID6Ticks(str.data(), str.data() + str.size(), parsed);
+		sink += parsed;
+	});
+	measure("TimeStringToXID6Ticks", iterations, [&](size_t i) {
+		sink += SPCFile::TimeStringToXID6Ticks(strings[i % num_values], NULL);
+	});
+	measure("legacy strtod parse", iterations, [&](size_t i) {
+		sink += legacy_parse(strings[i % num_values]);
+	});
+
+	return EXIT_SUCCESS;
+}
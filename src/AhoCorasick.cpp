@@ -0,0 +1,73 @@
+#include <stdint.h>
+
+#include <deque>
+
+#include "AhoCorasick.h"
+
+AhoCorasick::AhoCorasick() :
+	transitions(256, 0),
+	outputs(1, -1),
+	output_links(1, 0),
+	fail_links(1, 0)
+{
+}
+
+AhoCorasick::~AhoCorasick()
+{
+}
+
+size_t AhoCorasick::AddPattern(const uint8_t * pattern, size_t size)
+{
+	// while building, 0 means no edge (the root is never a child)
+	uint32_t state = 0;
+	for (size_t i = 0; i < size; i++) {
+		uint32_t & next = transitions[state * 256 + pattern[i]];
+		if (next == 0) {
+			next = (uint32_t)outputs.size();
+			transitions.resize(transitions.size() + 256, 0);
+			outputs.push_back(-1);
+			output_links.push_back(0);
+			fail_links.push_back(0);
+		}
+		state = transitions[state * 256 + pattern[i]];
+	}
+
+	size_t id = pattern_sizes.size();
+	pattern_sizes.push_back(size);
+	same_patterns.push_back(outputs[state]);
+	outputs[state] = (int32_t)id;
+	return id;
+}
+
+void AhoCorasick::Build()
+{
+	// breadth first, so that fail links always point at finished states
+	std::deque<uint32_t> queue;
+	for (int c = 0; c < 256; c++) {
+		uint32_t child = transitions[c];
+		if (child != 0) {
+			fail_links[child] = 0;
+			output_links[child] = 0;
+			queue.push_back(child);
+		}
+	}
+
+	while (!queue.empty()) {
+		uint32_t state = queue.front();
+		queue.pop_front();
+
+		uint32_t fail = fail_links[state];
+		for (int c = 0; c < 256; c++) {
+			uint32_t & next = transitions[state * 256 + c];
+			if (next != 0) {
+				uint32_t child_fail = transitions[fail * 256 + c];
+				fail_links[next] = child_fail;
+				output_links[next] = (outputs[child_fail] >= 0) ? child_fail : output_links[child_fail];
+				queue.push_back(next);
+			}
+			else {
+				next = transitions[fail * 256 + c];
+			}
+		}
+	}
+}
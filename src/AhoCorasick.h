@@ -0,0 +1,57 @@
+/**
+ * Multi-pattern byte string search (Aho-Corasick), compiled to a full transition table
+ * so that scanning costs one table lookup per input byte regardless of the pattern count.
+ */
+
+#ifndef AHOCORASICK_H_INCLUDED
+#define AHOCORASICK_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+class AhoCorasick
+{
+public:
+	AhoCorasick();
+	virtual ~AhoCorasick();
+
+	// Returns the pattern id, numbered from 0. Patterns must not be empty.
+	size_t AddPattern(const uint8_t * pattern, size_t size);
+
+	// Must be called after the last AddPattern and before Find.
+	void Build();
+
+	size_t GetPatternCount() const
+	{
+		return pattern_sizes.size();
+	}
+
+	// Calls func(pattern_id, offset) for every occurrence, offset being where it starts.
+	template <typename Func>
+	void Find(const uint8_t * data, size_t size, Func func) const
+	{
+		uint32_t state = 0;
+		for (size_t i = 0; i < size; i++) {
+			state = transitions[state * 256 + data[i]];
+
+			// every pattern ending here is on the output chain
+			for (uint32_t s = (outputs[state] >= 0) ? state : output_links[state]; s != 0; s = output_links[s]) {
+				for (int32_t id = outputs[s]; id >= 0; id = same_patterns[id]) {
+					func((size_t)id, i + 1 - pattern_sizes[id]);
+				}
+			}
+		}
+	}
+
+private:
+	std::vector<uint32_t> transitions;		// 256 per state, state 0 is the root
+	std::vector<int32_t> outputs;			// pattern ending at the state, or -1
+	std::vector<uint32_t> output_links;		// nearest suffix state with an output, 0 if none
+	std::vector<uint32_t> fail_links;
+	std::vector<size_t> pattern_sizes;
+	std::vector<int32_t> same_patterns;		// next pattern with identical bytes, or -1
+};
+
+#endif /* !AHOCORASICK_H_INCLUDED */
@@ -0,0 +1,52 @@
+#include <stdlib.h>
+#include <stddef.h>
+
+#include <new>
+
+#include "Stats.h"
+
+// Count heap allocations for --stats. Costs a single branch while statistics are disabled.
+// Kept apart from the code that allocates, so that the calls are never inlined there.
+void * operator new(size_t size)
+{
+	Stats::AddAllocation();
+
+	if (size == 0) {
+		size = 1;
+	}
+
+	void * p;
+	while ((p = malloc(size)) == NULL) {
+		std::new_handler handler = std::get_new_handler();
+		if (handler == NULL) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+	return p;
+}
+
+void * operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void * p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete[](void * p, size_t) noexcept
+{
+	operator delete(p);
+}
@@ -0,0 +1,212 @@
+#include <stdint.h>
+
+#include "BRR.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BRR_SSE2
+#endif
+
+// the largest shift that decodes meaningfully
+#define BRR_MAX_SHIFT   12
+
+#define CLAMP16(x)  { if ((int16_t)(x) != (x)) (x) = ((x) >> 31) ^ 0x7fff; }
+
+// Runs the prediction filter over one block of scaled samples.
+// p1 is the previous output as stored by the DSP (doubled), p2 the one before it.
+static inline void run_filter(const int * scaled, int filter, int16_t * out, int & p1, int & p2)
+{
+	for (int i = 0; i < BRR::SAMPLES_PER_BLOCK; i++) {
+		int s = scaled[i];
+		int half_p2 = p2 >> 1;
+		if (filter >= 8) {
+			s += p1;
+			s -= half_p2;
+			if (filter == 8) {
+				s += half_p2 >> 4;
+				s += (p1 * -3) >> 6;
+			}
+			else {
+				s += (p1 * -13) >> 7;
+				s += (half_p2 * 3) >> 4;
+			}
+		}
+		else if (filter != 0) {
+			s += p1 >> 1;
+			s += (-p1) >> 5;
+		}
+
+		CLAMP16(s);
+		s = (int16_t)(s * 2);
+		out[i] = (int16_t)s;
+		p2 = p1;
+		p1 = s;
+	}
+}
+
+void BRR::DecodeScalar(const uint8_t * data, size_t num_blocks, int16_t * out, int16_t * history)
+{
+	int p2 = history[0];
+	int p1 = history[1];
+
+	for (size_t block = 0; block < num_blocks; block++, data += BLOCK_SIZE, out += SAMPLES_PER_BLOCK) {
+		int header = data[0];
+		int shift = header >> 4;
+		int filter = header & 0x0c;
+
+		int scaled[SAMPLES_PER_BLOCK];
+		for (int i = 0; i < SAMPLES_PER_BLOCK; i++) {
+			int nybble = data[1 + i / 2];
+			int s = (int8_t)((i % 2 == 0) ? nybble : (nybble << 4)) >> 4;
+
+			s = (s << shift) >> 1;
+			if (shift >= 0xd) {
+				// -2048 or 0
+				s = (s >> 25) << 11;
+			}
+			scaled[i] = s;
+		}
+
+		run_filter(scaled, filter, out, p1, p2);
+	}
+
+	history[0] = (int16_t)p2;
+	history[1] = (int16_t)p1;
+}
+
+void BRR::Decode(const uint8_t * data, size_t num_blocks, int16_t * out, int16_t * history)
+{
+#ifdef BRR_SSE2
+	int p2 = history[0];
+	int p1 = history[1];
+
+	const __m128i zero = _mm_setzero_si128();
+	for (size_t block = 0; block < num_blocks; block++, data += BLOCK_SIZE, out += SAMPLES_PER_BLOCK) {
+		int header = data[0];
+		int shift = header >> 4;
+		int filter = header & 0x0c;
+
+		// each byte to the top of a 16-bit lane, then both nybbles sign-extended
+		__m128i bytes = _mm_unpacklo_epi8(zero, _mm_loadl_epi64((const __m128i *)&data[1]));
+		__m128i high = _mm_srai_epi16(bytes, 12);
+		__m128i low = _mm_srai_epi16(_mm_slli_epi16(bytes, 4), 12);
+		__m128i s0 = _mm_unpacklo_epi16(high, low);
+		__m128i s1 = _mm_unpackhi_epi16(high, low);
+
+		// the shifted nybble fits 16 bits up to shift 12
+		if (shift <= BRR_MAX_SHIFT) {
+			__m128i count = _mm_cvtsi32_si128(shift);
+			s0 = _mm_srai_epi16(_mm_sll_epi16(s0, count), 1);
+			s1 = _mm_srai_epi16(_mm_sll_epi16(s1, count), 1);
+		}
+		else {
+			const __m128i minimum = _mm_set1_epi16(-2048);
+			s0 = _mm_and_si128(_mm_srai_epi16(s0, 15), minimum);
+			s1 = _mm_and_si128(_mm_srai_epi16(s1, 15), minimum);
+		}
+
+		if (filter == 0) {
+			// no prediction, so nothing can clamp
+			_mm_storeu_si128((__m128i *)&out[0], _mm_slli_epi16(s0, 1));
+			_mm_storeu_si128((__m128i *)&out[8], _mm_slli_epi16(s1, 1));
+			p2 = out[SAMPLES_PER_BLOCK - 2];
+			p1 = out[SAMPLES_PER_BLOCK - 1];
+			continue;
+		}
+
+		int scaled[SAMPLES_PER_BLOCK];
+		_mm_storeu_si128((__m128i *)&scaled[0], _mm_srai_epi32(_mm_unpacklo_epi16(s0, s0), 16));
+		_mm_storeu_si128((__m128i *)&scaled[4], _mm_srai_epi32(_mm_unpackhi_epi16(s0, s0), 16));
+		_mm_storeu_si128((__m128i *)&scaled[8], _mm_srai_epi32(_mm_unpacklo_epi16(s1, s1), 16));
+		_mm_storeu_si128((__m128i *)&scaled[12], _mm_srai_epi32(_mm_unpackhi_epi16(s1, s1), 16));
+
+		// the filter is picked once per block rather than once per sample
+		switch (filter) {
+		case 0x04:
+			run_filter(scaled, 0x04, out, p1, p2);
+			break;
+		case 0x08:
+			run_filter(scaled, 0x08, out, p1, p2);
+			break;
+		default:
+			run_filter(scaled, 0x0c, out, p1, p2);
+			break;
+		}
+	}
+
+	history[0] = (int16_t)p2;
+	history[1] = (int16_t)p1;
+#else
+	DecodeScalar(data, num_blocks, out, history);
+#endif
+}
+
+uint32_t BRR::GetSampleSize(const uint8_t * ram, uint16_t start)
+{
+	uint32_t addr = start;
+	while (addr + BLOCK_SIZE <= 0x10000) {
+		uint8_t header = ram[addr];
+		if ((header >> 4) > BRR_MAX_SHIFT) {
+			return 0;
+		}
+
+		addr += BLOCK_SIZE;
+		if ((header & FLAG_END) != 0) {
+			return addr - start;
+		}
+	}
+	return 0;
+}
+
+void BRR::ReadDirectory(const uint8_t * ram, uint8_t dir, std::vector<Sample> & samples)
+{
+	samples.clear();
+
+	// the directory cannot extend into sample data
+	uint32_t dir_addr = dir * 0x100;
+	uint32_t dir_end = 0x10000;
+	for (int srcn = 0; srcn < 0x100 && dir_addr + srcn * 4 + 4 <= dir_end; srcn++) {
+		const uint8_t * entry = &ram[dir_addr + srcn * 4];
+
+		Sample sample;
+		sample.srcn = srcn;
+		sample.start = entry[0] | (entry[1] << 8);
+		sample.loop = entry[2] | (entry[3] << 8);
+
+		// zero page and stack hold driver variables
+		if (sample.start < 0x200 || (sample.start >= dir_addr && sample.start < dir_addr + srcn * 4 + 4)) {
+			continue;
+		}
+
+		sample.size = GetSampleSize(ram, sample.start);
+		if (sample.size == 0) {
+			continue;
+		}
+
+		// the loop flag is taken from the end block
+		sample.loops = (ram[sample.start + sample.size - BLOCK_SIZE] & FLAG_LOOP) != 0;
+		if (sample.loops) {
+			if (sample.loop < sample.start || sample.loop >= sample.start + sample.size ||
+				(sample.loop - sample.start) % BLOCK_SIZE != 0) {
+				continue;
+			}
+		}
+
+		// unused entries are often copies of a used one
+		bool duplicate = false;
+		for (auto itr = samples.begin(); itr != samples.end(); ++itr) {
+			if (itr->start == sample.start && (itr->loop == sample.loop || !sample.loops)) {
+				duplicate = true;
+				break;
+			}
+		}
+		if (duplicate) {
+			continue;
+		}
+
+		samples.push_back(sample);
+		if (sample.start >= dir_addr && sample.start < dir_end) {
+			dir_end = sample.start;
+		}
+	}
+}
@@ -0,0 +1,50 @@
+/**
+ * BRR samples in SPC700 RAM: 9-byte blocks of a header and 16 4-bit samples.
+ */
+
+#ifndef BRR_H_INCLUDED
+#define BRR_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+class BRR
+{
+public:
+	static const int BLOCK_SIZE = 9;
+	static const int SAMPLES_PER_BLOCK = 16;
+
+	enum HeaderFlag {
+		FLAG_END = 0x01,
+		FLAG_LOOP = 0x02
+	};
+
+	struct Sample {
+		int srcn;
+		uint16_t start;
+		uint16_t loop;
+		uint32_t size;		// in bytes, a multiple of BLOCK_SIZE
+		bool loops;
+	};
+
+	// Size of the sample at start up to and including its end block.
+	// 0 if it runs past the end of RAM or a block cannot be valid BRR.
+	static uint32_t GetSampleSize(const uint8_t * ram, uint16_t start);
+
+	// Decodes consecutive blocks, 16 samples each, with the same results as the S-DSP
+	// (16-bit, lowest bit clear). history holds the last two outputs, older first,
+	// and is updated, so a sample can be decoded in pieces or around its loop.
+	static void Decode(const uint8_t * data, size_t num_blocks, int16_t * out, int16_t * history);
+
+	// Plain reference implementation of Decode.
+	static void DecodeScalar(const uint8_t * data, size_t num_blocks, int16_t * out, int16_t * history);
+
+	// Reads the directory at dir * 0x100 and returns the plausible entries.
+	// Directories have no length, so entries whose data is not valid BRR, whose loop point
+	// falls outside the sample, or that repeat an earlier entry are skipped.
+	static void ReadDirectory(const uint8_t * ram, uint8_t dir, std::vector<Sample> & samples);
+};
+
+#endif /* !BRR_H_INCLUDED */
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include "DirectoryWalker.h"
+#include "SPCFile.h"
+#include "Stats.h"
+#include "cpath.h"
+
+static std::string join_path(const std::string & dir, const char * name)
+{
+	std::string path(dir);
+	if (!path.empty() && path[path.size() - 1] != PATH_SEPARATOR_CHAR && path[path.size() - 1] != '/') {
+		path += PATH_SEPARATOR_CHAR;
+	}
+	path += name;
+	return path;
+}
+
+#ifdef _WIN32
+
+static bool is_spc_file(const std::string & path, uint64_t file_size)
+{
+	uint8_t header[SPCFile::SIGNATURE_CHECK_SIZE];
+
+	Stats::AddSyscalls(2);
+	FILE * fp = fopen(path.c_str(), "rb");
+	if (fp == NULL) {
+		return false;
+	}
+
+	bool result = fread(header, 1, sizeof(header), fp) == sizeof(header) && SPCFile::IsSPCHeader(header, file_size);
+	Stats::AddRead(sizeof(header));
+	fclose(fp);
+	return result;
+}
+
+// Lists the subdirectories and the SPC files of one directory. Returns false if it cannot be read.
+static bool read_directory(const std::string & dir, std::vector<std::string> & subdirs, std::vector<std::string> & files)
+{
+	WIN32_FIND_DATAA find_data;
+
+	Stats::AddSyscalls(1);
+	HANDLE handle = FindFirstFileExA(join_path(dir, "*").c_str(), FindExInfoBasic, &find_data,
+		FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	do {
+		const char * name = find_data.cFileName;
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+			continue;
+		}
+
+		if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+			if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0) {
+				subdirs.push_back(join_path(dir, name));
+			}
+		}
+		else {
+			// the size rules out most other files without opening them
+			uint64_t file_size = ((uint64_t)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow;
+			if (file_size >= SPCFile::MIN_FILE_SIZE) {
+				std::string path(join_path(dir, name));
+				if (is_spc_file(path, file_size)) {
+					files.push_back(path);
+				}
+			}
+		}
+
+		Stats::AddSyscalls(1);
+	} while (FindNextFileA(handle, &find_data));
+
+	FindClose(handle);
+	return true;
+}
+
+#else
+
+// Checks an entry of the open directory dir_fd. Its type comes from the directory listing
+// and may be DT_UNKNOWN on file systems that do not report it.
+static void check_entry(int dir_fd, const std::string & dir, const char * name, unsigned char type,
+	std::vector<std::string> & subdirs, std::vector<std::string> & files)
+{
+	struct stat st;
+
+	if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+		return;
+	}
+
+	if (type == DT_UNKNOWN) {
+		Stats::AddSyscalls(1);
+		if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+			return;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			type = DT_DIR;
+		}
+		else if (S_ISLNK(st.st_mode)) {
+			type = DT_LNK;
+		}
+		else if (S_ISREG(st.st_mode)) {
+			type = DT_REG;
+		}
+	}
+
+	if (type == DT_DIR) {
+		subdirs.push_back(join_path(dir, name));
+		return;
+	}
+
+	if (type != DT_REG && type != DT_LNK) {
+		return;
+	}
+
+	// the size rules out most other files without opening them
+	Stats::AddSyscalls(1);
+	if (fstatat(dir_fd, name, &st, 0) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size < SPCFile::MIN_FILE_SIZE) {
+		return;
+	}
+
+	Stats::AddSyscalls(3);
+	int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return;
+	}
+
+	uint8_t header[SPCFile::SIGNATURE_CHECK_SIZE];
+	if (read(fd, header, sizeof(header)) == (ssize_t)sizeof(header) && SPCFile::IsSPCHeader(header, st.st_size)) {
+		files.push_back(join_path(dir, name));
+	}
+	Stats::AddRead(sizeof(header));
+	close(fd);
+}
+
+#ifdef __linux__
+// The record layout of getdents64, which glibc only exposes since 2.30.
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[256];
+};
+#endif
+
+// Lists the subdirectories and the SPC files of one directory. Returns false if it cannot be read.
+static bool read_directory(const std::string & dir, std::vector<std::string> & subdirs, std::vector<std::string> & files)
+{
+	Stats::AddSyscalls(1);
+	int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir_fd == -1) {
+		return false;
+	}
+
+#ifdef __linux__
+	// large reads keep the number of system calls per directory low
+	static const size_t BUFFER_SIZE = 0x10000;
+	char * buffer = new char[BUFFER_SIZE];
+	bool no_error = true;
+
+	for (;;) {
+		Stats::AddSyscalls(1);
+		long size = syscall(SYS_getdents64, dir_fd, buffer, BUFFER_SIZE);
+		if (size <= 0) {
+			no_error = (size == 0);
+			break;
+		}
+
+		for (long offset = 0; offset < size; ) {
+			const linux_dirent64 * entry = (const linux_dirent64 *)(buffer + offset);
+			check_entry(dir_fd, dir, entry->d_name, entry->d_type, subdirs, files);
+			offset += entry->d_reclen;
+		}
+	}
+
+	delete[] buffer;
+	Stats::AddSyscalls(1);
+	close(dir_fd);
+	return no_error;
+#else
+	DIR * dirp = fdopendir(dir_fd);
+	if (dirp == NULL) {
+		close(dir_fd);
+		return false;
+	}
+
+	struct dirent * entry;
+	while ((entry = readdir(dirp)) != NULL) {
+		check_entry(dir_fd, dir, entry->d_name, entry->d_type, subdirs, files);
+	}
+
+	closedir(dirp);
+	return true;
+#endif
+}
+
+#endif
+
+bool DirectoryWalker::FindSPCFiles(const std::string & dir, unsigned int num_threads, std::vector<std::string> & filenames)
+{
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::vector<std::string> pending(1, dir);
+	unsigned int busy = 0;
+	std::vector<std::string> found;
+	bool no_error = true;
+
+	// a worker finishes once there is nothing left to read and nobody can add more
+	auto worker = [&]() {
+		std::vector<std::string> subdirs;
+		std::vector<std::string> files;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			cond.wait(lock, [&]() { return !pending.empty() || busy == 0; });
+			if (pending.empty()) {
+				break;
+			}
+
+			std::string path;
+			path.swap(pending.back());
+			pending.pop_back();
+			busy++;
+			lock.unlock();
+
+			subdirs.clear();
+			files.clear();
+			bool read_ok = read_directory(path, subdirs, files);
+			if (!read_ok) {
+				fprintf(stderr, "Error: Unable to read directory \"%s\"\n", path.c_str());
+			}
+
+			lock.lock();
+			no_error = no_error && read_ok;
+			pending.insert(pending.end(), subdirs.begin(), subdirs.end());
+			found.insert(found.end(), files.begin(), files.end());
+			busy--;
+			cond.notify_all();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < num_threads; i++) {
+		threads.push_back(std::thread(worker));
+	}
+	worker();
+
+	for (auto itr = threads.begin(); itr != threads.end(); ++itr) {
+		itr->join();
+	}
+
+	std::sort(found.begin(), found.end());
+	filenames.insert(filenames.end(), found.begin(), found.end());
+	return no_error;
+}
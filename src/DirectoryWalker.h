@@ -0,0 +1,20 @@
+/**
+ * Recursive search for SPC files, reading several directories at once.
+ */
+
+#ifndef DIRECTORYWALKER_H_INCLUDED
+#define DIRECTORYWALKER_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+class DirectoryWalker
+{
+public:
+	// Appends the SPC files below dir to filenames in sorted order. Files are recognized
+	// by size and signature rather than by extension; symbolic links to directories are
+	// not followed. Returns false if a directory could not be read, after listing the rest.
+	static bool FindSPCFiles(const std::string & dir, unsigned int num_threads, std::vector<std::string> & filenames);
+};
+
+#endif /* !DIRECTORYWALKER_H_INCLUDED */
@@ -0,0 +1,116 @@
+/**
+ * Non-cryptographic hashing for content identification.
+ */
+
+#ifndef HASH_H_INCLUDED
+#define HASH_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class Hash
+{
+public:
+	static const uint64_t FNV1A64_INIT = 0xcbf29ce484222325ULL;
+
+	// 64-bit FNV-1a; pass the previous result as hash to continue over several blocks.
+	static uint64_t FNV1a64(const void * data, size_t size, uint64_t hash = FNV1A64_INIT)
+	{
+		const uint8_t * p = (const uint8_t *)data;
+		for (size_t i = 0; i < size; i++) {
+			hash ^= p[i];
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	// 64-bit xxHash (XXH64), reading 32 bytes per step in four independent lanes.
+	static uint64_t XXH64(const void * data, size_t size, uint64_t seed = 0)
+	{
+		const uint8_t * p = (const uint8_t *)data;
+		const uint8_t * end = p + size;
+		uint64_t hash;
+
+		if (size >= 32) {
+			uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+			uint64_t v2 = seed + XXH_PRIME64_2;
+			uint64_t v3 = seed;
+			uint64_t v4 = seed - XXH_PRIME64_1;
+			for (; p + 32 <= end; p += 32) {
+				v1 = XXH64Round(v1, read64(p));
+				v2 = XXH64Round(v2, read64(p + 8));
+				v3 = XXH64Round(v3, read64(p + 16));
+				v4 = XXH64Round(v4, read64(p + 24));
+			}
+
+			hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+			hash = XXH64MergeRound(hash, v1);
+			hash = XXH64MergeRound(hash, v2);
+			hash = XXH64MergeRound(hash, v3);
+			hash = XXH64MergeRound(hash, v4);
+		}
+		else {
+			hash = seed + XXH_PRIME64_5;
+		}
+
+		hash += (uint64_t)size;
+		for (; p + 8 <= end; p += 8) {
+			hash ^= XXH64Round(0, read64(p));
+			hash = rotl64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		}
+		if (p + 4 <= end) {
+			uint32_t value;
+			memcpy(&value, p, 4);
+			hash ^= (uint64_t)value * XXH_PRIME64_1;
+			hash = rotl64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+			p += 4;
+		}
+		for (; p < end; p++) {
+			hash ^= *p * XXH_PRIME64_5;
+			hash = rotl64(hash, 11) * XXH_PRIME64_1;
+		}
+
+		hash ^= hash >> 33;
+		hash *= XXH_PRIME64_2;
+		hash ^= hash >> 29;
+		hash *= XXH_PRIME64_3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+private:
+	static const uint64_t XXH_PRIME64_1 = 0x9e3779b185ebca87ULL;
+	static const uint64_t XXH_PRIME64_2 = 0xc2b2ae3d27d4eb4fULL;
+	static const uint64_t XXH_PRIME64_3 = 0x165667b19e3779f9ULL;
+	static const uint64_t XXH_PRIME64_4 = 0x85ebca77c2b2ae63ULL;
+	static const uint64_t XXH_PRIME64_5 = 0x27d4eb2f165667c5ULL;
+
+	static inline uint64_t rotl64(uint64_t x, int n)
+	{
+		return (x << n) | (x >> (64 - n));
+	}
+
+	// little-endian hosts only, like the rest of the file handling
+	static inline uint64_t read64(const uint8_t * p)
+	{
+		uint64_t value;
+		memcpy(&value, p, 8);
+		return value;
+	}
+
+	static inline uint64_t XXH64Round(uint64_t acc, uint64_t input)
+	{
+		acc += input * XXH_PRIME64_2;
+		acc = rotl64(acc, 31);
+		return acc * XXH_PRIME64_1;
+	}
+
+	static inline uint64_t XXH64MergeRound(uint64_t acc, uint64_t value)
+	{
+		acc ^= XXH64Round(0, value);
+		return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+};
+
+#endif /* !HASH_H_INCLUDED */
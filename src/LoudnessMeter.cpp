@@ -0,0 +1,171 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "LoudnessMeter.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LOUDNESS_SSE2
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// gated blocks are four 100 ms sub-blocks long
+#define SUBBLOCKS_PER_BLOCK 4
+
+#define ABSOLUTE_GATE   (-70.0)
+#define RELATIVE_GATE   (-10.0)
+
+static double energy_to_loudness(double energy)
+{
+	return -0.691 + 10.0 * log10(energy);
+}
+
+LoudnessMeter::LoudnessMeter(int sample_rate) :
+	subblock_frames(sample_rate / 10),
+	subblock_position(0),
+	subblock_energy(0),
+	peak(0)
+{
+	// BS.1770 filters, derived for the sample rate
+	double f0 = 1681.974450955533;
+	double gain = 3.999843853973347;
+	double q = 0.7071752369554196;
+	double k = tan(M_PI * f0 / sample_rate);
+	double vh = pow(10.0, gain / 20.0);
+	double vb = pow(vh, 0.4996667741545416);
+	double a0 = 1.0 + k / q + k * k;
+	stages[0].b0 = (vh + vb * k / q + k * k) / a0;
+	stages[0].b1 = 2.0 * (k * k - vh) / a0;
+	stages[0].b2 = (vh - vb * k / q + k * k) / a0;
+	stages[0].a1 = 2.0 * (k * k - 1.0) / a0;
+	stages[0].a2 = (1.0 - k / q + k * k) / a0;
+
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan(M_PI * f0 / sample_rate);
+	a0 = 1.0 + k / q + k * k;
+	stages[1].b0 = 1.0;
+	stages[1].b1 = -2.0;
+	stages[1].b2 = 1.0;
+	stages[1].a1 = 2.0 * (k * k - 1.0) / a0;
+	stages[1].a2 = (1.0 - k / q + k * k) / a0;
+
+	memset(z1, 0, sizeof(z1));
+	memset(z2, 0, sizeof(z2));
+}
+
+LoudnessMeter::~LoudnessMeter()
+{
+}
+
+void LoudnessMeter::Write(const int16_t * samples, size_t num_frames)
+{
+	for (size_t i = 0; i < num_frames * 2; i++) {
+		peak = std::max(peak, abs((int)samples[i]));
+	}
+
+	while (num_frames != 0) {
+		size_t count = std::min(num_frames, subblock_frames - subblock_position);
+
+#ifdef LOUDNESS_SSE2
+		// one lane per channel
+		__m128d state1[2] = { _mm_loadu_pd(z1[0]), _mm_loadu_pd(z1[1]) };
+		__m128d state2[2] = { _mm_loadu_pd(z2[0]), _mm_loadu_pd(z2[1]) };
+		__m128d sum = _mm_setzero_pd();
+		const __m128d scale = _mm_set1_pd(1.0 / 32768.0);
+
+		for (size_t i = 0; i < count; i++) {
+			__m128d y = _mm_mul_pd(_mm_set_pd(samples[i * 2 + 1], samples[i * 2]), scale);
+			for (int s = 0; s < 2; s++) {
+				const Biquad & f = stages[s];
+				__m128d x = y;
+				y = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(f.b0)), state1[s]);
+				state1[s] = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(x, _mm_set1_pd(f.b1)), _mm_mul_pd(y, _mm_set1_pd(f.a1))), state2[s]);
+				state2[s] = _mm_sub_pd(_mm_mul_pd(x, _mm_set1_pd(f.b2)), _mm_mul_pd(y, _mm_set1_pd(f.a2)));
+			}
+			sum = _mm_add_pd(sum, _mm_mul_pd(y, y));
+		}
+
+		for (int s = 0; s < 2; s++) {
+			_mm_storeu_pd(z1[s], state1[s]);
+			_mm_storeu_pd(z2[s], state2[s]);
+		}
+
+		double sums[2];
+		_mm_storeu_pd(sums, sum);
+		subblock_energy += sums[0] + sums[1];
+#else
+		for (size_t i = 0; i < count; i++) {
+			for (int ch = 0; ch < 2; ch++) {
+				double y = samples[i * 2 + ch] / 32768.0;
+				for (int s = 0; s < 2; s++) {
+					const Biquad & f = stages[s];
+					double x = y;
+					y = f.b0 * x + z1[s][ch];
+					z1[s][ch] = f.b1 * x - f.a1 * y + z2[s][ch];
+					z2[s][ch] = f.b2 * x - f.a2 * y;
+				}
+				subblock_energy += y * y;
+			}
+		}
+#endif
+
+		samples += count * 2;
+		num_frames -= count;
+		subblock_position += count;
+
+		if (subblock_position == subblock_frames) {
+			subblocks.push_back(subblock_energy / subblock_frames);
+			subblock_position = 0;
+			subblock_energy = 0;
+		}
+	}
+}
+
+double LoudnessMeter::GetIntegratedLoudness() const
+{
+	std::vector<double> blocks;
+	for (size_t i = SUBBLOCKS_PER_BLOCK; i <= subblocks.size(); i++) {
+		double energy = 0;
+		for (size_t j = i - SUBBLOCKS_PER_BLOCK; j < i; j++) {
+			energy += subblocks[j];
+		}
+		energy /= SUBBLOCKS_PER_BLOCK;
+
+		if (energy > 0 && energy_to_loudness(energy) > ABSOLUTE_GATE) {
+			blocks.push_back(energy);
+		}
+	}
+
+	if (blocks.empty()) {
+		return -HUGE_VAL;
+	}
+
+	double mean = 0;
+	for (auto itr = blocks.begin(); itr != blocks.end(); ++itr) {
+		mean += *itr;
+	}
+	mean /= blocks.size();
+
+	double threshold = energy_to_loudness(mean) + RELATIVE_GATE;
+	double gated_mean = 0;
+	size_t gated_count = 0;
+	for (auto itr = blocks.begin(); itr != blocks.end(); ++itr) {
+		if (energy_to_loudness(*itr) > threshold) {
+			gated_mean += *itr;
+			gated_count++;
+		}
+	}
+
+	if (gated_count == 0) {
+		return -HUGE_VAL;
+	}
+	return energy_to_loudness(gated_mean / gated_count);
+}
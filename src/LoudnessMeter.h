@@ -0,0 +1,51 @@
+/**
+ * Integrated loudness of 16-bit stereo audio (ITU-R BS.1770 / EBU R128):
+ * K-weighting, 400 ms blocks with 75% overlap, absolute and relative gates.
+ * Audio is consumed as it is written; only one energy value per 100 ms is kept.
+ */
+
+#ifndef LOUDNESSMETER_H_INCLUDED
+#define LOUDNESSMETER_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+class LoudnessMeter
+{
+public:
+	LoudnessMeter(int sample_rate);
+	virtual ~LoudnessMeter();
+
+	void Write(const int16_t * samples, size_t num_frames);
+
+	// In LUFS; -HUGE_VAL if everything was gated out.
+	double GetIntegratedLoudness() const;
+
+	// Largest absolute sample value.
+	int GetPeak() const
+	{
+		return peak;
+	}
+
+private:
+	struct Biquad {
+		double b0, b1, b2;
+		double a1, a2;
+	};
+
+	// shelving filter followed by high-pass, for the two channels
+	Biquad stages[2];
+	double z1[2][2];
+	double z2[2][2];
+
+	size_t subblock_frames;		// 100 ms
+	size_t subblock_position;
+	double subblock_energy;
+	std::vector<double> subblocks;
+
+	int peak;
+};
+
+#endif /* !LOUDNESSMETER_H_INCLUDED */
@@ -0,0 +1,59 @@
+/**
+ * Minimal work distribution over a fixed pool of threads.
+ */
+
+#ifndef PARALLEL_H_INCLUDED
+#define PARALLEL_H_INCLUDED
+
+#include <stddef.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+class Parallel
+{
+public:
+	static unsigned int DefaultThreadCount()
+	{
+		unsigned int count = std::thread::hardware_concurrency();
+		return (count != 0) ? count : 1;
+	}
+
+	// Calls func(i) for every i in [0, count), each index exactly once.
+	// Indices are handed out dynamically, so uneven work balances itself.
+	template <typename Func>
+	static void For(size_t count, unsigned int num_threads, Func func)
+	{
+		if (num_threads > count) {
+			num_threads = (unsigned int)count;
+		}
+
+		if (num_threads <= 1) {
+			for (size_t i = 0; i < count; i++) {
+				func(i);
+			}
+			return;
+		}
+
+		std::atomic<size_t> next_index(0);
+		auto worker = [&]() {
+			size_t i;
+			while ((i = next_index.fetch_add(1)) < count) {
+				func(i);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < num_threads; i++) {
+			threads.push_back(std::thread(worker));
+		}
+		worker();
+
+		for (auto itr = threads.begin(); itr != threads.end(); ++itr) {
+			itr->join();
+		}
+	}
+};
+
+#endif /* !PARALLEL_H_INCLUDED */
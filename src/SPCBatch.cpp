@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "SPCBatch.h"
+#include "SPCFile.h"
+#include "Hash.h"
+#include "Parallel.h"
+
+// Hash of everything the emulator output depends on. Tags other than the muted voices
+// only affect the gain applied afterwards, so rips of one song that differ in tags
+// or length share an instance.
+static uint64_t snapshot_hash(const SPCFile & spc, uint8_t mute_mask)
+{
+	const uint8_t regs[8] = {
+		(uint8_t)(spc.regs.pc & 0xff), (uint8_t)(spc.regs.pc >> 8),
+		spc.regs.a, spc.regs.x, spc.regs.y, spc.regs.psw, spc.regs.sp,
+		mute_mask
+	};
+
+	uint64_t hash = Hash::XXH64(regs, sizeof(regs));
+	hash = Hash::XXH64(spc.ram, sizeof(spc.ram), hash);
+	hash = Hash::XXH64(spc.dsp, sizeof(spc.dsp), hash);
+	hash = Hash::XXH64(spc.extra_ram, sizeof(spc.extra_ram), hash);
+	return hash;
+}
+
+static bool is_same_snapshot(const SPCFile & lhs, const SPCFile & rhs)
+{
+	return lhs.regs.pc == rhs.regs.pc &&
+		lhs.regs.a == rhs.regs.a &&
+		lhs.regs.x == rhs.regs.x &&
+		lhs.regs.y == rhs.regs.y &&
+		lhs.regs.psw == rhs.regs.psw &&
+		lhs.regs.sp == rhs.regs.sp &&
+		memcmp(lhs.ram, rhs.ram, sizeof(lhs.ram)) == 0 &&
+		memcmp(lhs.dsp, rhs.dsp, sizeof(lhs.dsp)) == 0 &&
+		memcmp(lhs.extra_ram, rhs.extra_ram, sizeof(lhs.extra_ram)) == 0;
+}
+
+SPCBatch::SPCBatch() :
+	kernel(NULL),
+	start(0)
+{
+}
+
+SPCBatch::~SPCBatch()
+{
+}
+
+size_t SPCBatch::Add(const SPCFile & spc, const std::string & filename)
+{
+	uint8_t mute_mask = (uint8_t)spc.GetIntegerTag(SPCFile::XID6_MUTED_VOICES);
+	uint64_t hash = snapshot_hash(spc, mute_mask);
+
+	Track track;
+	track.instance = SIZE_MAX;
+	track.fade.Load(spc);
+	track.stopped = false;
+	track.load_error = false;
+	track.checkpoint_error = false;
+
+	// a matching hash is confirmed against the file of the instance
+	auto range = instance_index.equal_range(hash);
+	for (auto itr = range.first; itr != range.second && track.instance == SIZE_MAX; ++itr) {
+		const Instance & instance = instances[itr->second];
+		if (instance.mute_mask != mute_mask || instance.tracks.size() >= MAX_INSTANCE_TRACKS) {
+			continue;
+		}
+
+		std::string messages;
+		SPCFile * instance_spc = SPCFile::Load(instance.filename, &messages);
+		if (instance_spc != NULL && is_same_snapshot(spc, *instance_spc)) {
+			track.instance = itr->second;
+		}
+		delete instance_spc;
+	}
+
+	if (track.instance == SIZE_MAX) {
+		Instance instance;
+		instance.filename = filename;
+		instance.snapshot_hash = hash;
+		instance.mute_mask = mute_mask;
+		instance.total_frames = 0;
+
+		track.instance = instances.size();
+		instances.push_back(instance);
+		instance_index.insert(std::make_pair(hash, track.instance));
+	}
+
+	Instance & instance = instances[track.instance];
+	instance.tracks.push_back(tracks.size());
+	instance.total_frames = std::max(instance.total_frames, track.fade.GetTotalFrames());
+
+	tracks.push_back(track);
+	return tracks.size() - 1;
+}
+
+void SPCBatch::Run(SPCBatchSink & sink, unsigned int num_threads)
+{
+	// longest first, so the last instances to finish are short ones
+	std::vector<size_t> order(instances.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](size_t lhs, size_t rhs) {
+		return instances[lhs].total_frames > instances[rhs].total_frames;
+	});
+
+	Parallel::For(order.size(), num_threads, [&](size_t i) {
+		RunInstance(instances[order[i]], sink);
+	});
+}
+
+void SPCBatch::RunInstance(Instance & instance, SPCBatchSink & sink)
+{
+	// warnings about the tags were given when the file was added
+	std::string messages;
+	SPCFile * spc = SPCFile::Load(instance.filename, &messages);
+	if (spc == NULL || snapshot_hash(*spc, instance.mute_mask) != instance.snapshot_hash) {
+		delete spc;
+		for (auto track_itr = instance.tracks.begin(); track_itr != instance.tracks.end(); ++track_itr) {
+			tracks[*track_itr].load_error = true;
+		}
+		return;
+	}
+
+	SPCEmulator * emulator = new SPCEmulator();
+	emulator->Load(*spc);
+	emulator->SetMuteMask(instance.mute_mask);
+	if (kernel != NULL) {
+		emulator->SetDSPKernel(kernel);
+	}
+	delete spc;
+
+	SPCCheckpoints * checkpoints = new SPCCheckpoints();
+	checkpoints->Reset(*emulator);
+	for (auto track_itr = instance.tracks.begin(); track_itr != instance.tracks.end(); ++track_itr) {
+		const Track & track = tracks[*track_itr];
+		if (!track.checkpoint_filename.empty()) {
+			checkpoints->Load(track.checkpoint_filename);
+		}
+	}
+
+	if (start < instance.total_frames) {
+		checkpoints->Seek(*emulator, start);
+	}
+
+	for (auto track_itr = instance.tracks.begin(); track_itr != instance.tracks.end(); ++track_itr) {
+		Track & track = tracks[*track_itr];
+		track.fade.Seek(start);
+		if (!sink.Open(*track_itr)) {
+			track.stopped = true;
+		}
+	}
+
+	int16_t block[BLOCK_FRAMES * 2];
+	int16_t track_block[BLOCK_FRAMES * 2];
+	for (uint64_t position = start; position < instance.total_frames; position += BLOCK_FRAMES) {
+		bool active = false;
+		for (auto track_itr = instance.tracks.begin(); track_itr != instance.tracks.end(); ++track_itr) {
+			const Track & track = tracks[*track_itr];
+			if (!track.stopped && track.fade.GetRemainingFrames() != 0) {
+				active = true;
+				break;
+			}
+		}
+		if (!active) {
+			break;
+		}
+
+		size_t num_frames = (size_t)std::min<uint64_t>((uint64_t)BLOCK_FRAMES, instance.total_frames - position);
+		checkpoints->Render(*emulator, block, num_frames);
+
+		for (auto track_itr = instance.tracks.begin(); track_itr != instance.tracks.end(); ++track_itr) {
+			Track & track = tracks[*track_itr];
+			size_t track_frames = (size_t)std::min<uint64_t>(num_frames, track.fade.GetRemainingFrames());
+			if (track.stopped || track_frames == 0) {
+				continue;
+			}
+
+			memcpy(track_block, block, track_frames * 2 * sizeof(int16_t));
+			track.fade.Apply(track_block, track_frames);
+			if (!sink.Write(*track_itr, track_block, track_frames)) {
+				track.stopped = true;
+			}
+		}
+	}
+
+	for (auto track_itr = instance.tracks.begin(); track_itr != instance.tracks.end(); ++track_itr) {
+		Track & track = tracks[*track_itr];
+		sink.Close(*track_itr);
+
+		if (!track.checkpoint_filename.empty() && !checkpoints->Save(track.checkpoint_filename)) {
+			track.checkpoint_error = true;
+		}
+	}
+
+	delete checkpoints;
+	delete emulator;
+}
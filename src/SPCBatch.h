@@ -0,0 +1,148 @@
+/**
+ * Renders a set of SPC files (typically one game's soundtrack) together.
+ * Tracks that start from the same emulator state are emulated only once.
+ * Instances are rendered one at a time per thread: the snapshot is read again from
+ * its file when the instance starts, so only the running instances hold an emulator.
+ * Checkpoints recorded on the way make later renders from a start position cheap.
+ */
+
+#ifndef SPCBATCH_H_INCLUDED
+#define SPCBATCH_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <map>
+#include <vector>
+
+#include "SPCPlayer.h"
+#include "SPCCheckpoints.h"
+
+class SPCFile;
+class SPCDSPKernel;
+
+class SPCBatchSink
+{
+public:
+	virtual ~SPCBatchSink() {}
+
+	// Called on the rendering thread before the first block of a track and after its last one.
+	// A track whose Open fails is not rendered; Close is called for it all the same.
+	virtual bool Open(size_t)
+	{
+		return true;
+	}
+
+	virtual void Close(size_t)
+	{
+	}
+
+	// Receives the next block of a track. Blocks of one track arrive in order,
+	// different tracks may be delivered from different threads at the same time.
+	// Returning false stops that track.
+	virtual bool Write(size_t track, const int16_t * samples, size_t num_frames) = 0;
+};
+
+class SPCBatch
+{
+public:
+	SPCBatch();
+	virtual ~SPCBatch();
+
+	static const size_t BLOCK_FRAMES = 4096;
+
+	// Tracks sharing one emulator; their outputs are all open while it runs.
+	static const size_t MAX_INSTANCE_TRACKS = 8;
+
+	// Returns the track index. Fade and muted voices are taken from the tags of spc;
+	// the snapshot itself is read again from filename when the track is rendered.
+	size_t Add(const SPCFile & spc, const std::string & filename);
+
+	size_t GetTrackCount() const
+	{
+		return tracks.size();
+	}
+
+	// Number of distinct emulator states among the tracks.
+	size_t GetInstanceCount() const
+	{
+		return instances.size();
+	}
+
+	uint64_t GetTotalFrames(size_t track) const
+	{
+		return tracks[track].fade.GetTotalFrames();
+	}
+
+	uint64_t GetPlayFrames(size_t track) const
+	{
+		return tracks[track].fade.GetPlayFrames();
+	}
+
+	void SetDSPKernel(const SPCDSPKernel * kernel)
+	{
+		this->kernel = kernel;
+	}
+
+	// Every track starts at this frame instead of at the beginning.
+	void SetStart(uint64_t frame)
+	{
+		start = frame;
+	}
+
+	// Checkpoints of the track's instance are loaded from this file before rendering
+	// and saved back to it once the track has been rendered.
+	void SetCheckpointFile(size_t track, const std::string & filename)
+	{
+		tracks[track].checkpoint_filename = filename;
+	}
+
+	// Renders every track to the end, longest instances first.
+	void Run(SPCBatchSink & sink, unsigned int num_threads);
+
+	// After Run: the file could not be read again or no longer holds the snapshot it was added with.
+	bool HasLoadError(size_t track) const
+	{
+		return tracks[track].load_error;
+	}
+
+	// After Run: the checkpoint file could not be saved.
+	bool HasCheckpointError(size_t track) const
+	{
+		return tracks[track].checkpoint_error;
+	}
+
+private:
+	SPCBatch(const SPCBatch&);
+	SPCBatch& operator=(const SPCBatch&);
+
+	struct Track {
+		size_t instance;
+		SPCFadeOut fade;
+		std::string checkpoint_filename;
+		bool stopped;
+		bool load_error;
+		bool checkpoint_error;
+	};
+
+	struct Instance {
+		std::string filename;
+		uint64_t snapshot_hash;
+		uint8_t mute_mask;
+		std::vector<size_t> tracks;
+		uint64_t total_frames;	// of the longest track
+	};
+
+	void RunInstance(Instance & instance, SPCBatchSink & sink);
+
+	std::vector<Track> tracks;
+	std::vector<Instance> instances;
+	const SPCDSPKernel * kernel;
+	uint64_t start;
+
+	// hash of everything the emulator output depends on -> instances
+	std::multimap<uint64_t, size_t> instance_index;
+};
+
+#endif /* !SPCBATCH_H_INCLUDED */
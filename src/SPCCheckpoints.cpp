@@ -0,0 +1,199 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "SPCCheckpoints.h"
+#include "SPCEmulator.h"
+#include "Hash.h"
+#include "cpath.h"
+
+static const char checkpoint_magic[8] = { 'S', 'P', 'C', 'C', 'K', 'P', 'T', 0x01 };
+
+static bool write_block(FILE * fp, const void * data, size_t size)
+{
+	return size == 0 || fwrite(data, size, 1, fp) == 1;
+}
+
+static bool read_block(FILE * fp, void * data, size_t size)
+{
+	return size == 0 || fread(data, size, 1, fp) == 1;
+}
+
+SPCCheckpoints::SPCCheckpoints() :
+	interval(DEFAULT_INTERVAL),
+	base_hash(0)
+{
+	memset(base_ram, 0, sizeof(base_ram));
+}
+
+SPCCheckpoints::~SPCCheckpoints()
+{
+}
+
+void SPCCheckpoints::Reset(const SPCEmulator & emulator, uint32_t interval)
+{
+	this->interval = (interval != 0) ? interval : DEFAULT_INTERVAL;
+	memcpy(base_ram, emulator.ram, sizeof(base_ram));
+	checkpoints.clear();
+	Record(emulator);
+
+	const std::vector<uint8_t> & state = checkpoints[0].state;
+	base_hash = Hash::FNV1a64(state.data(), state.size());
+	base_hash = Hash::FNV1a64(base_ram, sizeof(base_ram), base_hash);
+}
+
+void SPCCheckpoints::Record(const SPCEmulator & emulator)
+{
+	Checkpoint checkpoint;
+	emulator.SaveState(checkpoint.state);
+
+	for (int page = 0; page < PAGE_COUNT; page++) {
+		const uint8_t * data = &emulator.ram[page * PAGE_SIZE];
+		if (memcmp(data, &base_ram[page * PAGE_SIZE], PAGE_SIZE) != 0) {
+			checkpoint.pages.push_back((uint8_t)page);
+			checkpoint.pages.insert(checkpoint.pages.end(), data, data + PAGE_SIZE);
+		}
+	}
+
+	checkpoints.push_back(checkpoint);
+}
+
+void SPCCheckpoints::Restore(SPCEmulator & emulator, size_t index) const
+{
+	const Checkpoint & checkpoint = checkpoints[index];
+	emulator.LoadState(checkpoint.state);
+
+	memcpy(emulator.ram, base_ram, sizeof(base_ram));
+	for (size_t offset = 0; offset < checkpoint.pages.size(); offset += 1 + PAGE_SIZE) {
+		int page = checkpoint.pages[offset];
+		memcpy(&emulator.ram[page * PAGE_SIZE], &checkpoint.pages[offset + 1], PAGE_SIZE);
+	}
+}
+
+void SPCCheckpoints::Render(SPCEmulator & emulator, int16_t * out, size_t num_frames)
+{
+	while (num_frames != 0) {
+		uint64_t position = emulator.GetPosition();
+		uint64_t next_boundary = (position / interval + 1) * interval;
+
+		size_t count = (size_t)std::min<uint64_t>(num_frames, next_boundary - position);
+		emulator.Render(out, count);
+		if (out != NULL) {
+			out += count * 2;
+		}
+		num_frames -= count;
+
+		// only the next one in sequence, so the list never has gaps
+		if (emulator.GetPosition() == (uint64_t)checkpoints.size() * interval) {
+			Record(emulator);
+		}
+	}
+}
+
+void SPCCheckpoints::Seek(SPCEmulator & emulator, uint64_t frame)
+{
+	if (checkpoints.empty()) {
+		return;
+	}
+
+	size_t index = (size_t)std::min<uint64_t>(frame / interval, checkpoints.size() - 1);
+	uint64_t checkpoint_frame = (uint64_t)index * interval;
+	uint64_t position = emulator.GetPosition();
+	if (position < checkpoint_frame || position > frame) {
+		Restore(emulator, index);
+		position = checkpoint_frame;
+	}
+
+	Render(emulator, NULL, (size_t)(frame - position));
+}
+
+bool SPCCheckpoints::Save(const std::string & filename) const
+{
+	// written through a temporary name, so an interrupted save leaves the old file intact
+	std::string tmp_filename = filename + ".tmp";
+	FILE * fp = fopen(tmp_filename.c_str(), "wb");
+	if (fp == NULL) {
+		return false;
+	}
+
+	uint32_t count = (uint32_t)checkpoints.size();
+	bool ok = write_block(fp, checkpoint_magic, sizeof(checkpoint_magic)) &&
+		write_block(fp, &base_hash, sizeof(base_hash)) &&
+		write_block(fp, &interval, sizeof(interval)) &&
+		write_block(fp, &count, sizeof(count));
+
+	for (auto itr = checkpoints.begin(); ok && itr != checkpoints.end(); ++itr) {
+		uint32_t state_size = (uint32_t)itr->state.size();
+		uint32_t pages_size = (uint32_t)itr->pages.size();
+		ok = write_block(fp, &state_size, sizeof(state_size)) &&
+			write_block(fp, itr->state.data(), state_size) &&
+			write_block(fp, &pages_size, sizeof(pages_size)) &&
+			write_block(fp, itr->pages.data(), pages_size);
+	}
+
+	if (fclose(fp) != 0) {
+		ok = false;
+	}
+	if (!ok || !path_replacefile(tmp_filename.c_str(), filename.c_str())) {
+		remove(tmp_filename.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool SPCCheckpoints::Load(const std::string & filename)
+{
+	if (checkpoints.empty()) {
+		return false;
+	}
+
+	FILE * fp = fopen(filename.c_str(), "rb");
+	if (fp == NULL) {
+		return false;
+	}
+
+	char magic[sizeof(checkpoint_magic)];
+	uint64_t hash;
+	uint32_t file_interval;
+	uint32_t count;
+	if (!read_block(fp, magic, sizeof(magic)) || memcmp(magic, checkpoint_magic, sizeof(magic)) != 0 ||
+		!read_block(fp, &hash, sizeof(hash)) || hash != base_hash ||
+		!read_block(fp, &file_interval, sizeof(file_interval)) || file_interval == 0 ||
+		!read_block(fp, &count, sizeof(count)) || count == 0) {
+		fclose(fp);
+		return false;
+	}
+
+	// count comes from the file, so entries are only added as they are read
+	const size_t state_size = checkpoints[0].state.size();
+	std::vector<Checkpoint> loaded;
+	bool ok = true;
+	for (uint32_t i = 0; ok && i < count; i++) {
+		loaded.push_back(Checkpoint());
+		std::vector<Checkpoint>::iterator itr = loaded.end() - 1;
+
+		uint32_t size;
+		ok = read_block(fp, &size, sizeof(size)) && size == state_size;
+		if (ok) {
+			itr->state.resize(size);
+			ok = read_block(fp, itr->state.data(), size);
+		}
+
+		ok = ok && read_block(fp, &size, sizeof(size)) && size % (1 + PAGE_SIZE) == 0 && size <= PAGE_COUNT * (1 + PAGE_SIZE);
+		if (ok) {
+			itr->pages.resize(size);
+			ok = read_block(fp, itr->pages.data(), size);
+		}
+	}
+	fclose(fp);
+
+	if (!ok) {
+		return false;
+	}
+
+	interval = file_interval;
+	checkpoints.swap(loaded);
+	return true;
+}
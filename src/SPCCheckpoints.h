@@ -0,0 +1,72 @@
+/**
+ * Periodic emulator snapshots for seeking without emulating from the start.
+ * RAM is stored as the 256-byte pages that differ from the loaded image.
+ */
+
+#ifndef SPCCHECKPOINTS_H_INCLUDED
+#define SPCCHECKPOINTS_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+class SPCEmulator;
+
+class SPCCheckpoints
+{
+public:
+	SPCCheckpoints();
+	virtual ~SPCCheckpoints();
+
+	static const int PAGE_SIZE = 0x100;
+	static const int PAGE_COUNT = 0x10000 / PAGE_SIZE;
+
+	// 5 seconds at 32 kHz
+	static const uint32_t DEFAULT_INTERVAL = 5 * 32000;
+
+	// Starts over for an emulator that was just loaded; records the checkpoint at frame 0.
+	void Reset(const SPCEmulator & emulator, uint32_t interval = DEFAULT_INTERVAL);
+
+	uint32_t GetInterval() const
+	{
+		return interval;
+	}
+
+	size_t GetCount() const
+	{
+		return checkpoints.size();
+	}
+
+	// Like SPCEmulator::Render, recording every checkpoint it passes.
+	void Render(SPCEmulator & emulator, int16_t * out, size_t num_frames);
+
+	// Moves the emulator to the frame, starting from the nearest checkpoint
+	// (or from where it is, if that is closer).
+	void Seek(SPCEmulator & emulator, uint64_t frame);
+
+	// Checkpoint files use the native byte order of the build that wrote them
+	// and are rejected when they do not belong to the loaded image.
+	bool Save(const std::string & filename) const;
+	bool Load(const std::string & filename);
+
+private:
+	SPCCheckpoints(const SPCCheckpoints&);
+	SPCCheckpoints& operator=(const SPCCheckpoints&);
+
+	struct Checkpoint {
+		std::vector<uint8_t> state;
+		std::vector<uint8_t> pages;		// page number followed by its contents
+	};
+
+	void Record(const SPCEmulator & emulator);
+	void Restore(SPCEmulator & emulator, size_t index) const;
+
+	uint32_t interval;
+	uint8_t base_ram[0x10000];
+	uint64_t base_hash;		// initial state and RAM, identifies the song
+	std::vector<Checkpoint> checkpoints;
+};
+
+#endif /* !SPCCHECKPOINTS_H_INCLUDED */
@@ -0,0 +1,553 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "SPCDSP.h"
+#include "SPCDSPKernel.h"
+
+#define CLAMP16(x)  { if ((int16_t)(x) != (x)) (x) = ((x) >> 31) ^ 0x7fff; }
+
+// The global counter wraps at a multiple of every envelope and noise rate period.
+#define COUNTER_RANGE   (2048 * 5 * 3)
+
+static const int counter_rates[32] = {
+	COUNTER_RANGE + 1, // never fires
+	      2048, 1536,
+	1280, 1024,  768,
+	 640,  512,  384,
+	 320,  256,  192,
+	 160,  128,   96,
+	  80,   64,   48,
+	  40,   32,   24,
+	  20,   16,   12,
+	  10,    8,    6,
+	   5,    4,    3,
+	         2,
+	         1
+};
+
+static const int counter_offsets[32] = {
+	  1, 0, 1040,
+	536, 0, 1040,
+	536, 0, 1040,
+	536, 0, 1040,
+	536, 0, 1040,
+	536, 0, 1040,
+	536, 0, 1040,
+	536, 0, 1040,
+	536, 0, 1040,
+	536, 0, 1040,
+	     0,
+	     0
+};
+
+// Bit n is set when rate n fires at that counter value, so a sample needs
+// a single lookup instead of a division per voice.
+struct CounterMaskTable {
+	uint32_t masks[COUNTER_RANGE];
+
+	CounterMaskTable()
+	{
+		for (int counter = 0; counter < COUNTER_RANGE; counter++) {
+			uint32_t mask = 0;
+			for (int rate = 0; rate < 32; rate++) {
+				if ((counter + counter_offsets[rate]) % counter_rates[rate] == 0) {
+					mask |= 1u << rate;
+				}
+			}
+			masks[counter] = mask;
+		}
+	}
+};
+
+static const uint32_t * get_counter_masks()
+{
+	static const CounterMaskTable table;
+	return table.masks;
+}
+
+SPCDSP::SPCDSP() :
+	ram(NULL),
+	kernel(SPCDSPKernel::GetDefault()),
+	counter_masks(get_counter_masks())
+{
+	memset(regs, 0, sizeof(regs));
+	memset(voices, 0, sizeof(voices));
+	memset(&lanes, 0, sizeof(lanes));
+	counter = 0;
+	counter_mask = 0;
+	noise = 0x4000;
+	every_other_sample = true;
+	new_kon = 0;
+	mute_mask = 0;
+	voice_activity = 0;
+	echo_offset = 0;
+	echo_length = 0;
+	echo_hist_pos = 0;
+	memset(echo_hist, 0, sizeof(echo_hist));
+	memset(fir, 0, sizeof(fir));
+}
+
+SPCDSP::~SPCDSP()
+{
+}
+
+void SPCDSP::Reset(uint8_t * ram, const uint8_t * regs)
+{
+	this->ram = ram;
+	memcpy(this->regs, regs, REGISTER_COUNT);
+
+	memset(voices, 0, sizeof(voices));
+	memset(&lanes, 0, sizeof(lanes));
+	for (int i = 0; i < VOICE_COUNT; i++) {
+		voices[i].brr_offset = 1;
+	}
+	UpdateLanes();
+
+	counter = 0;
+	noise = 0x4000;
+	every_other_sample = true;
+	new_kon = this->regs[R_KON];
+	voice_activity = 0;
+
+	echo_offset = 0;
+	echo_length = 0;
+	echo_hist_pos = 0;
+	memset(echo_hist, 0, sizeof(echo_hist));
+
+	// stale echo buffer contents would otherwise be played back as a burst of noise
+	if ((this->regs[R_FLG] & 0x20) == 0) {
+		int esa = this->regs[R_ESA] * 0x100;
+		int length = (this->regs[R_EDL] & 0x0f) * 0x800;
+		if (length == 0) {
+			length = 4;
+		}
+
+		for (int i = 0; i < length; i++) {
+			ram[(esa + i) & 0xffff] = 0;
+		}
+	}
+}
+
+#define SAVE_FIELD(field) \
+	state.insert(state.end(), (const uint8_t *)&(field), (const uint8_t *)&(field) + sizeof(field))
+
+#define LOAD_FIELD(field) \
+	memcpy(&(field), &state[offset], sizeof(field)); offset += sizeof(field)
+
+void SPCDSP::SaveState(std::vector<uint8_t> & state) const
+{
+	SAVE_FIELD(regs);
+	SAVE_FIELD(voices);
+	SAVE_FIELD(lanes);
+	SAVE_FIELD(counter);
+	SAVE_FIELD(counter_mask);
+	SAVE_FIELD(noise);
+	SAVE_FIELD(every_other_sample);
+	SAVE_FIELD(new_kon);
+	SAVE_FIELD(echo_offset);
+	SAVE_FIELD(echo_length);
+	SAVE_FIELD(echo_hist_pos);
+	SAVE_FIELD(echo_hist);
+}
+
+size_t SPCDSP::LoadState(const uint8_t * state, size_t size)
+{
+	size_t expected = sizeof(regs) + sizeof(voices) + sizeof(lanes) + sizeof(counter) + sizeof(counter_mask) +
+		sizeof(noise) + sizeof(every_other_sample) + sizeof(new_kon) + sizeof(echo_offset) +
+		sizeof(echo_length) + sizeof(echo_hist_pos) + sizeof(echo_hist);
+	if (size < expected) {
+		return 0;
+	}
+
+	size_t offset = 0;
+	LOAD_FIELD(regs);
+	LOAD_FIELD(voices);
+	LOAD_FIELD(lanes);
+	LOAD_FIELD(counter);
+	LOAD_FIELD(counter_mask);
+	LOAD_FIELD(noise);
+	LOAD_FIELD(every_other_sample);
+	LOAD_FIELD(new_kon);
+	LOAD_FIELD(echo_offset);
+	LOAD_FIELD(echo_length);
+	LOAD_FIELD(echo_hist_pos);
+	LOAD_FIELD(echo_hist);
+
+	// mirrored registers and the mute mask
+	UpdateLanes();
+	return offset;
+}
+
+void SPCDSP::Write(uint8_t addr, uint8_t data)
+{
+	addr &= 0x7f;
+
+	switch (addr) {
+	case R_KON:
+		new_kon = data;
+		break;
+
+	case R_ENDX:
+		// any write clears all the flags
+		data = 0;
+		break;
+	}
+
+	regs[addr] = data;
+
+	// registers mirrored into the voice lanes
+	if ((addr & 0x0f) <= V_VOLR || (addr & 0x0f) == R_FIR || addr == R_NON || addr == R_EON) {
+		UpdateLanes();
+	}
+}
+
+void SPCDSP::SetMuteMask(uint8_t mask)
+{
+	mute_mask = mask;
+	UpdateLanes();
+}
+
+void SPCDSP::UpdateLanes()
+{
+	for (int i = 0; i < VOICE_COUNT; i++) {
+		const uint8_t * vregs = &regs[i * 0x10];
+		const uint8_t vbit = 1 << i;
+
+		lanes.noise_mask[i] = ((regs[R_NON] & vbit) != 0) ? -1 : 0;
+		lanes.volume[0][i] = ((mute_mask & vbit) == 0) ? (int8_t)vregs[V_VOLL] : 0;
+		lanes.volume[1][i] = ((mute_mask & vbit) == 0) ? (int8_t)vregs[V_VOLR] : 0;
+		lanes.echo_mask[i] = ((regs[R_EON] & vbit) != 0) ? -1 : 0;
+
+		// C0 applies to the oldest sample, C7 to the newest
+		fir[i] = (int8_t)regs[R_FIR + i * 0x10];
+	}
+}
+
+bool SPCDSP::ReadCounter(int rate) const
+{
+	return ((counter_mask >> rate) & 1) != 0;
+}
+
+void SPCDSP::RunEnvelope(Voice & v, const uint8_t * vregs)
+{
+	int env = v.env;
+
+	if (v.env_mode == ENV_RELEASE) {
+		env -= 0x8;
+		if (env < 0) {
+			env = 0;
+		}
+		v.env = env;
+		return;
+	}
+
+	int rate;
+	int env_data = vregs[V_ADSR2];
+	int adsr1 = vregs[V_ADSR1];
+	if ((adsr1 & 0x80) != 0) {
+		// ADSR
+		if (v.env_mode >= ENV_DECAY) {
+			env--;
+			env -= env >> 8;
+			rate = env_data & 0x1f;
+			if (v.env_mode == ENV_DECAY) {
+				rate = ((adsr1 >> 3) & 0x0e) + 0x10;
+			}
+		}
+		else {
+			rate = (adsr1 & 0x0f) * 2 + 1;
+			env += (rate < 31) ? 0x20 : 0x400;
+		}
+	}
+	else {
+		// GAIN
+		env_data = vregs[V_GAIN];
+		int mode = env_data >> 5;
+		if (mode < 4) {
+			// direct
+			env = env_data * 0x10;
+			rate = 31;
+		}
+		else {
+			rate = env_data & 0x1f;
+			if (mode == 4) {
+				// linear decrease
+				env -= 0x20;
+			}
+			else if (mode < 6) {
+				// exponential decrease
+				env--;
+				env -= env >> 8;
+			}
+			else {
+				// linear increase, mode 7 slows down above 3/4
+				env += 0x20;
+				if (mode > 6 && (unsigned)v.hidden_env >= 0x600) {
+					env += 0x8 - 0x20;
+				}
+			}
+		}
+	}
+
+	// sustain level
+	if ((env >> 8) == (env_data >> 5) && v.env_mode == ENV_DECAY) {
+		v.env_mode = ENV_SUSTAIN;
+	}
+
+	v.hidden_env = env;
+
+	// unsigned cast catches a linear decrease going negative as well
+	if ((unsigned)env > 0x7ff) {
+		env = (env < 0) ? 0 : 0x7ff;
+		if (v.env_mode == ENV_ATTACK) {
+			v.env_mode = ENV_DECAY;
+		}
+	}
+
+	if (ReadCounter(rate)) {
+		v.env = env;
+	}
+}
+
+void SPCDSP::DecodeBRR(Voice & v, int voice)
+{
+	const int BRR_BUF_SIZE = SPCDSPVoiceLanes::BRR_BUF_SIZE;
+
+	int header = ram[v.brr_addr];
+	int nybbles = (ram[(v.brr_addr + v.brr_offset) & 0xffff] << 8) | ram[(v.brr_addr + v.brr_offset + 1) & 0xffff];
+
+	int shift = header >> 4;
+	int filter = header & 0x0c;
+
+	int32_t & buf_pos = lanes.buf_pos[voice];
+	int32_t * pos = &lanes.buf[voice][buf_pos];
+	for (int i = 0; i < 4; i++, pos++, nybbles <<= 4) {
+		int s = (int16_t)nybbles >> 12;
+
+		s = (s << shift) >> 1;
+		if (shift >= 0xd) {
+			// -2048 or 0
+			s = (s >> 25) << 11;
+		}
+
+		// previous samples are read from the mirrored half
+		int p1 = pos[BRR_BUF_SIZE - 1];
+		int p2 = pos[BRR_BUF_SIZE - 2] >> 1;
+		if (filter >= 8) {
+			s += p1;
+			s -= p2;
+			if (filter == 8) {
+				// s += p1 * 0.953125 - p2 * 0.46875
+				s += p2 >> 4;
+				s += (p1 * -3) >> 6;
+			}
+			else {
+				// s += p1 * 0.8984375 - p2 * 0.40625
+				s += (p1 * -13) >> 7;
+				s += (p2 * 3) >> 4;
+			}
+		}
+		else if (filter != 0) {
+			// s += p1 * 0.46875
+			s += p1 >> 1;
+			s += (-p1) >> 5;
+		}
+
+		CLAMP16(s);
+		s = (int16_t)(s * 2);
+		pos[0] = pos[BRR_BUF_SIZE] = s;
+	}
+
+	buf_pos += 4;
+	if (buf_pos >= BRR_BUF_SIZE) {
+		buf_pos = 0;
+	}
+}
+
+void SPCDSP::RunSample(int16_t * out)
+{
+	if (--counter < 0) {
+		counter = COUNTER_RANGE - 1;
+	}
+	counter_mask = counter_masks[counter];
+
+	// noise
+	if (ReadCounter(regs[R_FLG] & 0x1f)) {
+		int feedback = (noise << 13) ^ (noise << 14);
+		noise = (feedback & 0x4000) ^ (noise >> 1);
+	}
+
+	// KON and KOFF are polled every other sample
+	uint8_t kon = 0;
+	uint8_t koff = 0;
+	every_other_sample = !every_other_sample;
+	if (every_other_sample) {
+		kon = new_kon;
+		koff = regs[R_KOFF];
+		new_kon = 0;
+		regs[R_ENDX] &= ~kon;
+	}
+
+	int dir = regs[R_DIR] * 0x100;
+
+	// voices in the middle of KON restart their sample and hold their pitch
+	uint8_t kon_active = 0;
+	for (int i = 0; i < VOICE_COUNT; i++) {
+		Voice & v = voices[i];
+
+		if (v.kon_delay != 0) {
+			if (v.kon_delay == 5) {
+				int srcn_entry = dir + regs[i * 0x10 + V_SRCN] * 4;
+				v.brr_addr = ram[srcn_entry & 0xffff] | (ram[(srcn_entry + 1) & 0xffff] << 8);
+				v.brr_offset = 1;
+				v.brr_header = 0; // header is ignored on this sample
+				lanes.buf_pos[i] = 0;
+			}
+			else {
+				v.brr_header = ram[v.brr_addr];
+			}
+
+			// envelope is never run during KON
+			v.env = 0;
+			v.hidden_env = 0;
+			lanes.env[i] = 0;
+
+			// BRR decoding is enabled for the last three samples only
+			lanes.interp_pos[i] = ((--v.kon_delay & 3) != 0) ? 0x4000 : 0;
+
+			kon_active |= 1 << i;
+		}
+		else {
+			v.brr_header = ram[v.brr_addr];
+		}
+	}
+	lanes.noise = (int16_t)(noise * 2);
+
+	// interpolation, envelope and volume of all voices at once
+	kernel->RunVoices(lanes);
+
+	// advance envelopes and sample positions
+	int main_out[2] = { 0, 0 };
+	int echo_in[2] = { 0, 0 };
+	for (int i = 0; i < VOICE_COUNT; i++) {
+		Voice & v = voices[i];
+		uint8_t * vregs = &regs[i * 0x10];
+		const uint8_t vbit = 1 << i;
+
+		int output = lanes.output[i];
+		v.output = output;
+		voice_activity |= (output != 0) ? vbit : 0;
+
+		vregs[V_ENVX] = (uint8_t)(v.env >> 4);
+		vregs[V_OUTX] = (uint8_t)(output >> 8);
+
+		// immediate silence due to end of sample or soft reset
+		if ((regs[R_FLG] & 0x80) != 0 || (v.brr_header & 3) == 1) {
+			v.env_mode = ENV_RELEASE;
+			v.env = 0;
+		}
+
+		if ((koff & vbit) != 0) {
+			v.env_mode = ENV_RELEASE;
+		}
+		if ((kon & vbit) != 0) {
+			v.kon_delay = 5;
+			v.env_mode = ENV_ATTACK;
+		}
+
+		if (v.kon_delay == 0) {
+			RunEnvelope(v, vregs);
+		}
+		lanes.env[i] = v.env;
+
+		// decode four more samples when the interpolation position passes them
+		int32_t & interp_pos = lanes.interp_pos[i];
+		if (interp_pos >= 0x4000) {
+			DecodeBRR(v, i);
+
+			v.brr_offset += 2;
+			if (v.brr_offset >= 9) {
+				if ((v.brr_header & 1) != 0) {
+					int srcn_entry = dir + vregs[V_SRCN] * 4;
+					v.brr_addr = ram[(srcn_entry + 2) & 0xffff] | (ram[(srcn_entry + 3) & 0xffff] << 8);
+					regs[R_ENDX] |= vbit;
+				}
+				else {
+					v.brr_addr = (v.brr_addr + 9) & 0xffff;
+				}
+				v.brr_offset = 1;
+			}
+		}
+
+		int pitch = 0;
+		if ((kon_active & vbit) == 0) {
+			pitch = ((vregs[V_PITCHH] & 0x3f) << 8) | vregs[V_PITCHL];
+			if (i != 0 && (regs[R_PMON] & vbit) != 0) {
+				pitch += ((lanes.output[i - 1] >> 5) * pitch) >> 10;
+			}
+		}
+
+		interp_pos = (interp_pos & 0x3fff) + pitch;
+		if (interp_pos > 0x7fff) {
+			interp_pos = 0x7fff;
+		}
+
+		// mix; the clamp after every voice keeps the sum order-dependent
+		for (int ch = 0; ch < 2; ch++) {
+			main_out[ch] += lanes.amp[ch][i];
+			CLAMP16(main_out[ch]);
+
+			echo_in[ch] += lanes.echo_amp[ch][i];
+			CLAMP16(echo_in[ch]);
+		}
+	}
+
+	// echo: read the oldest sample of the ring buffer into the FIR history
+	int echo_ptr = (regs[R_ESA] * 0x100 + echo_offset) & 0xffff;
+	echo_hist_pos = (echo_hist_pos + 1) & 7;
+	for (int ch = 0; ch < 2; ch++) {
+		int addr = (echo_ptr + ch * 2) & 0xffff;
+		int sample = (int16_t)(ram[addr] | (ram[(addr + 1) & 0xffff] << 8)) >> 1;
+
+		// mirrored so that the eight taps are always contiguous
+		echo_hist[ch][echo_hist_pos] = echo_hist[ch][echo_hist_pos + 8] = sample;
+	}
+
+	int echo_out[2];
+	for (int ch = 0; ch < 2; ch++) {
+		echo_out[ch] = kernel->RunFIR(&echo_hist[ch][echo_hist_pos + 1], fir);
+	}
+
+	// main output
+	for (int ch = 0; ch < 2; ch++) {
+		int sample = ((main_out[ch] * (int8_t)regs[R_MVOLL + ch * 0x10]) >> 7) +
+			((echo_out[ch] * (int8_t)regs[R_EVOLL + ch * 0x10]) >> 7);
+		CLAMP16(sample);
+
+		if ((regs[R_FLG] & 0x40) != 0) {
+			sample = 0;
+		}
+		out[ch] = (int16_t)sample;
+	}
+
+	// echo feedback
+	for (int ch = 0; ch < 2; ch++) {
+		int sample = echo_in[ch] + ((echo_out[ch] * (int8_t)regs[R_EFB]) >> 7);
+		CLAMP16(sample);
+		sample &= ~1;
+
+		if ((regs[R_FLG] & 0x20) == 0) {
+			int addr = (echo_ptr + ch * 2) & 0xffff;
+			ram[addr] = (uint8_t)sample;
+			ram[(addr + 1) & 0xffff] = (uint8_t)(sample >> 8);
+		}
+	}
+
+	if (echo_offset == 0) {
+		echo_length = (regs[R_EDL] & 0x0f) * 0x800;
+	}
+	echo_offset += 4;
+	if (echo_offset >= echo_length) {
+		echo_offset = 0;
+	}
+}
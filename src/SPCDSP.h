@@ -0,0 +1,161 @@
+/**
+ * S-DSP emulation (8 BRR voices, ADSR/GAIN envelopes, noise, echo with FIR).
+ * Runs one 32 kHz stereo sample at a time against the shared 64 KB RAM.
+ */
+
+#ifndef SPCDSP_H_INCLUDED
+#define SPCDSP_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "SPCDSPKernel.h"
+
+class SPCDSP
+{
+public:
+	SPCDSP();
+	virtual ~SPCDSP();
+
+	static const int SAMPLE_RATE = 32000;
+	static const int VOICE_COUNT = 8;
+	static const int REGISTER_COUNT = 0x80;
+
+	enum GlobalRegister {
+		R_MVOLL = 0x0c,
+		R_MVOLR = 0x1c,
+		R_EVOLL = 0x2c,
+		R_EVOLR = 0x3c,
+		R_KON = 0x4c,
+		R_KOFF = 0x5c,
+		R_FLG = 0x6c,
+		R_ENDX = 0x7c,
+		R_EFB = 0x0d,
+		R_PMON = 0x2d,
+		R_NON = 0x3d,
+		R_EON = 0x4d,
+		R_DIR = 0x5d,
+		R_ESA = 0x6d,
+		R_EDL = 0x7d,
+		R_FIR = 0x0f
+	};
+
+	enum VoiceRegister {
+		V_VOLL = 0x00,
+		V_VOLR = 0x01,
+		V_PITCHL = 0x02,
+		V_PITCHH = 0x03,
+		V_SRCN = 0x04,
+		V_ADSR1 = 0x05,
+		V_ADSR2 = 0x06,
+		V_GAIN = 0x07,
+		V_ENVX = 0x08,
+		V_OUTX = 0x09
+	};
+
+	enum EnvelopeMode {
+		ENV_RELEASE = 0,
+		ENV_ATTACK,
+		ENV_DECAY,
+		ENV_SUSTAIN
+	};
+
+	// Starts from a register snapshot; voices are silent until keyed on.
+	void Reset(uint8_t * ram, const uint8_t * regs);
+
+	uint8_t Read(uint8_t addr) const
+	{
+		return regs[addr & 0x7f];
+	}
+
+	void Write(uint8_t addr, uint8_t data);
+
+	// Muted voices still run (and still drive pitch modulation) but are not mixed.
+	void SetMuteMask(uint8_t mask);
+
+	// Selects the SIMD implementation; all kernels give identical output.
+	void SetKernel(const SPCDSPKernel * kernel)
+	{
+		this->kernel = kernel;
+	}
+
+	// Produces one stereo sample.
+	void RunSample(int16_t * out);
+
+	// Appends the internal state (not RAM, mute mask or kernel) in native byte order.
+	void SaveState(std::vector<uint8_t> & state) const;
+
+	// Returns the number of bytes consumed, or 0 if the state is truncated.
+	size_t LoadState(const uint8_t * state, size_t size);
+
+	const uint8_t * GetRegisters() const
+	{
+		return regs;
+	}
+
+	// Voice output of the last sample (after envelope, before volume).
+	int GetVoiceOutput(int voice) const
+	{
+		return voices[voice].output;
+	}
+
+	int GetVoiceEnvelope(int voice) const
+	{
+		return voices[voice].env;
+	}
+
+	// Bit n is set if voice n had nonzero output since the last call.
+	uint8_t TakeVoiceActivity()
+	{
+		uint8_t activity = voice_activity;
+		voice_activity = 0;
+		return activity;
+	}
+
+private:
+	SPCDSP(const SPCDSP&);
+	SPCDSP& operator=(const SPCDSP&);
+
+	// Sample buffers, positions and envelope levels live in the lanes.
+	struct Voice {
+		int brr_addr;
+		int brr_offset;
+		int brr_header;
+		int kon_delay;
+		int env_mode;
+		int env;
+		int hidden_env;
+		int output;
+	};
+
+	bool ReadCounter(int rate) const;
+	void RunEnvelope(Voice & v, const uint8_t * vregs);
+	void DecodeBRR(Voice & v, int voice);
+	void UpdateLanes();
+
+	uint8_t regs[REGISTER_COUNT];
+	uint8_t * ram;
+	const SPCDSPKernel * kernel;
+
+	Voice voices[VOICE_COUNT];
+	SPCDSPVoiceLanes lanes;
+
+	const uint32_t * counter_masks;
+	int counter;
+	uint32_t counter_mask;
+	int noise;
+	bool every_other_sample;
+	uint8_t new_kon;
+	uint8_t mute_mask;
+	uint8_t voice_activity;
+
+	int echo_offset;
+	int echo_length;
+	int echo_hist_pos;
+	int32_t echo_hist[2][16];
+	int32_t fir[8];
+};
+
+#endif /* !SPCDSP_H_INCLUDED */
@@ -0,0 +1,342 @@
+#include <stdint.h>
+
+#include "SPCDSPKernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPCDSP_X86
+#define TARGET_SSE41    __attribute__((target("sse4.1")))
+#define TARGET_AVX2     __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SPCDSP_X86
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+#ifdef SPCDSP_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#define CLAMP16(x)  { if ((int16_t)(x) != (x)) (x) = ((x) >> 31) ^ 0x7fff; }
+
+#define BUF_STRIDE  (SPCDSPVoiceLanes::BRR_BUF_SIZE * 2)
+
+// Gaussian interpolation table, 32-bit so that it can be gathered directly.
+static const int32_t gauss[512] = {
+	   0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,
+	   1,    1,    1,    1,    1,    1,    1,    1,    1,    1,    1,    2,    2,    2,    2,    2,
+	   2,    2,    3,    3,    3,    3,    3,    4,    4,    4,    4,    4,    5,    5,    5,    5,
+	   6,    6,    6,    6,    7,    7,    7,    8,    8,    8,    9,    9,    9,   10,   10,   10,
+	  11,   11,   11,   12,   12,   13,   13,   14,   14,   15,   15,   15,   16,   16,   17,   17,
+	  18,   19,   19,   20,   20,   21,   21,   22,   23,   23,   24,   24,   25,   26,   27,   27,
+	  28,   29,   29,   30,   31,   32,   32,   33,   34,   35,   36,   36,   37,   38,   39,   40,
+	  41,   42,   43,   44,   45,   46,   47,   48,   49,   50,   51,   52,   53,   54,   55,   56,
+	  58,   59,   60,   61,   62,   64,   65,   66,   67,   69,   70,   71,   73,   74,   76,   77,
+	  78,   80,   81,   83,   84,   86,   87,   89,   90,   92,   94,   95,   97,   99,  100,  102,
+	 104,  106,  107,  109,  111,  113,  115,  117,  118,  120,  122,  124,  126,  128,  130,  132,
+	 134,  137,  139,  141,  143,  145,  147,  150,  152,  154,  156,  159,  161,  163,  166,  168,
+	 171,  173,  175,  178,  180,  183,  186,  188,  191,  193,  196,  199,  201,  204,  207,  210,
+	 212,  215,  218,  221,  224,  227,  230,  233,  236,  239,  242,  245,  248,  251,  254,  257,
+	 260,  263,  267,  270,  273,  276,  280,  283,  286,  290,  293,  297,  300,  304,  307,  311,
+	 314,  318,  321,  325,  328,  332,  336,  339,  343,  347,  351,  354,  358,  362,  366,  370,
+	 374,  378,  381,  385,  389,  393,  397,  401,  405,  410,  414,  418,  422,  426,  430,  434,
+	 439,  443,  447,  451,  456,  460,  464,  469,  473,  477,  482,  486,  491,  495,  499,  504,
+	 508,  513,  517,  522,  527,  531,  536,  540,  545,  550,  554,  559,  563,  568,  573,  577,
+	 582,  587,  592,  596,  601,  606,  611,  615,  620,  625,  630,  635,  640,  644,  649,  654,
+	 659,  664,  669,  674,  678,  683,  688,  693,  698,  703,  708,  713,  718,  723,  728,  732,
+	 737,  742,  747,  752,  757,  762,  767,  772,  777,  782,  787,  792,  797,  802,  806,  811,
+	 816,  821,  826,  831,  836,  841,  846,  851,  855,  860,  865,  870,  875,  880,  884,  889,
+	 894,  899,  904,  908,  913,  918,  923,  927,  932,  937,  941,  946,  951,  955,  960,  965,
+	 969,  974,  978,  983,  988,  992,  997, 1001, 1005, 1010, 1014, 1019, 1023, 1027, 1032, 1036,
+	1040, 1045, 1049, 1053, 1057, 1061, 1066, 1070, 1074, 1078, 1082, 1086, 1090, 1094, 1098, 1102,
+	1106, 1109, 1113, 1117, 1121, 1125, 1128, 1132, 1136, 1139, 1143, 1146, 1150, 1153, 1157, 1160,
+	1164, 1167, 1170, 1174, 1177, 1180, 1183, 1186, 1190, 1193, 1196, 1199, 1202, 1205, 1207, 1210,
+	1213, 1216, 1219, 1221, 1224, 1227, 1229, 1232, 1234, 1237, 1239, 1241, 1244, 1246, 1248, 1251,
+	1253, 1255, 1257, 1259, 1261, 1263, 1265, 1267, 1269, 1270, 1272, 1274, 1275, 1277, 1279, 1280,
+	1282, 1283, 1284, 1286, 1287, 1288, 1290, 1291, 1292, 1293, 1294, 1295, 1296, 1297, 1297, 1298,
+	1299, 1300, 1300, 1301, 1302, 1302, 1303, 1303, 1303, 1304, 1304, 1304, 1304, 1304, 1305, 1305
+};
+
+//============================================================================
+// scalar reference
+//============================================================================
+
+class SPCDSPScalarKernel : public SPCDSPKernel
+{
+public:
+	virtual const char * GetName() const
+	{
+		return "scalar";
+	}
+
+	virtual void RunVoices(SPCDSPVoiceLanes & lanes) const
+	{
+		for (int i = 0; i < 8; i++) {
+			int interp_pos = lanes.interp_pos[i];
+			int offset = (interp_pos >> 4) & 0xff;
+			const int32_t * fwd = gauss + 255 - offset;
+			const int32_t * rev = gauss + offset;
+			const int32_t * in = &lanes.buf[i][(interp_pos >> 12) + lanes.buf_pos[i]];
+
+			int out;
+			out = (fwd[0] * in[0]) >> 11;
+			out += (fwd[256] * in[1]) >> 11;
+			out += (rev[256] * in[2]) >> 11;
+			out = (int16_t)out;
+			out += (rev[0] * in[3]) >> 11;
+			CLAMP16(out);
+			out &= ~1;
+
+			if (lanes.noise_mask[i] != 0) {
+				out = lanes.noise;
+			}
+
+			out = ((out * lanes.env[i]) >> 11) & ~1;
+			lanes.output[i] = out;
+
+			for (int ch = 0; ch < 2; ch++) {
+				int amp = (out * lanes.volume[ch][i]) >> 7;
+				lanes.amp[ch][i] = amp;
+				lanes.echo_amp[ch][i] = amp & lanes.echo_mask[i];
+			}
+		}
+	}
+
+	virtual int RunFIR(const int32_t * history, const int32_t * coefficients) const
+	{
+		int sum = 0;
+		for (int tap = 0; tap < 7; tap++) {
+			sum += (history[tap] * coefficients[tap]) >> 6;
+		}
+		sum = (int16_t)sum;
+		sum += (int16_t)((history[7] * coefficients[7]) >> 6);
+		CLAMP16(sum);
+		return sum & ~1;
+	}
+};
+
+#ifdef SPCDSP_X86
+
+//============================================================================
+// SSE4.1 (four voices per vector)
+//============================================================================
+
+class SPCDSPSSE41Kernel : public SPCDSPKernel
+{
+public:
+	virtual const char * GetName() const
+	{
+		return "sse4";
+	}
+
+	TARGET_SSE41 virtual void RunVoices(SPCDSPVoiceLanes & lanes) const
+	{
+		const __m128i min16 = _mm_set1_epi32(-32768);
+		const __m128i max16 = _mm_set1_epi32(32767);
+		const __m128i even = _mm_set1_epi32(~1);
+		const __m128i noise = _mm_set1_epi32(lanes.noise);
+
+		for (int i = 0; i < 8; i += 4) {
+			// no gathers before AVX2, so the taps are fetched one voice at a time
+			const int32_t * in[4];
+			const int32_t * fwd[4];
+			const int32_t * rev[4];
+			for (int lane = 0; lane < 4; lane++) {
+				int interp_pos = lanes.interp_pos[i + lane];
+				int offset = (interp_pos >> 4) & 0xff;
+				in[lane] = &lanes.buf[i + lane][(interp_pos >> 12) + lanes.buf_pos[i + lane]];
+				fwd[lane] = gauss + 255 - offset;
+				rev[lane] = gauss + offset;
+			}
+
+			__m128i out;
+			out = _mm_srai_epi32(_mm_mullo_epi32(
+				_mm_setr_epi32(fwd[0][0], fwd[1][0], fwd[2][0], fwd[3][0]),
+				_mm_setr_epi32(in[0][0], in[1][0], in[2][0], in[3][0])), 11);
+			out = _mm_add_epi32(out, _mm_srai_epi32(_mm_mullo_epi32(
+				_mm_setr_epi32(fwd[0][256], fwd[1][256], fwd[2][256], fwd[3][256]),
+				_mm_setr_epi32(in[0][1], in[1][1], in[2][1], in[3][1])), 11));
+			out = _mm_add_epi32(out, _mm_srai_epi32(_mm_mullo_epi32(
+				_mm_setr_epi32(rev[0][256], rev[1][256], rev[2][256], rev[3][256]),
+				_mm_setr_epi32(in[0][2], in[1][2], in[2][2], in[3][2])), 11));
+			out = _mm_srai_epi32(_mm_slli_epi32(out, 16), 16);
+			out = _mm_add_epi32(out, _mm_srai_epi32(_mm_mullo_epi32(
+				_mm_setr_epi32(rev[0][0], rev[1][0], rev[2][0], rev[3][0]),
+				_mm_setr_epi32(in[0][3], in[1][3], in[2][3], in[3][3])), 11));
+			out = _mm_min_epi32(_mm_max_epi32(out, min16), max16);
+			out = _mm_and_si128(out, even);
+
+			out = _mm_blendv_epi8(out, noise, _mm_loadu_si128((const __m128i *)&lanes.noise_mask[i]));
+
+			out = _mm_and_si128(_mm_srai_epi32(_mm_mullo_epi32(out, _mm_loadu_si128((const __m128i *)&lanes.env[i])), 11), even);
+			_mm_storeu_si128((__m128i *)&lanes.output[i], out);
+
+			const __m128i echo_mask = _mm_loadu_si128((const __m128i *)&lanes.echo_mask[i]);
+			for (int ch = 0; ch < 2; ch++) {
+				__m128i amp = _mm_srai_epi32(_mm_mullo_epi32(out, _mm_loadu_si128((const __m128i *)&lanes.volume[ch][i])), 7);
+				_mm_storeu_si128((__m128i *)&lanes.amp[ch][i], amp);
+				_mm_storeu_si128((__m128i *)&lanes.echo_amp[ch][i], _mm_and_si128(amp, echo_mask));
+			}
+		}
+	}
+
+	TARGET_SSE41 virtual int RunFIR(const int32_t * history, const int32_t * coefficients) const
+	{
+		__m128i lo = _mm_srai_epi32(_mm_mullo_epi32(_mm_loadu_si128((const __m128i *)&history[0]), _mm_loadu_si128((const __m128i *)&coefficients[0])), 6);
+		__m128i hi = _mm_srai_epi32(_mm_mullo_epi32(_mm_loadu_si128((const __m128i *)&history[4]), _mm_loadu_si128((const __m128i *)&coefficients[4])), 6);
+
+		// the newest tap is added after the first seven wrap to 16 bits
+		int last = _mm_extract_epi32(hi, 3);
+		__m128i sum = _mm_add_epi32(lo, _mm_insert_epi32(hi, 0, 3));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		int result = (int16_t)_mm_cvtsi128_si32(sum);
+		result += (int16_t)last;
+		CLAMP16(result);
+		return result & ~1;
+	}
+};
+
+//============================================================================
+// AVX2 (all eight voices per vector)
+//============================================================================
+
+class SPCDSPAVX2Kernel : public SPCDSPKernel
+{
+public:
+	virtual const char * GetName() const
+	{
+		return "avx2";
+	}
+
+	TARGET_AVX2 virtual void RunVoices(SPCDSPVoiceLanes & lanes) const
+	{
+		const __m256i min16 = _mm256_set1_epi32(-32768);
+		const __m256i max16 = _mm256_set1_epi32(32767);
+		const __m256i even = _mm256_set1_epi32(~1);
+		const __m256i noise = _mm256_set1_epi32(lanes.noise);
+		const __m256i lane_base = _mm256_setr_epi32(0, BUF_STRIDE, BUF_STRIDE * 2, BUF_STRIDE * 3,
+			BUF_STRIDE * 4, BUF_STRIDE * 5, BUF_STRIDE * 6, BUF_STRIDE * 7);
+
+		__m256i interp_pos = _mm256_loadu_si256((const __m256i *)lanes.interp_pos);
+		__m256i offset = _mm256_and_si256(_mm256_srai_epi32(interp_pos, 4), _mm256_set1_epi32(0xff));
+		__m256i index = _mm256_add_epi32(_mm256_add_epi32(_mm256_srai_epi32(interp_pos, 12),
+			_mm256_loadu_si256((const __m256i *)lanes.buf_pos)), lane_base);
+		__m256i fwd = _mm256_sub_epi32(_mm256_set1_epi32(255), offset);
+
+		const int * buf = (const int *)&lanes.buf[0][0];
+		const int * table = (const int *)gauss;
+
+		__m256i out;
+		out = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_i32gather_epi32(table, fwd, 4), _mm256_i32gather_epi32(buf, index, 4)), 11);
+		out = _mm256_add_epi32(out, _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_i32gather_epi32(table + 256, fwd, 4), _mm256_i32gather_epi32(buf + 1, index, 4)), 11));
+		out = _mm256_add_epi32(out, _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_i32gather_epi32(table + 256, offset, 4), _mm256_i32gather_epi32(buf + 2, index, 4)), 11));
+		out = _mm256_srai_epi32(_mm256_slli_epi32(out, 16), 16);
+		out = _mm256_add_epi32(out, _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_i32gather_epi32(table, offset, 4), _mm256_i32gather_epi32(buf + 3, index, 4)), 11));
+		out = _mm256_min_epi32(_mm256_max_epi32(out, min16), max16);
+		out = _mm256_and_si256(out, even);
+
+		out = _mm256_blendv_epi8(out, noise, _mm256_loadu_si256((const __m256i *)lanes.noise_mask));
+
+		out = _mm256_and_si256(_mm256_srai_epi32(_mm256_mullo_epi32(out, _mm256_loadu_si256((const __m256i *)lanes.env)), 11), even);
+		_mm256_storeu_si256((__m256i *)lanes.output, out);
+
+		const __m256i echo_mask = _mm256_loadu_si256((const __m256i *)lanes.echo_mask);
+		for (int ch = 0; ch < 2; ch++) {
+			__m256i amp = _mm256_srai_epi32(_mm256_mullo_epi32(out, _mm256_loadu_si256((const __m256i *)lanes.volume[ch])), 7);
+			_mm256_storeu_si256((__m256i *)lanes.amp[ch], amp);
+			_mm256_storeu_si256((__m256i *)lanes.echo_amp[ch], _mm256_and_si256(amp, echo_mask));
+		}
+	}
+
+	TARGET_AVX2 virtual int RunFIR(const int32_t * history, const int32_t * coefficients) const
+	{
+		__m256i taps = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)history), _mm256_loadu_si256((const __m256i *)coefficients)), 6);
+
+		// the newest tap is added after the first seven wrap to 16 bits
+		int last = _mm256_extract_epi32(taps, 7);
+		taps = _mm256_blend_epi32(taps, _mm256_setzero_si256(), 0x80);
+
+		__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(taps), _mm256_extracti128_si256(taps, 1));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		int result = (int16_t)_mm_cvtsi128_si32(sum);
+		result += (int16_t)last;
+		CLAMP16(result);
+		return result & ~1;
+	}
+};
+
+static bool cpu_supports_sse41()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 19)) != 0;
+#else
+	return __builtin_cpu_supports("sse4.1") != 0;
+#endif
+}
+
+static bool cpu_supports_avx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+
+	// the OS must also save the YMM registers
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif /* SPCDSP_X86 */
+
+static const SPCDSPScalarKernel scalar_kernel;
+#ifdef SPCDSP_X86
+static const SPCDSPSSE41Kernel sse41_kernel;
+static const SPCDSPAVX2Kernel avx2_kernel;
+#endif
+
+const SPCDSPKernel * SPCDSPKernel::GetDefault()
+{
+#ifdef SPCDSP_X86
+	static const SPCDSPKernel * kernel =
+		cpu_supports_avx2() ? (const SPCDSPKernel *)&avx2_kernel :
+		cpu_supports_sse41() ? (const SPCDSPKernel *)&sse41_kernel :
+		(const SPCDSPKernel *)&scalar_kernel;
+	return kernel;
+#else
+	return &scalar_kernel;
+#endif
+}
+
+const SPCDSPKernel * SPCDSPKernel::Find(const std::string & name)
+{
+	if (name == "scalar") {
+		return &scalar_kernel;
+	}
+#ifdef SPCDSP_X86
+	else if (name == "sse4" && cpu_supports_sse41()) {
+		return &sse41_kernel;
+	}
+	else if (name == "avx2" && cpu_supports_avx2()) {
+		return &avx2_kernel;
+	}
+#endif
+	return NULL;
+}
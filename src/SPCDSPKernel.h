@@ -0,0 +1,56 @@
+/**
+ * Data-parallel parts of the S-DSP: the eight voices are processed as lanes.
+ * Every kernel must produce results bit-identical to the scalar one.
+ */
+
+#ifndef SPCDSPKERNEL_H_INCLUDED
+#define SPCDSPKERNEL_H_INCLUDED
+
+#include <stdint.h>
+
+#include <string>
+
+// Voice state in structure-of-arrays form, one lane per voice.
+// Kept between samples so the kernels never wait on scattered scalar stores.
+struct SPCDSPVoiceLanes {
+	static const int BRR_BUF_SIZE = 12;
+
+	// voice state
+	int32_t buf[8][BRR_BUF_SIZE * 2];	// decoded samples, second half mirrors the first
+	int32_t buf_pos[8];
+	int32_t interp_pos[8];
+	int32_t env[8];
+
+	// mirrored registers
+	int32_t noise_mask[8];				// -1 for voices playing noise
+	int32_t volume[2][8];				// 0 for muted voices
+	int32_t echo_mask[8];				// -1 for voices feeding the echo
+	int32_t noise;						// noise output, already doubled and wrapped
+
+	// outputs
+	int32_t output[8];					// after envelope, before volume
+	int32_t amp[2][8];
+	int32_t echo_amp[2][8];
+};
+
+class SPCDSPKernel
+{
+public:
+	virtual ~SPCDSPKernel() {}
+
+	virtual const char * GetName() const = 0;
+
+	// Gaussian interpolation, envelope and volume for all eight voices.
+	virtual void RunVoices(SPCDSPVoiceLanes & lanes) const = 0;
+
+	// Eight-tap echo FIR over history (oldest first), returns the filtered sample.
+	virtual int RunFIR(const int32_t * history, const int32_t * coefficients) const = 0;
+
+	// The fastest kernel supported by the running CPU.
+	static const SPCDSPKernel * GetDefault();
+
+	// "scalar", "sse4" or "avx2". Returns NULL if unknown or not supported by the CPU.
+	static const SPCDSPKernel * Find(const std::string & name);
+};
+
+#endif /* !SPCDSPKERNEL_H_INCLUDED */
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPCDIFF_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "SPCDiff.h"
+
+void SPCDiff::Compare(const SPCFile & a, const SPCFile & b, Result & result)
+{
+	result = Result();
+
+	if (a.regs.pc != b.regs.pc) {
+		result.registers.push_back("pc");
+	}
+	if (a.regs.a != b.regs.a) {
+		result.registers.push_back("a");
+	}
+	if (a.regs.x != b.regs.x) {
+		result.registers.push_back("x");
+	}
+	if (a.regs.y != b.regs.y) {
+		result.registers.push_back("y");
+	}
+	if (a.regs.psw != b.regs.psw) {
+		result.registers.push_back("psw");
+	}
+	if (a.regs.sp != b.regs.sp) {
+		result.registers.push_back("sp");
+	}
+
+	// both maps are in name order, so walk them side by side
+	std::map<std::string, std::string> a_tags = a.ExportPSFTag(true);
+	std::map<std::string, std::string> b_tags = b.ExportPSFTag(true);
+	auto a_itr = a_tags.begin();
+	auto b_itr = b_tags.begin();
+	while (a_itr != a_tags.end() || b_itr != b_tags.end()) {
+		if (b_itr == b_tags.end() || (a_itr != a_tags.end() && a_itr->first < b_itr->first)) {
+			result.tags.push_back(a_itr->first);
+			++a_itr;
+		}
+		else if (a_itr == a_tags.end() || b_itr->first < a_itr->first) {
+			result.tags.push_back(b_itr->first);
+			++b_itr;
+		}
+		else {
+			if (a_itr->second != b_itr->second) {
+				result.tags.push_back(a_itr->first);
+			}
+			++a_itr;
+			++b_itr;
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(a.dsp); i++) {
+		if (a.dsp[i] != b.dsp[i]) {
+			result.dsp_registers.push_back((uint8_t)i);
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(a.extra_ram); i++) {
+		if (a.extra_ram[i] != b.extra_ram[i]) {
+			result.extra_ram_offsets.push_back((uint8_t)i);
+		}
+	}
+
+	for (size_t page = 0; page < PAGE_COUNT; page++) {
+		if (PageDiffers(&a.ram[page * PAGE_SIZE], &b.ram[page * PAGE_SIZE])) {
+			result.ram_pages.push_back((uint8_t)page);
+		}
+	}
+}
+
+bool SPCDiff::PageDiffers(const uint8_t * a, const uint8_t * b)
+{
+#ifdef SPCDIFF_SSE2
+	// OR the differences of the whole page together and test once at the end
+	__m128i diff = _mm_setzero_si128();
+	for (size_t i = 0; i < PAGE_SIZE; i += 16) {
+		__m128i block_a = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i block_b = _mm_loadu_si128((const __m128i *)(b + i));
+		diff = _mm_or_si128(diff, _mm_xor_si128(block_a, block_b));
+	}
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xffff;
+#else
+	return memcmp(a, b, PAGE_SIZE) != 0;
+#endif
+}
+
+size_t SPCDiff::CountDifferences(const uint8_t * a, const uint8_t * b, size_t size, size_t & first_offset)
+{
+	size_t count = 0;
+	first_offset = size;
+	for (size_t i = 0; i < size; i++) {
+		if (a[i] != b[i]) {
+			if (count == 0) {
+				first_offset = i;
+			}
+			count++;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,44 @@
+/**
+ * Differences between two SPC files: CPU registers, tags, DSP registers and RAM by 256-byte page.
+ */
+
+#ifndef SPCDIFF_H_INCLUDED
+#define SPCDIFF_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "SPCFile.h"
+
+class SPCDiff
+{
+public:
+	static const size_t PAGE_SIZE = 0x100;
+	static const size_t PAGE_COUNT = 0x100;
+
+	struct Result {
+		std::vector<const char *> registers;	// "pc", "a", "x", "y", "psw", "sp"
+		std::vector<std::string> tags;			// PSF tag names, including unofficial ones
+		std::vector<uint8_t> dsp_registers;
+		std::vector<uint8_t> extra_ram_offsets;
+		std::vector<uint8_t> ram_pages;
+
+		bool IsEmpty() const
+		{
+			return registers.empty() && tags.empty() && dsp_registers.empty() && extra_ram_offsets.empty() && ram_pages.empty();
+		}
+	};
+
+	static void Compare(const SPCFile & a, const SPCFile & b, Result & result);
+
+	// Whether two 256-byte pages differ, 16 bytes at a time with SSE2.
+	static bool PageDiffers(const uint8_t * a, const uint8_t * b);
+
+	// Number of differing bytes and the offset of the first one (size if none).
+	static size_t CountDifferences(const uint8_t * a, const uint8_t * b, size_t size, size_t & first_offset);
+};
+
+#endif /* !SPCDIFF_H_INCLUDED */
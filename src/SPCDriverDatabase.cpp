@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <algorithm>
+
+#include "SPCDriverDatabase.h"
+#include "SPCFile.h"
+
+SPCDriverDatabase::SPCDriverDatabase()
+{
+}
+
+SPCDriverDatabase::~SPCDriverDatabase()
+{
+}
+
+static int hex_digit_value(int c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c = tolower(c);
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+bool SPCDriverDatabase::Load(const std::string & filename)
+{
+	FILE * fp = fopen(filename.c_str(), "r");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Unable to open \"%s\"\n", filename.c_str());
+		return false;
+	}
+
+	bool ok = true;
+	char line[1024];
+	int line_number = 0;
+	while (ok && fgets(line, sizeof(line), fp) != NULL) {
+		line_number++;
+
+		char * comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+
+		const char * separators = " \t\r\n";
+		char * name = strtok(line, separators);
+		if (name == NULL) {
+			continue;
+		}
+
+		std::vector<uint8_t> pattern;
+		int32_t address = ANYWHERE;
+		char * token;
+		while (ok && (token = strtok(NULL, separators)) != NULL) {
+			if (token[0] == '@') {
+				char * endptr = NULL;
+				if (strcmp(token, "@pc") == 0) {
+					address = AT_PC;
+				}
+				else {
+					long value = strtol(token + 1, &endptr, 16);
+					if (token[1] == '\0' || *endptr != '\0' || value < 0 || value > 0xffff) {
+						ok = false;
+					}
+					address = (int32_t)value;
+				}
+				continue;
+			}
+
+			size_t length = strlen(token);
+			for (size_t i = 0; ok && i < length; i += 2) {
+				int high = hex_digit_value(token[i]);
+				int low = (i + 1 < length) ? hex_digit_value(token[i + 1]) : -1;
+				if (high < 0 || low < 0) {
+					ok = false;
+				}
+				pattern.push_back((uint8_t)((high << 4) | low));
+			}
+		}
+
+		if (!ok || pattern.empty()) {
+			fprintf(stderr, "Error: %s:%d: Illegal signature\n", filename.c_str(), line_number);
+			ok = false;
+			break;
+		}
+
+		auto driver = std::find(drivers.begin(), drivers.end(), std::string(name));
+		Signature signature;
+		signature.driver = driver - drivers.begin();
+		signature.address = address;
+		if (driver == drivers.end()) {
+			drivers.push_back(name);
+		}
+
+		matcher.AddPattern(pattern.data(), pattern.size());
+		signatures.push_back(signature);
+	}
+	fclose(fp);
+
+	matcher.Build();
+	return ok;
+}
+
+std::vector<std::string> SPCDriverDatabase::Identify(const SPCFile & spc) const
+{
+	std::vector<bool> matched(drivers.size(), false);
+	matcher.Find(spc.ram, sizeof(spc.ram), [&](size_t id, size_t offset) {
+		const Signature & signature = signatures[id];
+		if (signature.address == ANYWHERE ||
+			(signature.address == AT_PC && offset == spc.regs.pc) ||
+			(size_t)signature.address == offset) {
+			matched[signature.driver] = true;
+		}
+	});
+
+	std::vector<std::string> names;
+	for (size_t i = 0; i < drivers.size(); i++) {
+		if (matched[i]) {
+			names.push_back(drivers[i]);
+		}
+	}
+	return names;
+}
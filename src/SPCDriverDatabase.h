@@ -0,0 +1,55 @@
+/**
+ * Sound driver identification by byte signatures in the SPC700 RAM image.
+ * All signatures are searched in a single pass over the RAM.
+ */
+
+#ifndef SPCDRIVERDATABASE_H_INCLUDED
+#define SPCDRIVERDATABASE_H_INCLUDED
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "AhoCorasick.h"
+
+class SPCFile;
+
+class SPCDriverDatabase
+{
+public:
+	SPCDriverDatabase();
+	virtual ~SPCDriverDatabase();
+
+	// Text file, one signature per line: "name hex-bytes [@address | @pc]".
+	// Bytes may be separated by spaces; "@" pins the signature to an address
+	// or to the saved program counter. "#" starts a comment.
+	// A driver may have several signatures; any of them identifies it.
+	bool Load(const std::string & filename);
+
+	size_t GetSignatureCount() const
+	{
+		return signatures.size();
+	}
+
+	// Names of the matching drivers in database order, empty if unknown.
+	std::vector<std::string> Identify(const SPCFile & spc) const;
+
+private:
+	SPCDriverDatabase(const SPCDriverDatabase&);
+	SPCDriverDatabase& operator=(const SPCDriverDatabase&);
+
+	static const int32_t ANYWHERE = -1;
+	static const int32_t AT_PC = -2;
+
+	struct Signature {
+		size_t driver;
+		int32_t address;
+	};
+
+	std::vector<std::string> drivers;
+	std::vector<Signature> signatures;	// indexed by pattern id
+	AhoCorasick matcher;
+};
+
+#endif /* !SPCDRIVERDATABASE_H_INCLUDED */
@@ -0,0 +1,1364 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "SPCEmulator.h"
+#include "SPCFile.h"
+
+const uint8_t SPCEmulator::ipl_rom[0x40] = {
+	0xcd, 0xef, 0xbd, 0xe8, 0x00, 0xc6, 0x1d, 0xd0, 0xfc, 0x8f, 0xaa, 0xf4, 0x8f, 0xbb, 0xf5, 0x78,
+	0xcc, 0xf4, 0xd0, 0xfb, 0x2f, 0x19, 0xeb, 0xf4, 0xd0, 0xfc, 0x7e, 0xf4, 0xd0, 0x0b, 0xe4, 0xf5,
+	0xcb, 0xf4, 0xd7, 0x00, 0xfc, 0xd0, 0xf3, 0xab, 0x01, 0x10, 0xef, 0x7e, 0xf4, 0x10, 0xeb, 0xba,
+	0xf6, 0xda, 0x00, 0xba, 0xf4, 0xc4, 0xf4, 0xdd, 0x5d, 0xd0, 0xdb, 0x1f, 0x00, 0x00, 0xc0, 0xff
+};
+
+// Base cycle counts; taken branches add two more.
+static const uint8_t cycle_table[256] = {
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+	2, 8, 4, 5, 3, 4, 3, 6, 2, 6, 5, 4, 5, 4, 6, 8, // 0
+	2, 8, 4, 5, 4, 5, 5, 6, 5, 5, 6, 5, 2, 2, 4, 6, // 1
+	2, 8, 4, 5, 3, 4, 3, 6, 2, 6, 5, 4, 5, 4, 5, 2, // 2
+	2, 8, 4, 5, 4, 5, 5, 6, 5, 5, 6, 5, 2, 2, 3, 8, // 3
+	2, 8, 4, 5, 3, 4, 3, 6, 2, 6, 4, 4, 5, 4, 6, 6, // 4
+	2, 8, 4, 5, 4, 5, 5, 6, 5, 5, 4, 5, 2, 2, 4, 3, // 5
+	2, 8, 4, 5, 3, 4, 3, 6, 2, 6, 4, 4, 5, 4, 5, 5, // 6
+	2, 8, 4, 5, 4, 5, 5, 6, 5, 5, 5, 5, 2, 2, 3, 6, // 7
+	2, 8, 4, 5, 3, 4, 3, 6, 2, 6, 5, 4, 5, 2, 4, 5, // 8
+	2, 8, 4, 5, 4, 5, 5, 6, 5, 5, 5, 5, 2, 2,12, 5, // 9
+	3, 8, 4, 5, 3, 4, 3, 6, 2, 6, 4, 4, 5, 2, 4, 4, // A
+	2, 8, 4, 5, 4, 5, 5, 6, 5, 5, 5, 5, 2, 2, 3, 4, // B
+	3, 8, 4, 5, 4, 5, 4, 7, 2, 5, 6, 4, 5, 2, 4, 9, // C
+	2, 8, 4, 5, 5, 6, 6, 7, 4, 5, 5, 5, 2, 2, 6, 3, // D
+	2, 8, 4, 5, 3, 4, 3, 6, 2, 4, 5, 3, 4, 3, 4, 3, // E
+	2, 8, 4, 5, 4, 5, 5, 6, 3, 4, 5, 4, 2, 2, 4, 3  // F
+};
+
+SPCEmulator::SPCEmulator()
+{
+	memset(ram, 0, sizeof(ram));
+	pc = 0xffc0;
+	a = x = y = 0;
+	psw = 0;
+	sp = 0xef;
+	halted = false;
+	dsp_addr = 0;
+	memset(ports_in, 0, sizeof(ports_in));
+	rom_enabled = true;
+	memset(timers, 0, sizeof(timers));
+	time = 0;
+	sample_time = CLOCKS_PER_SAMPLE;
+}
+
+SPCEmulator::~SPCEmulator()
+{
+}
+
+void SPCEmulator::Load(const SPCFile & spc)
+{
+	memcpy(ram, spc.ram, sizeof(ram));
+
+	pc = spc.regs.pc;
+	a = spc.regs.a;
+	x = spc.regs.x;
+	y = spc.regs.y;
+	psw = spc.regs.psw;
+	sp = spc.regs.sp;
+	halted = false;
+	time = 0;
+	sample_time = CLOCKS_PER_SAMPLE;
+
+	// I/O state lives in the RAM image at $F0-$FF
+	uint8_t control = ram[0xf1];
+	rom_enabled = (control & 0x80) != 0;
+	if (rom_enabled) {
+		// the RAM hidden under the IPL ROM is stored separately
+		memcpy(&ram[0xffc0], spc.extra_ram, 0x40);
+	}
+
+	dsp_addr = ram[0xf2];
+	memcpy(ports_in, &ram[0xf4], 4);
+
+	for (int i = 0; i < 3; i++) {
+		Timer & timer = timers[i];
+		timer.prescaler = (i == 2) ? 16 : 128;
+		timer.next_time = timer.prescaler;
+		timer.period = (ram[0xfa + i] != 0) ? ram[0xfa + i] : 256;
+		timer.divider = 0;
+		timer.counter = ram[0xfd + i] & 0x0f;
+		timer.enabled = ((control >> i) & 1) != 0;
+	}
+
+	dsp.Reset(ram, spc.dsp);
+}
+
+void SPCEmulator::Render(int16_t * out, size_t num_frames)
+{
+	int16_t discard[2];
+
+	for (size_t i = 0; i < num_frames; i++) {
+		// the CPU may overshoot a boundary, so boundaries are kept absolute
+		RunCPU(sample_time);
+		sample_time += CLOCKS_PER_SAMPLE;
+
+		dsp.RunSample((out != NULL) ? &out[i * 2] : discard);
+	}
+}
+
+#define SAVE_FIELD(field) \
+	state.insert(state.end(), (const uint8_t *)&(field), (const uint8_t *)&(field) + sizeof(field))
+
+#define LOAD_FIELD(field) \
+	memcpy(&(field), &state[offset], sizeof(field)); offset += sizeof(field)
+
+void SPCEmulator::SaveState(std::vector<uint8_t> & state) const
+{
+	SAVE_FIELD(pc);
+	SAVE_FIELD(a);
+	SAVE_FIELD(x);
+	SAVE_FIELD(y);
+	SAVE_FIELD(psw);
+	SAVE_FIELD(sp);
+	SAVE_FIELD(halted);
+	SAVE_FIELD(dsp_addr);
+	SAVE_FIELD(ports_in);
+	SAVE_FIELD(rom_enabled);
+	SAVE_FIELD(timers);
+	SAVE_FIELD(time);
+	SAVE_FIELD(sample_time);
+	dsp.SaveState(state);
+}
+
+bool SPCEmulator::LoadState(const std::vector<uint8_t> & state)
+{
+	size_t expected = sizeof(pc) + sizeof(a) + sizeof(x) + sizeof(y) + sizeof(psw) + sizeof(sp) +
+		sizeof(halted) + sizeof(dsp_addr) + sizeof(ports_in) + sizeof(rom_enabled) + sizeof(timers) +
+		sizeof(time) + sizeof(sample_time);
+	if (state.size() < expected) {
+		return false;
+	}
+
+	size_t offset = 0;
+	LOAD_FIELD(pc);
+	LOAD_FIELD(a);
+	LOAD_FIELD(x);
+	LOAD_FIELD(y);
+	LOAD_FIELD(psw);
+	LOAD_FIELD(sp);
+	LOAD_FIELD(halted);
+	LOAD_FIELD(dsp_addr);
+	LOAD_FIELD(ports_in);
+	LOAD_FIELD(rom_enabled);
+	LOAD_FIELD(timers);
+	LOAD_FIELD(time);
+	LOAD_FIELD(sample_time);
+
+	size_t dsp_size = dsp.LoadState(state.data() + offset, state.size() - offset);
+	return dsp_size != 0 && offset + dsp_size == state.size();
+}
+
+void SPCEmulator::RunTimer(Timer & timer, int64_t time)
+{
+	if (time < timer.next_time) {
+		return;
+	}
+
+	int elapsed = (int)((time - timer.next_time) / timer.prescaler) + 1;
+	timer.next_time += (int64_t)timer.prescaler * elapsed;
+
+	if (timer.enabled) {
+		int remain = timer.period - timer.divider;
+		if (remain <= 0) {
+			remain += 256;
+		}
+
+		int divider = timer.divider + elapsed;
+		int over = elapsed - remain;
+		if (over >= 0) {
+			int n = over / timer.period;
+			timer.counter = (timer.counter + 1 + n) & 0x0f;
+			divider = over - n * timer.period;
+		}
+		timer.divider = divider & 0xff;
+	}
+}
+
+int64_t SPCEmulator::GetNextTickTime(const Timer & timer) const
+{
+	if (!timer.enabled) {
+		return INT64_MAX;
+	}
+
+	int remain = timer.period - timer.divider;
+	if (remain <= 0) {
+		remain += 256;
+	}
+	return timer.next_time + (int64_t)(remain - 1) * timer.prescaler;
+}
+
+int64_t SPCEmulator::GetTimerPollSkip(int64_t loop_time, int64_t end_time)
+{
+	// `mov a/x/y, $fd-$ff` followed by `beq` back to it, with the direct page at $00xx
+	if (pc < 0x0100 || pc >= 0xffbc || (psw & PSW_P) != 0) {
+		return 0;
+	}
+
+	uint8_t mov = ram[pc];
+	uint8_t operand = ram[pc + 1];
+	if ((mov != 0xe4 && mov != 0xf8 && mov != 0xeb) || operand < 0xfd ||
+		ram[pc + 2] != 0xf0 || ram[pc + 3] != 0xfc) {
+		return 0;
+	}
+
+	Timer & timer = timers[operand - 0xfd];
+	RunTimer(timer, loop_time);
+	if (timer.counter != 0) {
+		return 0;
+	}
+
+	// every read before the next tick returns zero and changes nothing,
+	// so whole iterations up to it (or the end of the slice) can be skipped
+	const int loop_cycles = 3 + 4;
+	int64_t target = std::min(GetNextTickTime(timer), end_time);
+	if (target <= loop_time) {
+		return 0;
+	}
+	return (target - loop_time + loop_cycles - 1) / loop_cycles * loop_cycles;
+}
+
+uint8_t SPCEmulator::ReadIO(uint16_t addr)
+{
+	switch (addr) {
+	case 0xf2:
+		return dsp_addr;
+
+	case 0xf3:
+		return dsp.Read(dsp_addr);
+
+	case 0xf4:
+	case 0xf5:
+	case 0xf6:
+	case 0xf7:
+		return ports_in[addr - 0xf4];
+
+	case 0xf8:
+	case 0xf9:
+		return ram[addr];
+
+	case 0xfd:
+	case 0xfe:
+	case 0xff:
+	{
+		Timer & timer = timers[addr - 0xfd];
+		RunTimer(timer, time);
+
+		uint8_t counter = (uint8_t)timer.counter;
+		timer.counter = 0;
+		return counter;
+	}
+
+	default:
+		// TEST, CONTROL and the timer targets are write-only
+		return 0;
+	}
+}
+
+void SPCEmulator::WriteIO(uint16_t addr, uint8_t data)
+{
+	switch (addr) {
+	case 0xf1:
+		WriteControl(data);
+		break;
+
+	case 0xf2:
+		dsp_addr = data;
+		break;
+
+	case 0xf3:
+		if (dsp_addr < 0x80) {
+			dsp.Write(dsp_addr, data);
+		}
+		break;
+
+	case 0xfa:
+	case 0xfb:
+	case 0xfc:
+	{
+		Timer & timer = timers[addr - 0xfa];
+		RunTimer(timer, time);
+		timer.period = (data != 0) ? data : 256;
+		break;
+	}
+
+	default:
+		// TEST, output ports and counters have no effect on playback
+		break;
+	}
+}
+
+void SPCEmulator::WriteControl(uint8_t data)
+{
+	// port clear bits
+	if ((data & 0x10) != 0) {
+		ports_in[0] = ports_in[1] = 0;
+	}
+	if ((data & 0x20) != 0) {
+		ports_in[2] = ports_in[3] = 0;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		Timer & timer = timers[i];
+		bool enabled = ((data >> i) & 1) != 0;
+
+		RunTimer(timer, time);
+		if (enabled && !timer.enabled) {
+			timer.divider = 0;
+			timer.counter = 0;
+		}
+		timer.enabled = enabled;
+	}
+
+	rom_enabled = (data & 0x80) != 0;
+}
+
+#define SET_NZ(v)       { psw = (psw & ~(PSW_N | PSW_Z)) | ((v) & 0x80) | (((uint8_t)(v) == 0) ? PSW_Z : 0); }
+#define SET_NZ16(v)     { psw = (psw & ~(PSW_N | PSW_Z)) | (((v) >> 8) & 0x80) | (((uint16_t)(v) == 0) ? PSW_Z : 0); }
+
+#define FETCH()         Read(pc++)
+#define DP(off)         ((uint16_t)(((psw & PSW_P) << 3) | ((off) & 0xff)))
+#define READ_DP16(off)  (Read(DP(off)) | (Read(DP((off) + 1)) << 8))
+
+#define BRANCH(cond) {                      \
+	int8_t rel = (int8_t)FETCH();           \
+	if (cond) {                             \
+		pc = (uint16_t)(pc + rel);          \
+		cycles += 2;                        \
+	}                                       \
+}
+
+// With GCC and Clang every handler jumps straight to the next one through
+// a label table, which gives each its own indirect branch to predict.
+// Other compilers loop around the switch.
+#if defined(__GNUC__)
+#define SPC_THREADED_CODE
+#endif
+
+#ifdef SPC_THREADED_CODE
+#define OPCODE(n)       case 0x##n: op_##n:
+#define NEXT() {                            \
+	time += cycles;                         \
+	if (time >= end_time) {                 \
+		goto done;                          \
+	}                                       \
+	opcode = FETCH();                       \
+	cycles = cycle_table[opcode];           \
+	goto *handlers[opcode];                 \
+}
+#else
+#define OPCODE(n)       case 0x##n:
+#define NEXT()          break
+#endif
+
+#define PUSH(v)         { ram[0x100 | sp] = (uint8_t)(v); sp--; }
+#define POP()           (sp++, ram[0x100 | sp])
+
+void SPCEmulator::RunCPU(int64_t end_time)
+{
+	if (halted) {
+		if (time < end_time) {
+			time = end_time;
+		}
+		return;
+	}
+
+#ifdef SPC_THREADED_CODE
+	static const void * const handlers[256] = {
+		&&op_00, &&op_01, &&op_02, &&op_03, &&op_04, &&op_05, &&op_06, &&op_07,
+		&&op_08, &&op_09, &&op_0A, &&op_0B, &&op_0C, &&op_0D, &&op_0E, &&op_0F,
+		&&op_10, &&op_11, &&op_12, &&op_13, &&op_14, &&op_15, &&op_16, &&op_17,
+		&&op_18, &&op_19, &&op_1A, &&op_1B, &&op_1C, &&op_1D, &&op_1E, &&op_1F,
+		&&op_20, &&op_21, &&op_22, &&op_23, &&op_24, &&op_25, &&op_26, &&op_27,
+		&&op_28, &&op_29, &&op_2A, &&op_2B, &&op_2C, &&op_2D, &&op_2E, &&op_2F,
+		&&op_30, &&op_31, &&op_32, &&op_33, &&op_34, &&op_35, &&op_36, &&op_37,
+		&&op_38, &&op_39, &&op_3A, &&op_3B, &&op_3C, &&op_3D, &&op_3E, &&op_3F,
+		&&op_40, &&op_41, &&op_42, &&op_43, &&op_44, &&op_45, &&op_46, &&op_47,
+		&&op_48, &&op_49, &&op_4A, &&op_4B, &&op_4C, &&op_4D, &&op_4E, &&op_4F,
+		&&op_50, &&op_51, &&op_52, &&op_53, &&op_54, &&op_55, &&op_56, &&op_57,
+		&&op_58, &&op_59, &&op_5A, &&op_5B, &&op_5C, &&op_5D, &&op_5E, &&op_5F,
+		&&op_60, &&op_61, &&op_62, &&op_63, &&op_64, &&op_65, &&op_66, &&op_67,
+		&&op_68, &&op_69, &&op_6A, &&op_6B, &&op_6C, &&op_6D, &&op_6E, &&op_6F,
+		&&op_70, &&op_71, &&op_72, &&op_73, &&op_74, &&op_75, &&op_76, &&op_77,
+		&&op_78, &&op_79, &&op_7A, &&op_7B, &&op_7C, &&op_7D, &&op_7E, &&op_7F,
+		&&op_80, &&op_81, &&op_82, &&op_83, &&op_84, &&op_85, &&op_86, &&op_87,
+		&&op_88, &&op_89, &&op_8A, &&op_8B, &&op_8C, &&op_8D, &&op_8E, &&op_8F,
+		&&op_90, &&op_91, &&op_92, &&op_93, &&op_94, &&op_95, &&op_96, &&op_97,
+		&&op_98, &&op_99, &&op_9A, &&op_9B, &&op_9C, &&op_9D, &&op_9E, &&op_9F,
+		&&op_A0, &&op_A1, &&op_A2, &&op_A3, &&op_A4, &&op_A5, &&op_A6, &&op_A7,
+		&&op_A8, &&op_A9, &&op_AA, &&op_AB, &&op_AC, &&op_AD, &&op_AE, &&op_AF,
+		&&op_B0, &&op_B1, &&op_B2, &&op_B3, &&op_B4, &&op_B5, &&op_B6, &&op_B7,
+		&&op_B8, &&op_B9, &&op_BA, &&op_BB, &&op_BC, &&op_BD, &&op_BE, &&op_BF,
+		&&op_C0, &&op_C1, &&op_C2, &&op_C3, &&op_C4, &&op_C5, &&op_C6, &&op_C7,
+		&&op_C8, &&op_C9, &&op_CA, &&op_CB, &&op_CC, &&op_CD, &&op_CE, &&op_CF,
+		&&op_D0, &&op_D1, &&op_D2, &&op_D3, &&op_D4, &&op_D5, &&op_D6, &&op_D7,
+		&&op_D8, &&op_D9, &&op_DA, &&op_DB, &&op_DC, &&op_DD, &&op_DE, &&op_DF,
+		&&op_E0, &&op_E1, &&op_E2, &&op_E3, &&op_E4, &&op_E5, &&op_E6, &&op_E7,
+		&&op_E8, &&op_E9, &&op_EA, &&op_EB, &&op_EC, &&op_ED, &&op_EE, &&op_EF,
+		&&op_F0, &&op_F1, &&op_F2, &&op_F3, &&op_F4, &&op_F5, &&op_F6, &&op_F7,
+		&&op_F8, &&op_F9, &&op_FA, &&op_FB, &&op_FC, &&op_FD, &&op_FE, &&op_FF
+	};
+#endif
+
+	uint8_t opcode;
+	int cycles;
+
+	while (time < end_time) {
+		opcode = FETCH();
+		cycles = cycle_table[opcode];
+
+		switch (opcode) {
+		// ALU group: OR, AND, EOR, CMP, ADC, SBC in columns 4-9 of rows 0-B
+		OPCODE(04) OPCODE(05) OPCODE(06) OPCODE(07) OPCODE(08) OPCODE(09)
+		OPCODE(14) OPCODE(15) OPCODE(16) OPCODE(17) OPCODE(18) OPCODE(19)
+		OPCODE(24) OPCODE(25) OPCODE(26) OPCODE(27) OPCODE(28) OPCODE(29)
+		OPCODE(34) OPCODE(35) OPCODE(36) OPCODE(37) OPCODE(38) OPCODE(39)
+		OPCODE(44) OPCODE(45) OPCODE(46) OPCODE(47) OPCODE(48) OPCODE(49)
+		OPCODE(54) OPCODE(55) OPCODE(56) OPCODE(57) OPCODE(58) OPCODE(59)
+		OPCODE(64) OPCODE(65) OPCODE(66) OPCODE(67) OPCODE(68) OPCODE(69)
+		OPCODE(74) OPCODE(75) OPCODE(76) OPCODE(77) OPCODE(78) OPCODE(79)
+		OPCODE(84) OPCODE(85) OPCODE(86) OPCODE(87) OPCODE(88) OPCODE(89)
+		OPCODE(94) OPCODE(95) OPCODE(96) OPCODE(97) OPCODE(98) OPCODE(99)
+		OPCODE(A4) OPCODE(A5) OPCODE(A6) OPCODE(A7) OPCODE(A8) OPCODE(A9)
+		OPCODE(B4) OPCODE(B5) OPCODE(B6) OPCODE(B7) OPCODE(B8) OPCODE(B9)
+		{
+			int op = opcode >> 5;
+			uint16_t dst_addr = 0;
+			bool to_memory = false;
+			uint8_t lhs = a;
+			uint8_t rhs;
+
+			switch (opcode & 0x1f) {
+			case 0x04:
+				rhs = Read(DP(FETCH()));
+				break;
+
+			case 0x05:
+			{
+				uint16_t addr = FETCH();
+				addr |= FETCH() << 8;
+				rhs = Read(addr);
+				break;
+			}
+
+			case 0x06:
+				rhs = Read(DP(x));
+				break;
+
+			case 0x07:
+			{
+				uint8_t off = FETCH() + x;
+				rhs = Read((uint16_t)READ_DP16(off));
+				break;
+			}
+
+			case 0x08:
+				rhs = FETCH();
+				break;
+
+			case 0x09:
+				rhs = Read(DP(FETCH()));
+				dst_addr = DP(FETCH());
+				lhs = Read(dst_addr);
+				to_memory = true;
+				break;
+
+			case 0x14:
+				rhs = Read(DP(FETCH() + x));
+				break;
+
+			case 0x15:
+			case 0x16:
+			{
+				uint16_t addr = FETCH();
+				addr |= FETCH() << 8;
+				addr += ((opcode & 0x1f) == 0x15) ? x : y;
+				rhs = Read(addr);
+				break;
+			}
+
+			case 0x17:
+			{
+				uint8_t off = FETCH();
+				rhs = Read((uint16_t)(READ_DP16(off) + y));
+				break;
+			}
+
+			case 0x18:
+				rhs = FETCH();
+				dst_addr = DP(FETCH());
+				lhs = Read(dst_addr);
+				to_memory = true;
+				break;
+
+			default: // 0x19
+				rhs = Read(DP(y));
+				dst_addr = DP(x);
+				lhs = Read(dst_addr);
+				to_memory = true;
+				break;
+			}
+
+			int result;
+			switch (op) {
+			case 0: // OR
+				result = lhs | rhs;
+				SET_NZ(result);
+				break;
+
+			case 1: // AND
+				result = lhs & rhs;
+				SET_NZ(result);
+				break;
+
+			case 2: // EOR
+				result = lhs ^ rhs;
+				SET_NZ(result);
+				break;
+
+			case 3: // CMP
+				result = lhs - rhs;
+				psw = (psw & ~PSW_C) | ((result >= 0) ? PSW_C : 0);
+				SET_NZ(result);
+				// compare never writes back
+				to_memory = false;
+				result = lhs;
+				break;
+
+			default: // ADC, SBC
+			{
+				if (op == 5) {
+					rhs ^= 0xff;
+				}
+
+				result = lhs + rhs + (psw & PSW_C);
+				psw &= ~(PSW_C | PSW_H | PSW_V);
+				if (result > 0xff) {
+					psw |= PSW_C;
+				}
+				if (((lhs ^ rhs ^ result) & 0x10) != 0) {
+					psw |= PSW_H;
+				}
+				if ((~(lhs ^ rhs) & (lhs ^ result) & 0x80) != 0) {
+					psw |= PSW_V;
+				}
+				SET_NZ(result);
+				break;
+			}
+			}
+
+			if (to_memory) {
+				Write(dst_addr, (uint8_t)result);
+			}
+			else {
+				a = (uint8_t)result;
+			}
+
+			NEXT();
+		}
+
+		// shifts, rotates, increments and decrements
+		OPCODE(0B) OPCODE(0C) OPCODE(1B) OPCODE(1C)
+		OPCODE(2B) OPCODE(2C) OPCODE(3B) OPCODE(3C)
+		OPCODE(4B) OPCODE(4C) OPCODE(5B) OPCODE(5C)
+		OPCODE(6B) OPCODE(6C) OPCODE(7B) OPCODE(7C)
+		OPCODE(8B) OPCODE(8C) OPCODE(9B) OPCODE(9C)
+		OPCODE(AB) OPCODE(AC) OPCODE(BB) OPCODE(BC)
+		{
+			uint16_t addr = 0;
+			uint8_t value;
+			bool to_memory = true;
+
+			switch (opcode & 0x1f) {
+			case 0x0b:
+				addr = DP(FETCH());
+				value = Read(addr);
+				break;
+
+			case 0x0c:
+				addr = FETCH();
+				addr |= FETCH() << 8;
+				value = Read(addr);
+				break;
+
+			case 0x1b:
+				addr = DP(FETCH() + x);
+				value = Read(addr);
+				break;
+
+			default: // 0x1c
+				value = a;
+				to_memory = false;
+				break;
+			}
+
+			int result;
+			switch (opcode >> 5) {
+			case 0: // ASL
+				result = value << 1;
+				psw = (psw & ~PSW_C) | ((value >> 7) & PSW_C);
+				break;
+
+			case 1: // ROL
+				result = (value << 1) | (psw & PSW_C);
+				psw = (psw & ~PSW_C) | ((value >> 7) & PSW_C);
+				break;
+
+			case 2: // LSR
+				result = value >> 1;
+				psw = (psw & ~PSW_C) | (value & PSW_C);
+				break;
+
+			case 3: // ROR
+				result = (value >> 1) | ((psw & PSW_C) << 7);
+				psw = (psw & ~PSW_C) | (value & PSW_C);
+				break;
+
+			case 4: // DEC
+				result = value - 1;
+				break;
+
+			default: // INC
+				result = value + 1;
+				break;
+			}
+			SET_NZ(result);
+
+			if (to_memory) {
+				Write(addr, (uint8_t)result);
+			}
+			else {
+				a = (uint8_t)result;
+			}
+			NEXT();
+		}
+
+		// SET1 / CLR1 d.b
+		OPCODE(02) OPCODE(22) OPCODE(42) OPCODE(62) OPCODE(82) OPCODE(A2) OPCODE(C2) OPCODE(E2)
+		OPCODE(12) OPCODE(32) OPCODE(52) OPCODE(72) OPCODE(92) OPCODE(B2) OPCODE(D2) OPCODE(F2)
+		{
+			uint16_t addr = DP(FETCH());
+			uint8_t mask = 1 << (opcode >> 5);
+			uint8_t value = Read(addr);
+			Write(addr, (opcode & 0x10) ? (value & ~mask) : (value | mask));
+			NEXT();
+		}
+
+		// BBS / BBC d.b, r
+		OPCODE(03) OPCODE(23) OPCODE(43) OPCODE(63) OPCODE(83) OPCODE(A3) OPCODE(C3) OPCODE(E3)
+		OPCODE(13) OPCODE(33) OPCODE(53) OPCODE(73) OPCODE(93) OPCODE(B3) OPCODE(D3) OPCODE(F3)
+		{
+			uint8_t value = Read(DP(FETCH()));
+			bool set = ((value >> (opcode >> 5)) & 1) != 0;
+			BRANCH((opcode & 0x10) ? !set : set);
+			NEXT();
+		}
+
+		// TCALL n
+		OPCODE(01) OPCODE(11) OPCODE(21) OPCODE(31) OPCODE(41) OPCODE(51) OPCODE(61) OPCODE(71)
+		OPCODE(81) OPCODE(91) OPCODE(A1) OPCODE(B1) OPCODE(C1) OPCODE(D1) OPCODE(E1) OPCODE(F1)
+		{
+			uint16_t vector = 0xffde - (opcode >> 4) * 2;
+			PUSH(pc >> 8);
+			PUSH(pc);
+			pc = Read(vector) | (Read(vector + 1) << 8);
+			NEXT();
+		}
+
+		OPCODE(00) // NOP
+			NEXT();
+
+		OPCODE(0A) // OR1 C, m.b
+		OPCODE(2A) // OR1 C, /m.b
+		OPCODE(4A) // AND1 C, m.b
+		OPCODE(6A) // AND1 C, /m.b
+		OPCODE(8A) // EOR1 C, m.b
+		OPCODE(AA) // MOV1 C, m.b
+		OPCODE(CA) // MOV1 m.b, C
+		OPCODE(EA) // NOT1 m.b
+		{
+			uint16_t operand = FETCH();
+			operand |= FETCH() << 8;
+			uint16_t addr = operand & 0x1fff;
+			int bit = operand >> 13;
+			uint8_t value = Read(addr);
+			int m = (value >> bit) & 1;
+
+			switch (opcode) {
+			case 0x0a:
+				psw |= m;
+				break;
+
+			case 0x2a:
+				psw |= m ^ 1;
+				break;
+
+			case 0x4a:
+				psw &= ~PSW_C | m;
+				break;
+
+			case 0x6a:
+				psw &= ~PSW_C | (m ^ 1);
+				break;
+
+			case 0x8a:
+				psw ^= m;
+				break;
+
+			case 0xaa:
+				psw = (psw & ~PSW_C) | m;
+				break;
+
+			case 0xca:
+				Write(addr, (uint8_t)((value & ~(1 << bit)) | ((psw & PSW_C) << bit)));
+				break;
+
+			default:
+				Write(addr, (uint8_t)(value ^ (1 << bit)));
+				break;
+			}
+			NEXT();
+		}
+
+		OPCODE(0D) // PUSH PSW
+			PUSH(psw);
+			NEXT();
+
+		OPCODE(2D) // PUSH A
+			PUSH(a);
+			NEXT();
+
+		OPCODE(4D) // PUSH X
+			PUSH(x);
+			NEXT();
+
+		OPCODE(6D) // PUSH Y
+			PUSH(y);
+			NEXT();
+
+		OPCODE(8E) // POP PSW
+			psw = POP();
+			NEXT();
+
+		OPCODE(AE) // POP A
+			a = POP();
+			NEXT();
+
+		OPCODE(CE) // POP X
+			x = POP();
+			NEXT();
+
+		OPCODE(EE) // POP Y
+			y = POP();
+			NEXT();
+
+		OPCODE(0E) // TSET1 !a
+		OPCODE(4E) // TCLR1 !a
+		{
+			uint16_t addr = FETCH();
+			addr |= FETCH() << 8;
+			uint8_t value = Read(addr);
+			int result = a - value;
+			SET_NZ(result);
+			Write(addr, (opcode == 0x0e) ? (value | a) : (value & ~a));
+			NEXT();
+		}
+
+		OPCODE(0F) // BRK
+		{
+			PUSH(pc >> 8);
+			PUSH(pc);
+			PUSH(psw);
+			psw = (psw | PSW_B) & ~PSW_I;
+			pc = Read(0xffde) | (Read(0xffdf) << 8);
+			NEXT();
+		}
+
+		OPCODE(10) // BPL
+			BRANCH((psw & PSW_N) == 0);
+			NEXT();
+
+		OPCODE(30) // BMI
+			BRANCH((psw & PSW_N) != 0);
+			NEXT();
+
+		OPCODE(50) // BVC
+			BRANCH((psw & PSW_V) == 0);
+			NEXT();
+
+		OPCODE(70) // BVS
+			BRANCH((psw & PSW_V) != 0);
+			NEXT();
+
+		OPCODE(90) // BCC
+			BRANCH((psw & PSW_C) == 0);
+			NEXT();
+
+		OPCODE(B0) // BCS
+			BRANCH((psw & PSW_C) != 0);
+			NEXT();
+
+		OPCODE(D0) // BNE
+			BRANCH((psw & PSW_Z) == 0);
+			NEXT();
+
+		OPCODE(F0) // BEQ
+			BRANCH((psw & PSW_Z) != 0);
+			if (cycles > 2 && ram[(uint16_t)(pc + 3)] == 0xfc) {
+				time += GetTimerPollSkip(time + cycles, end_time);
+			}
+			NEXT();
+
+		OPCODE(2F) // BRA
+		{
+			int8_t rel = (int8_t)FETCH();
+			pc = (uint16_t)(pc + rel);
+
+			// a branch to itself spins until the end of the slice
+			if (rel == -2 && time + cycles < end_time) {
+				time += (end_time - time - 1) / cycles * cycles;
+			}
+			NEXT();
+		}
+
+		OPCODE(1A) // DECW d
+		OPCODE(3A) // INCW d
+		{
+			uint8_t off = FETCH();
+			int value = READ_DP16(off) + ((opcode == 0x1a) ? -1 : 1);
+			Write(DP(off), (uint8_t)value);
+			Write(DP(off + 1), (uint8_t)(value >> 8));
+			SET_NZ16(value);
+			NEXT();
+		}
+
+		OPCODE(5A) // CMPW YA, d
+		{
+			uint8_t off = FETCH();
+			int result = ((y << 8) | a) - READ_DP16(off);
+			psw = (psw & ~PSW_C) | ((result >= 0) ? PSW_C : 0);
+			SET_NZ16(result);
+			NEXT();
+		}
+
+		OPCODE(7A) // ADDW YA, d
+		OPCODE(9A) // SUBW YA, d
+		{
+			uint8_t off = FETCH();
+			int lhs = (y << 8) | a;
+			int rhs = READ_DP16(off);
+			int carry = 0;
+			if (opcode == 0x9a) {
+				rhs ^= 0xffff;
+				carry = 1;
+			}
+
+			int result = lhs + rhs + carry;
+			psw &= ~(PSW_C | PSW_H | PSW_V);
+			if (result > 0xffff) {
+				psw |= PSW_C;
+			}
+			if (((lhs ^ rhs ^ result) & 0x1000) != 0) {
+				psw |= PSW_H;
+			}
+			if ((~(lhs ^ rhs) & (lhs ^ result) & 0x8000) != 0) {
+				psw |= PSW_V;
+			}
+			SET_NZ16(result);
+
+			a = (uint8_t)result;
+			y = (uint8_t)(result >> 8);
+			NEXT();
+		}
+
+		OPCODE(BA) // MOVW YA, d
+		{
+			uint8_t off = FETCH();
+			a = Read(DP(off));
+			y = Read(DP(off + 1));
+			SET_NZ16((y << 8) | a);
+			NEXT();
+		}
+
+		OPCODE(DA) // MOVW d, YA
+		{
+			uint8_t off = FETCH();
+			Write(DP(off), a);
+			Write(DP(off + 1), y);
+			NEXT();
+		}
+
+		OPCODE(1D) // DEC X
+			x--;
+			SET_NZ(x);
+			NEXT();
+
+		OPCODE(3D) // INC X
+			x++;
+			SET_NZ(x);
+			NEXT();
+
+		OPCODE(DC) // DEC Y
+			y--;
+			SET_NZ(y);
+			NEXT();
+
+		OPCODE(FC) // INC Y
+			y++;
+			SET_NZ(y);
+			NEXT();
+
+		OPCODE(1E) // CMP X, !a
+		OPCODE(3E) // CMP X, d
+		OPCODE(C8) // CMP X, #i
+		OPCODE(5E) // CMP Y, !a
+		OPCODE(7E) // CMP Y, d
+		OPCODE(AD) // CMP Y, #i
+		{
+			uint8_t value;
+			if (opcode == 0xc8 || opcode == 0xad) {
+				value = FETCH();
+			}
+			else if (opcode == 0x3e || opcode == 0x7e) {
+				value = Read(DP(FETCH()));
+			}
+			else {
+				uint16_t addr = FETCH();
+				addr |= FETCH() << 8;
+				value = Read(addr);
+			}
+
+			int result = ((opcode == 0x1e || opcode == 0x3e || opcode == 0xc8) ? x : y) - value;
+			psw = (psw & ~PSW_C) | ((result >= 0) ? PSW_C : 0);
+			SET_NZ(result);
+			NEXT();
+		}
+
+		OPCODE(1F) // JMP [!a+X]
+		{
+			uint16_t addr = FETCH();
+			addr |= FETCH() << 8;
+			addr += x;
+			pc = Read(addr) | (Read((uint16_t)(addr + 1)) << 8);
+			NEXT();
+		}
+
+		OPCODE(5F) // JMP !a
+		{
+			uint16_t addr = FETCH();
+			addr |= FETCH() << 8;
+			pc = addr;
+			NEXT();
+		}
+
+		OPCODE(3F) // CALL !a
+		{
+			uint16_t addr = FETCH();
+			addr |= FETCH() << 8;
+			PUSH(pc >> 8);
+			PUSH(pc);
+			pc = addr;
+			NEXT();
+		}
+
+		OPCODE(4F) // PCALL u
+		{
+			uint8_t off = FETCH();
+			PUSH(pc >> 8);
+			PUSH(pc);
+			pc = 0xff00 | off;
+			NEXT();
+		}
+
+		OPCODE(6F) // RET
+		{
+			uint8_t lo = POP();
+			uint8_t hi = POP();
+			pc = lo | (hi << 8);
+			NEXT();
+		}
+
+		OPCODE(7F) // RETI
+		{
+			psw = POP();
+			uint8_t lo = POP();
+			uint8_t hi = POP();
+			pc = lo | (hi << 8);
+			NEXT();
+		}
+
+		OPCODE(2E) // CBNE d, r
+		OPCODE(DE) // CBNE d+X, r
+		{
+			uint8_t off = FETCH();
+			if (opcode == 0xde) {
+				off += x;
+			}
+			uint8_t value = Read(DP(off));
+			BRANCH(value != a);
+			NEXT();
+		}
+
+		OPCODE(6E) // DBNZ d, r
+		{
+			uint16_t addr = DP(FETCH());
+			uint8_t value = Read(addr) - 1;
+			Write(addr, value);
+			BRANCH(value != 0);
+			NEXT();
+		}
+
+		OPCODE(FE) // DBNZ Y, r
+			y--;
+			BRANCH(y != 0);
+			NEXT();
+
+		OPCODE(20) // CLRP
+			psw &= ~PSW_P;
+			NEXT();
+
+		OPCODE(40) // SETP
+			psw |= PSW_P;
+			NEXT();
+
+		OPCODE(60) // CLRC
+			psw &= ~PSW_C;
+			NEXT();
+
+		OPCODE(80) // SETC
+			psw |= PSW_C;
+			NEXT();
+
+		OPCODE(ED) // NOTC
+			psw ^= PSW_C;
+			NEXT();
+
+		OPCODE(E0) // CLRV
+			psw &= ~(PSW_V | PSW_H);
+			NEXT();
+
+		OPCODE(A0) // EI
+			psw |= PSW_I;
+			NEXT();
+
+		OPCODE(C0) // DI
+			psw &= ~PSW_I;
+			NEXT();
+
+		OPCODE(5D) // MOV X, A
+			x = a;
+			SET_NZ(x);
+			NEXT();
+
+		OPCODE(7D) // MOV A, X
+			a = x;
+			SET_NZ(a);
+			NEXT();
+
+		OPCODE(DD) // MOV A, Y
+			a = y;
+			SET_NZ(a);
+			NEXT();
+
+		OPCODE(FD) // MOV Y, A
+			y = a;
+			SET_NZ(y);
+			NEXT();
+
+		OPCODE(9D) // MOV X, SP
+			x = sp;
+			SET_NZ(x);
+			NEXT();
+
+		OPCODE(BD) // MOV SP, X
+			sp = x;
+			NEXT();
+
+		OPCODE(8D) // MOV Y, #i
+			y = FETCH();
+			SET_NZ(y);
+			NEXT();
+
+		OPCODE(CD) // MOV X, #i
+			x = FETCH();
+			SET_NZ(x);
+			NEXT();
+
+		OPCODE(E8) // MOV A, #i
+			a = FETCH();
+			SET_NZ(a);
+			NEXT();
+
+		OPCODE(8F) // MOV d, #i
+		{
+			uint8_t value = FETCH();
+			Write(DP(FETCH()), value);
+			NEXT();
+		}
+
+		OPCODE(FA) // MOV dd, ds
+		{
+			uint8_t value = Read(DP(FETCH()));
+			Write(DP(FETCH()), value);
+			NEXT();
+		}
+
+		OPCODE(CF) // MUL YA
+		{
+			uint16_t result = y * a;
+			a = (uint8_t)result;
+			y = (uint8_t)(result >> 8);
+			SET_NZ(y);
+			NEXT();
+		}
+
+		OPCODE(9E) // DIV YA, X
+		{
+			unsigned ya = (y << 8) | a;
+			psw &= ~(PSW_H | PSW_V);
+			if (y >= x) {
+				psw |= PSW_V;
+			}
+			if ((y & 0x0f) >= (x & 0x0f)) {
+				psw |= PSW_H;
+			}
+
+			unsigned quotient;
+			unsigned remainder;
+			if (y < x * 2) {
+				quotient = ya / x;
+				remainder = ya - quotient * x;
+			}
+			else {
+				quotient = 255 - (ya - x * 0x200) / (256 - x);
+				remainder = x + (ya - x * 0x200) % (256 - x);
+			}
+
+			a = (uint8_t)quotient;
+			y = (uint8_t)remainder;
+			SET_NZ(a);
+			NEXT();
+		}
+
+		OPCODE(9F) // XCN A
+			a = (uint8_t)((a >> 4) | (a << 4));
+			SET_NZ(a);
+			NEXT();
+
+		OPCODE(DF) // DAA A
+		{
+			int value = a;
+			if ((psw & PSW_C) != 0 || value > 0x99) {
+				value += 0x60;
+				psw |= PSW_C;
+			}
+			if ((psw & PSW_H) != 0 || (value & 0x0f) > 9) {
+				value += 0x06;
+			}
+			a = (uint8_t)value;
+			SET_NZ(a);
+			NEXT();
+		}
+
+		OPCODE(BE) // DAS A
+		{
+			int value = a;
+			if ((psw & PSW_C) == 0 || value > 0x99) {
+				value -= 0x60;
+				psw &= ~PSW_C;
+			}
+			if ((psw & PSW_H) == 0 || (value & 0x0f) > 9) {
+				value -= 0x06;
+			}
+			a = (uint8_t)value;
+			SET_NZ(a);
+			NEXT();
+		}
+
+		OPCODE(AF) // MOV (X)+, A
+			Write(DP(x), a);
+			x++;
+			NEXT();
+
+		OPCODE(BF) // MOV A, (X)+
+			a = Read(DP(x));
+			x++;
+			SET_NZ(a);
+			NEXT();
+
+		// stores from A
+		OPCODE(C4) // MOV d, A
+			Write(DP(FETCH()), a);
+			NEXT();
+
+		OPCODE(C5) // MOV !a, A
+		OPCODE(D5) // MOV !a+X, A
+		OPCODE(D6) // MOV !a+Y, A
+		{
+			uint16_t addr = FETCH();
+			addr |= FETCH() << 8;
+			if (opcode == 0xd5) {
+				addr += x;
+			}
+			else if (opcode == 0xd6) {
+				addr += y;
+			}
+			Write(addr, a);
+			NEXT();
+		}
+
+		OPCODE(C6) // MOV (X), A
+			Write(DP(x), a);
+			NEXT();
+
+		OPCODE(C7) // MOV [d+X], A
+		{
+			uint8_t off = FETCH() + x;
+			Write((uint16_t)READ_DP16(off), a);
+			NEXT();
+		}
+
+		OPCODE(D4) // MOV d+X, A
+			Write(DP(FETCH() + x), a);
+			NEXT();
+
+		OPCODE(D7) // MOV [d]+Y, A
+		{
+			uint8_t off = FETCH();
+			Write((uint16_t)(READ_DP16(off) + y), a);
+			NEXT();
+		}
+
+		// stores from X and Y
+		OPCODE(D8) // MOV d, X
+			Write(DP(FETCH()), x);
+			NEXT();
+
+		OPCODE(D9) // MOV d+Y, X
+			Write(DP(FETCH() + y), x);
+			NEXT();
+
+		OPCODE(C9) // MOV !a, X
+		OPCODE(CC) // MOV !a, Y
+		{
+			uint16_t addr = FETCH();
+			addr |= FETCH() << 8;
+			Write(addr, (opcode == 0xc9) ? x : y);
+			NEXT();
+		}
+
+		OPCODE(CB) // MOV d, Y
+			Write(DP(FETCH()), y);
+			NEXT();
+
+		OPCODE(DB) // MOV d+X, Y
+			Write(DP(FETCH() + x), y);
+			NEXT();
+
+		// loads into A
+		OPCODE(E4) // MOV A, d
+			a = Read(DP(FETCH()));
+			SET_NZ(a);
+			NEXT();
+
+		OPCODE(E5) // MOV A, !a
+		OPCODE(F5) // MOV A, !a+X
+		OPCODE(F6) // MOV A, !a+Y
+		{
+			uint16_t addr = FETCH();
+			addr |= FETCH() << 8;
+			if (opcode == 0xf5) {
+				addr += x;
+			}
+			else if (opcode == 0xf6) {
+				addr += y;
+			}
+			a = Read(addr);
+			SET_NZ(a);
+			NEXT();
+		}
+
+		OPCODE(E6) // MOV A, (X)
+			a = Read(DP(x));
+			SET_NZ(a);
+			NEXT();
+
+		OPCODE(E7) // MOV A, [d+X]
+		{
+			uint8_t off = FETCH() + x;
+			a = Read((uint16_t)READ_DP16(off));
+			SET_NZ(a);
+			NEXT();
+		}
+
+		OPCODE(F4) // MOV A, d+X
+			a = Read(DP(FETCH() + x));
+			SET_NZ(a);
+			NEXT();
+
+		OPCODE(F7) // MOV A, [d]+Y
+		{
+			uint8_t off = FETCH();
+			a = Read((uint16_t)(READ_DP16(off) + y));
+			SET_NZ(a);
+			NEXT();
+		}
+
+		// loads into X and Y
+		OPCODE(E9) // MOV X, !a
+		OPCODE(EC) // MOV Y, !a
+		{
+			uint16_t addr = FETCH();
+			addr |= FETCH() << 8;
+			uint8_t value = Read(addr);
+			if (opcode == 0xe9) {
+				x = value;
+			}
+			else {
+				y = value;
+			}
+			SET_NZ(value);
+			NEXT();
+		}
+
+		OPCODE(F8) // MOV X, d
+			x = Read(DP(FETCH()));
+			SET_NZ(x);
+			NEXT();
+
+		OPCODE(F9) // MOV X, d+Y
+			x = Read(DP(FETCH() + y));
+			SET_NZ(x);
+			NEXT();
+
+		OPCODE(EB) // MOV Y, d
+			y = Read(DP(FETCH()));
+			SET_NZ(y);
+			NEXT();
+
+		OPCODE(FB) // MOV Y, d+X
+			y = Read(DP(FETCH() + x));
+			SET_NZ(y);
+			NEXT();
+
+		OPCODE(EF) // SLEEP
+		OPCODE(FF) // STOP
+			halted = true;
+			time = end_time;
+			goto done;
+		}
+
+		time += cycles;
+	}
+
+done:
+	return;
+}
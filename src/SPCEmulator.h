@@ -0,0 +1,139 @@
+/**
+ * SPC700 + S-DSP emulation seeded from an SPCFile snapshot.
+ */
+
+#ifndef SPCEMULATOR_H_INCLUDED
+#define SPCEMULATOR_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "SPCDSP.h"
+
+class SPCFile;
+
+class SPCEmulator
+{
+public:
+	SPCEmulator();
+	virtual ~SPCEmulator();
+
+	static const int SAMPLE_RATE = SPCDSP::SAMPLE_RATE;
+	static const int CLOCKS_PER_SAMPLE = 32;
+
+	void Load(const SPCFile & spc);
+
+	void SetMuteMask(uint8_t mask)
+	{
+		dsp.SetMuteMask(mask);
+	}
+
+	void SetDSPKernel(const SPCDSPKernel * kernel)
+	{
+		dsp.SetKernel(kernel);
+	}
+
+	// Generates interleaved stereo frames. out may be NULL to fast-forward.
+	void Render(int16_t * out, size_t num_frames);
+
+	const SPCDSP & GetDSP() const
+	{
+		return dsp;
+	}
+
+	uint8_t TakeVoiceActivity()
+	{
+		return dsp.TakeVoiceActivity();
+	}
+
+	// Number of frames rendered since Load.
+	uint64_t GetPosition() const
+	{
+		return (uint64_t)(sample_time / CLOCKS_PER_SAMPLE) - 1;
+	}
+
+	// CPU, I/O and DSP state without RAM, in native byte order.
+	// Only valid for the build that saved it, so it is meant for caches such as checkpoints.
+	void SaveState(std::vector<uint8_t> & state) const;
+	bool LoadState(const std::vector<uint8_t> & state);
+
+	uint8_t ram[0x10000];
+
+private:
+	SPCEmulator(const SPCEmulator&);
+	SPCEmulator& operator=(const SPCEmulator&);
+
+	enum PSWFlag {
+		PSW_C = 0x01,
+		PSW_Z = 0x02,
+		PSW_I = 0x04,
+		PSW_H = 0x08,
+		PSW_B = 0x10,
+		PSW_P = 0x20,
+		PSW_V = 0x40,
+		PSW_N = 0x80
+	};
+
+	struct Timer {
+		int64_t next_time;
+		int prescaler;
+		int period;
+		int divider;
+		int counter;
+		bool enabled;
+	};
+
+	void RunCPU(int64_t end_time);
+
+	void RunTimer(Timer & timer, int64_t time);
+	int64_t GetNextTickTime(const Timer & timer) const;
+	int64_t GetTimerPollSkip(int64_t loop_time, int64_t end_time);
+	uint8_t ReadIO(uint16_t addr);
+	void WriteIO(uint16_t addr, uint8_t data);
+	void WriteControl(uint8_t data);
+
+	uint8_t Read(uint16_t addr)
+	{
+		if ((uint16_t)(addr - 0xf0) < 0x10) {
+			return ReadIO(addr);
+		}
+		if (addr >= 0xffc0 && rom_enabled) {
+			return ipl_rom[addr - 0xffc0];
+		}
+		return ram[addr];
+	}
+
+	void Write(uint16_t addr, uint8_t data)
+	{
+		ram[addr] = data;
+		if ((uint16_t)(addr - 0xf0) < 0x10) {
+			WriteIO(addr, data);
+		}
+	}
+
+	SPCDSP dsp;
+
+	// SPC700 registers
+	uint16_t pc;
+	uint8_t a;
+	uint8_t x;
+	uint8_t y;
+	uint8_t psw;
+	uint8_t sp;
+	bool halted;
+
+	// I/O registers
+	uint8_t dsp_addr;
+	uint8_t ports_in[4];
+	bool rom_enabled;
+	Timer timers[3];
+
+	int64_t time;
+	int64_t sample_time;	// end of the current sample's CPU slice
+
+	static const uint8_t ipl_rom[0x40];
+};
+
+#endif /* !SPCEMULATOR_H_INCLUDED */
@@ -15,6 +15,7 @@
 #include <algorithm>
 
 #include "SPCFile.h"
+#include "Stats.h"
 #include "cpath.h"
 
 #ifdef WIN32
@@ -24,13 +25,61 @@
 #define SPC_SIGNATURE_HEAD      "SNES-SPC700 Sound File Data"
 #define SPC_SIGNATURE           "SNES-SPC700 Sound File Data v0.30"
 #define SPC_HEADER_SIZE         0x100
-#define SPC_MIN_SIZE            0x10200
+#define SPC_MIN_SIZE            SPCFile::MIN_FILE_SIZE
 
 #define XID6_TICK_UNIT          64000
 
+// largest values the text ID666 length fields can hold
+#define ID666_MAX_SONG_SECONDS  999
+#define ID666_MAX_FADE_MSECS    99999
+
 #define ALIGN32(x)  (((x) + 3) & ~3)
 
-SPCFile::SPCFile()
+// Names accepted by TagPatch::Compile.
+static const char * const PSF_TAG_NAMES[] = {
+	"artist", "comment", "copyright", "created_at", "disc", "emulator", "end", "fade", "game", "intro",
+	"length", "loop", "loopcount", "mute", "snsfby", "soundtrack", "spcby", "title", "track", "volume", "year"
+};
+
+// Appends a diagnostic line to messages, or prints it if there is nowhere to collect it.
+static void report_message(std::string * messages, const char * message)
+{
+	if (messages != NULL) {
+		*messages += message;
+		*messages += '\n';
+	}
+	else {
+		fprintf(stderr, "%s\n", message);
+	}
+}
+
+// Copies a string into a zero-padded ID666 text field. A longer string is cut before
+// the UTF-8 character that does not fit, rather than in the middle of it.
+static void CopyID666String(uint8_t * field, size_t size, const std::string & str)
+{
+	size_t length = 0;
+	while (length < size && length < str.size() && str[length] != '\0') {
+		length++;
+	}
+
+	if (length == size && length < str.size() && ((uint8_t)str[length] & 0xc0) == 0x80) {
+		size_t start = length;
+		while (start > 0 && length - start < 3 && ((uint8_t)str[start] & 0xc0) == 0x80) {
+			start--;
+		}
+		if ((uint8_t)str[start] >= 0xc0) {
+			length = start;
+		}
+	}
+
+	memset(field, 0, size);
+	memcpy(field, str.data(), length);
+}
+
+SPCFile::SPCFile() :
+	id666_format(ID666_NONE),
+	has_xid6(false),
+	file_size(0)
 {
 	memset(ram, 0xff, 0x10000);
 	memset(dsp, 0xff, 0x80);
@@ -46,11 +95,13 @@ bool SPCFile::IsSPCFile(const std::string& filename)
 	FILE *fp = NULL;
 	uint8_t header[SPC_HEADER_SIZE];
 
+	Stats::AddSyscalls(1);
 	off_t off_spc_size = path_getfilesize(filename.c_str());
-	if (off_spc_size == -1 || off_spc_size < SPC_MIN_SIZE) {
+	if (off_spc_size == -1 || off_spc_size < (off_t)SPC_MIN_SIZE) {
 		return false;
 	}
 
+	Stats::AddSyscalls(2);
 	fp = fopen(filename.c_str(), "rb");
 	if (fp == NULL) {
 		return false;
@@ -60,47 +111,36 @@ bool SPCFile::IsSPCFile(const std::string& filename)
 		fclose(fp);
 		return false;
 	}
-
-	if (memcmp(header, SPC_SIGNATURE_HEAD, strlen(SPC_SIGNATURE_HEAD)) != 0 ||
-		header[0x21] != 0x1a || header[0x22] != 0x1a) {
-		fclose(fp);
-		return false;
-	}
+	Stats::AddRead(SPC_HEADER_SIZE);
 
 	fclose(fp);
-	return true;
+	return IsSPCHeader(header, off_spc_size);
 }
 
-SPCFile * SPCFile::Load(const std::string& filename)
+bool SPCFile::IsSPCHeader(const uint8_t * header, uint64_t file_size)
 {
-	char * endptr;
+	return file_size >= SPC_MIN_SIZE &&
+		memcmp(header, SPC_SIGNATURE_HEAD, strlen(SPC_SIGNATURE_HEAD)) == 0 &&
+		header[0x21] == 0x1a && header[0x22] == 0x1a;
+}
+
+SPCFile * SPCFile::Load(const std::string& filename, std::string * messages)
+{
+	Stats::Scope stats_scope(Stats::PHASE_LOAD);
 
+	Stats::AddSyscalls(1);
 	off_t off_spc_size = path_getfilesize(filename.c_str());
-	if (off_spc_size == -1 || off_spc_size < SPC_MIN_SIZE) {
+	if (off_spc_size == -1 || off_spc_size < (off_t)SPC_MIN_SIZE) {
 		return NULL;
 	}
 	size_t spc_size = (size_t) off_spc_size;
 
+	Stats::AddSyscalls(2);
 	FILE * fp = fopen(filename.c_str(), "rb");
 	if (fp == NULL) {
 		return NULL;
 	}
 
-	// read header
-	uint8_t header[SPC_HEADER_SIZE];
-	if (fread(header, 1, SPC_HEADER_SIZE, fp) != SPC_HEADER_SIZE) {
-		fclose(fp);
-		return NULL;
-	}
-	rewind(fp);
-
-	// signature
-	if (memcmp(header, SPC_SIGNATURE_HEAD, strlen(SPC_SIGNATURE_HEAD)) != 0 ||
-		header[0x21] != 0x1a || header[0x22] != 0x1a) {
-		fclose(fp);
-		return NULL;
-	}
-
 	// read whole file
 	uint8_t * data = new uint8_t[spc_size];
 	if (fread(data, 1, spc_size, fp) != spc_size) {
@@ -108,9 +148,26 @@ SPCFile * SPCFile::Load(const std::string& filename)
 		fclose(fp);
 		return NULL;
 	}
+	Stats::AddRead(spc_size);
+	fclose(fp);
+
+	SPCFile * spc = LoadFromMemory(data, spc_size, messages);
+	delete[] data;
+	return spc;
+}
+
+SPCFile * SPCFile::LoadFromMemory(const uint8_t * data, size_t spc_size, std::string * messages)
+{
+	char * endptr;
+
+	if (data == NULL || !IsSPCHeader(data, spc_size)) {
+		return NULL;
+	}
+	const uint8_t * header = data;
 
 	// create new SPC object
 	SPCFile * spc = new SPCFile();
+	spc->file_size = spc_size;
 
 	// SPC700 registers
 	spc->regs.pc = header[0x25] | (header[0x26] << 8);
@@ -154,20 +211,25 @@ SPCFile * SPCFile::Load(const std::string& filename)
 		bool has_id666_song_length = false;
 		if (header[0xd2] < 0x30) {
 			// binary format
+			spc->id666_format = ID666_BINARY;
+
 			u = header[0x9e] | (header[0x9f] << 8) | (header[0xa0] << 16) | (header[0xa1] << 24);
 			if (u != 0) {
 				spc->SetIntegerTag(XID6_DUMPED_DATE, u, 4);
 			}
 
+			// clamped like the text fields, garbage would overflow the tick count
 			u = header[0xa9] | (header[0xaa] << 8) | (header[0xab] << 16);
 			if (u != 0) {
-				spc->SetIntegerTag(XID6_INTRO_LENGTH, XID6TicksToMilliSeconds(u) / 1000, 4);
+				u = std::min<uint32_t>(u, ID666_MAX_SONG_SECONDS);
+				spc->SetIntegerTag(XID6_INTRO_LENGTH, MilliSecondsToXID6Ticks(u * 1000), 4);
 				has_id666_song_length = true;
 			}
 
 			u = header[0xac] | (header[0xad] << 8) | (header[0xae] << 16) | (header[0xaf] << 24);
 			if (has_id666_song_length || u != 0) {
-				spc->SetIntegerTag(XID6_FADE_LENGTH, XID6TicksToMilliSeconds(u), 4);
+				u = std::min<uint32_t>(u, ID666_MAX_FADE_MSECS);
+				spc->SetIntegerTag(XID6_FADE_LENGTH, MilliSecondsToXID6Ticks(u), 4);
 			}
 
 			memcpy(s, &header[0xb0], 32);
@@ -180,6 +242,8 @@ SPCFile * SPCFile::Load(const std::string& filename)
 		}
 		else {
 			// text format
+			spc->id666_format = ID666_TEXT;
+
 			memcpy(s, &header[0x9e], 11);
 			s[11] = '\0';
 			if (strcmp(s, "") != 0) {
@@ -192,7 +256,7 @@ SPCFile * SPCFile::Load(const std::string& filename)
 					spc->SetIntegerTag(XID6_DUMPED_DATE, year * 10000 + month * 100 + day, 4);
 				}
 				else {
-					fprintf(stderr, "Warning: Unable to parse ID666 dumped date\n");
+					report_message(messages, "Warning: Unable to parse ID666 dumped date");
 				}
 			}
 
@@ -201,10 +265,10 @@ SPCFile * SPCFile::Load(const std::string& filename)
 			if (strcmp(s, "") != 0) {
 				u = strtoul(s, &endptr, 10);
 				if (*endptr == '\0') {
-					spc->SetIntegerTag(XID6_INTRO_LENGTH, XID6TicksToMilliSeconds(u) / 1000, 4);
+					spc->SetIntegerTag(XID6_INTRO_LENGTH, MilliSecondsToXID6Ticks(u * 1000), 4);
 				}
 				else {
-					fprintf(stderr, "Warning: Unable to parse ID666 playback length\n");
+					report_message(messages, "Warning: Unable to parse ID666 playback length");
 				}
 			}
 
@@ -213,10 +277,10 @@ SPCFile * SPCFile::Load(const std::string& filename)
 			if (strcmp(s, "") != 0) {
 				u = strtoul(s, &endptr, 10);
 				if (*endptr == '\0') {
-					spc->SetIntegerTag(XID6_FADE_LENGTH, u * XID6TicksToMilliSeconds(u), 4);
+					spc->SetIntegerTag(XID6_FADE_LENGTH, MilliSecondsToXID6Ticks(u), 4);
 				}
 				else {
-					fprintf(stderr, "Warning: Unable to parse ID666 fade length\n");
+					report_message(messages, "Warning: Unable to parse ID666 fade length");
 				}
 			}
 
@@ -234,7 +298,7 @@ SPCFile * SPCFile::Load(const std::string& filename)
 					spc->SetIntegerTag(XID6_EMULATOR, u, 1);
 				}
 				else {
-					fprintf(stderr, "Warning: Unable to parse ID666 emulator id\n");
+					report_message(messages, "Warning: Unable to parse ID666 emulator id");
 				}
 			}
 		}
@@ -249,6 +313,7 @@ SPCFile * SPCFile::Load(const std::string& filename)
 
 		// skip the xid6 header
 		xid6_offset += 8;
+		spc->has_xid6 = true;
 
 		// determine the end offset
 		if (xid6_offset + xid6_whole_size > spc_size) {
@@ -278,19 +343,39 @@ SPCFile * SPCFile::Load(const std::string& filename)
 		}
 	}
 
-	delete[] data;
-	fclose(fp);
-
 	return spc;
 }
 
 bool SPCFile::Save(const std::string& filename) const
 {
+	Stats::Scope stats_scope(Stats::PHASE_SAVE);
+
+	std::vector<uint8_t> data;
+	Serialize(data);
+
+	Stats::AddSyscalls(1);
 	FILE * spc_file = fopen(filename.c_str(), "wb");
 	if (spc_file == NULL) {
 		return false;
 	}
 
+	if (fwrite(&data[0], 1, data.size(), spc_file) != data.size()) {
+		fclose(spc_file);
+		return false;
+	}
+	Stats::AddWrite(data.size());
+
+	Stats::AddSyscalls(1);
+	if (fclose(spc_file) != 0) {
+		return false;
+	}
+	return true;
+}
+
+void SPCFile::Serialize(std::vector<uint8_t> & data) const
+{
+	Stats::Scope stats_scope(Stats::PHASE_SERIALIZE);
+
 	uint8_t header[0x100];
 	memset(header, 0, 0x100);
 
@@ -321,21 +406,10 @@ bool SPCFile::Save(const std::string& filename) const
 
 		header[0x23] = 0x1a;
 
-		strncpy(s, GetStringTag(XID6_SONG_NAME).c_str(), 32);
-		s[32] = '\0';
-		memcpy(&header[0x2e], s, 32);
-
-		strncpy(s, GetStringTag(XID6_GAME_NAME).c_str(), 32);
-		s[32] = '\0';
-		memcpy(&header[0x4e], s, 32);
-
-		strncpy(s, GetStringTag(XID6_DUMPER_NAME).c_str(), 16);
-		s[16] = '\0';
-		memcpy(&header[0x6e], s, 16);
-
-		strncpy(s, GetStringTag(XID6_COMMENT).c_str(), 32);
-		s[32] = '\0';
-		memcpy(&header[0x7e], s, 32);
+		CopyID666String(&header[0x2e], 32, GetStringTag(XID6_SONG_NAME));
+		CopyID666String(&header[0x4e], 32, GetStringTag(XID6_GAME_NAME));
+		CopyID666String(&header[0x6e], 16, GetStringTag(XID6_DUMPER_NAME));
+		CopyID666String(&header[0x7e], 32, GetStringTag(XID6_COMMENT));
 
 		if (tags.count(XID6_DUMPED_DATE) != 0) {
 			uint32_t yyyymmdd = GetIntegerTag(XID6_DUMPED_DATE);
@@ -351,7 +425,7 @@ bool SPCFile::Save(const std::string& filename) const
 		if (length_in_ticks != 0)
 		{
 			uint32_t seconds = XID6TicksToMilliSeconds(length_in_ticks) / 1000;
-			sprintf(s, "%d", std::min<uint32_t>(seconds, 999));
+			sprintf(s, "%d", std::min<uint32_t>(seconds, ID666_MAX_SONG_SECONDS));
 			memcpy(&header[0xa9], s, 3);
 		}
 
@@ -359,7 +433,7 @@ bool SPCFile::Save(const std::string& filename) const
 			uint32_t ticks = GetIntegerTag(XID6_FADE_LENGTH);
 			uint32_t milliseconds = XID6TicksToMilliSeconds(ticks);
 
-			sprintf(s, "%d", std::min<uint32_t>(milliseconds, 99999));
+			sprintf(s, "%d", std::min<uint32_t>(milliseconds, ID666_MAX_FADE_MSECS));
 			memcpy(&header[0xac], s, 5);
 		}
 
@@ -379,35 +453,23 @@ bool SPCFile::Save(const std::string& filename) const
 		}
 	}
 
-	// write file header
-	if (fwrite(header, 1, 0x100, spc_file) != 0x100) {
-		fclose(spc_file);
-		return false;
-	}
+	data.clear();
+	data.reserve(SPC_MIN_SIZE);
 
-	// write RAM
-	if (fwrite(ram, 1, 0x10000, spc_file) != 0x10000) {
-		fclose(spc_file);
-		return false;
-	}
+	// file header
+	data.insert(data.end(), header, header + 0x100);
 
-	// write DSP registers
-	if (fwrite(dsp, 1, 0x80, spc_file) != 0x80) {
-		fclose(spc_file);
-		return false;
-	}
+	// RAM
+	data.insert(data.end(), ram, ram + 0x10000);
 
-	// write reserved area
-	if (fwrite(reserved, 1, 0x40, spc_file) != 0x40) {
-		fclose(spc_file);
-		return false;
-	}
+	// DSP registers
+	data.insert(data.end(), dsp, dsp + 0x80);
 
-	// write extra RAM
-	if (fwrite(extra_ram, 1, 0x40, spc_file) != 0x40) {
-		fclose(spc_file);
-		return false;
-	}
+	// reserved area
+	data.insert(data.end(), reserved, reserved + 0x40);
+
+	// extra RAM
+	data.insert(data.end(), extra_ram, extra_ram + 0x40);
 
 	// determine if Extended ID666 is required
 	bool xid6_required = false;
@@ -420,18 +482,11 @@ bool SPCFile::Save(const std::string& filename) const
 		}
 	}
 
-	// write Extended ID666
+	// Extended ID666
 	if (xid6_required) {
 		std::vector<uint8_t> xid6 = GetXID6Block();
-
-		if (fwrite(&xid6[0], 1, xid6.size(), spc_file) != xid6.size()) {
-			fclose(spc_file);
-			return false;
-		}
+		data.insert(data.end(), xid6.begin(), xid6.end());
 	}
-
-	fclose(spc_file);
-	return true;
 }
 
 std::vector<uint8_t> SPCFile::GetXID6Block() const
@@ -617,17 +672,7 @@ void SPCFile::SetLengthTag(XID6ItemId id, uint16_t value)
 
 void SPCFile::SetIntegerTag(XID6ItemId id, uint32_t value, size_t size)
 {
-	std::vector<char> data;
-
-	size = std::min<size_t>(size, 4);
-	for (size_t i = 0; i < size; i++) {
-		data.push_back((value >> (8 * i)) & 0xff);
-	}
-
-	XID6TagItem tag;
-	tag.type = XID6_TYPE_INTEGER;
-	tag.value = data;
-	tags[id] = tag;
+	tags[id] = MakeIntegerItem(value, size);
 }
 
 void SPCFile::SetStringTag(XID6ItemId id, const std::string & str)
@@ -636,17 +681,31 @@ void SPCFile::SetStringTag(XID6ItemId id, const std::string & str)
 		tags.erase(id);
 	}
 	else {
-		std::vector<char> data;
-		data.reserve(str.size() + 1);
-		for (size_t i = 0; i <= str.size(); i++) {
-			data.push_back(str[i]);
-		}
+		tags[id] = MakeStringItem(str);
+	}
+}
+
+SPCFile::XID6TagItem SPCFile::MakeIntegerItem(uint32_t value, size_t size)
+{
+	XID6TagItem tag;
+	tag.type = XID6_TYPE_INTEGER;
 
-		XID6TagItem tag;
-		tag.type = XID6_TYPE_STRING;
-		tag.value = data;
-		tags[id] = tag;
+	size = std::min<size_t>(size, 4);
+	for (size_t i = 0; i < size; i++) {
+		tag.value.push_back((value >> (8 * i)) & 0xff);
 	}
+	return tag;
+}
+
+SPCFile::XID6TagItem SPCFile::MakeStringItem(const std::string & str)
+{
+	XID6TagItem tag;
+	tag.type = XID6_TYPE_STRING;
+	tag.value.reserve(str.size() + 1);
+	for (size_t i = 0; i <= str.size(); i++) {
+		tag.value.push_back(str[i]);
+	}
+	return tag;
 }
 
 uint32_t SPCFile::GetPlaybackLength() const
@@ -683,130 +742,196 @@ uint32_t SPCFile::MilliSecondsToXID6Ticks(uint32_t msecs)
 	return msecs * (XID6_TICK_UNIT / 1000);
 }
 
-std::string SPCFile::XID6TicksToTimeString(uint32_t ticks, bool padding)
+// Writes the decimal digits of value, right-aligned to at least min_digits.
+static char * FormatDecimal(char * p, uint32_t value, int min_digits)
 {
-	double tv = (double)ticks / XID6_TICK_UNIT;
+	char digits[10];
+	int count = 0;
+	do {
+		digits[count++] = '0' + (value % 10);
+		value /= 10;
+	} while (value != 0);
 
-	double seconds = fmod(tv, 60.0);
-	unsigned int minutes = (unsigned int)(tv - seconds) / 60;
-	unsigned int hours = minutes / 60;
-	minutes %= 60;
-	hours %= 60;
+	while (count < min_digits) {
+		digits[count++] = '0';
+	}
 
-	char str[64];
-	if (hours != 0) {
-		sprintf(str, "%u:%02u:%06.3f", hours, minutes, seconds);
+	while (count > 0) {
+		*p++ = digits[--count];
 	}
-	else {
-		if (padding || minutes != 0) {
-			sprintf(str, "%u:%06.3f", minutes, seconds);
-		}
-		else {
-			sprintf(str, "%.3f", seconds);
-		}
+	return p;
+}
+
+// Parses a non-empty run of decimal digits. Fails on any other character or on overflow.
+static bool ParseDecimal(const char * first, const char * last, uint64_t limit, uint64_t & value)
+{
+	if (first == last) {
+		return false;
 	}
 
-	if (!padding) {
-		size_t len = strlen(str);
-		for (off_t i = (off_t)(len - 1); i >= 0; i--) {
-			if (str[i] == '0') {
-				str[i] = '\0';
-			}
-			else {
-				if (str[i] == '.') {
-					str[i] = '\0';
-				}
-				break;
-			}
+	value = 0;
+	for (const char * p = first; p != last; p++) {
+		if (*p < '0' || *p > '9') {
+			return false;
 		}
-	}
 
-	return str;
+		value = value * 10 + (*p - '0');
+		if (value > limit) {
+			return false;
+		}
+	}
+	return true;
 }
 
-uint32_t SPCFile::TimeStringToXID6Ticks(const std::string & str, bool * p_valid_format)
+size_t SPCFile::FormatXID6Ticks(uint32_t ticks, bool padding, char * str)
 {
-	bool dummy_ret;
-	if (p_valid_format == NULL) {
-		p_valid_format = &dummy_ret;
-	}
+	uint32_t total_seconds = ticks / XID6_TICK_UNIT;
+	uint32_t seconds = total_seconds % 60;
+	uint32_t minutes = (total_seconds / 60) % 60;
+	uint32_t hours = total_seconds / 3600;
 
-	if (str.empty()) {
-		*p_valid_format = true;
-		return 0;
+	// A tick is exactly 15625 nanoseconds, so nine fractional digits are always exact.
+	uint32_t nanoseconds = (ticks % XID6_TICK_UNIT) * (1000000000 / XID6_TICK_UNIT);
+
+	char * p = str;
+	if (hours != 0) {
+		p = FormatDecimal(p, hours, 1);
+		*p++ = ':';
+		p = FormatDecimal(p, minutes, 2);
+		*p++ = ':';
+		p = FormatDecimal(p, seconds, 2);
+	}
+	else if (padding || minutes != 0) {
+		p = FormatDecimal(p, minutes, 1);
+		*p++ = ':';
+		p = FormatDecimal(p, seconds, 2);
+	}
+	else {
+		p = FormatDecimal(p, seconds, 1);
 	}
 
-	// split by colons
-	std::vector<std::string> tokens;
-	size_t current = 0;
-	size_t found;
-	while ((found = str.find_first_of(':', current)) != std::string::npos) {
-		tokens.push_back(std::string(str, current, found - current));
-		current = found + 1;
+	// keep three digits (milliseconds) when padding, drop trailing zeros otherwise
+	int fraction_digits = 9;
+	int min_fraction_digits = padding ? 3 : 0;
+	while (fraction_digits > min_fraction_digits && nanoseconds % 10 == 0) {
+		nanoseconds /= 10;
+		fraction_digits--;
 	}
-	tokens.push_back(std::string(str, current, str.size() - current));
 
-	// too many colons?
-	if (tokens.size() > 3) {
-		*p_valid_format = false;
-		return 0;
+	if (fraction_digits != 0) {
+		*p++ = '.';
+		p = FormatDecimal(p, nanoseconds, fraction_digits);
 	}
 
-	// set token for each fields
-	const char * s_hours = "0";
-	const char * s_minutes = "0";
-	const char * s_seconds = "0";
-	switch (tokens.size())
-	{
-	case 1:
-		s_seconds = tokens[0].c_str();
-		break;
+	*p = '\0';
+	return p - str;
+}
 
-	case 2:
-		s_minutes = tokens[0].c_str();
-		s_seconds = tokens[1].c_str();
-		break;
+std::string SPCFile::XID6TicksToTimeString(uint32_t ticks, bool padding)
+{
+	char str[XID6_TIME_STRING_MAX];
+	size_t len = FormatXID6Ticks(ticks, padding, str);
+	return std::string(str, len);
+}
 
-	case 3:
-		s_hours = tokens[0].c_str();
-		s_minutes = tokens[1].c_str();
-		s_seconds = tokens[2].c_str();
-		break;
+bool SPCFile::ParseXID6Ticks(const char * first, const char * last, uint32_t & ticks)
+{
+	ticks = 0;
+	if (first == last) {
+		return true;
+	}
+
+	// split by colons, [[hours:]minutes:]seconds
+	const char * fields[3] = { first };
+	size_t num_fields = 1;
+	for (const char * p = first; p != last; p++) {
+		if (*p == ':') {
+			if (num_fields == 3) {
+				return false;
+			}
+			fields[num_fields++] = p + 1;
+		}
 	}
 
-	if (*s_hours == '\0' || *s_minutes == '\0' || *s_seconds == '\0' ||
-		*s_hours == '+' || *s_minutes == '+' || *s_seconds == '+') {
-		*p_valid_format = false;
-		return 0;
+	const uint64_t max_seconds = UINT32_MAX / XID6_TICK_UNIT;
+	uint64_t total_seconds = 0;
+	for (size_t i = 0; i + 1 < num_fields; i++) {
+		uint64_t value;
+		if (!ParseDecimal(fields[i], fields[i + 1] - 1, max_seconds, value)) {
+			return false;
+		}
+		total_seconds = total_seconds * 60 + value;
+		if (total_seconds > max_seconds) {
+			return false;
+		}
 	}
 
-	char * endptr = NULL;
-	double n_seconds = strtod(s_seconds, &endptr);
-	if (*endptr != '\0' || errno == ERANGE || n_seconds < 0) {
-		*p_valid_format = false;
-		return 0;
+	// seconds, with an optional fraction rounded to the nearest tick
+	const char * s_seconds = fields[num_fields - 1];
+	const char * s_dot = s_seconds;
+	while (s_dot != last && *s_dot != '.') {
+		s_dot++;
 	}
 
-	long n_minutes = strtol(s_minutes, &endptr, 10);
-	if (*endptr != '\0' || errno == ERANGE || n_minutes < 0) {
-		*p_valid_format = false;
-		return 0;
+	uint64_t seconds = 0;
+	if (s_dot != s_seconds && !ParseDecimal(s_seconds, s_dot, max_seconds, seconds)) {
+		return false;
 	}
 
-	long n_hours = strtol(s_hours, &endptr, 10);
-	if (*endptr != '\0' || errno == ERANGE || n_hours < 0) {
-		*p_valid_format = false;
-		return 0;
+	uint64_t nanoseconds = 0;
+	if (s_dot != last) {
+		const char * s_fraction = s_dot + 1;
+		if (s_dot == s_seconds && s_fraction == last) {
+			return false;
+		}
+
+		int num_digits = 0;
+		bool round_up = false;
+		for (const char * p = s_fraction; p != last; p++) {
+			if (*p < '0' || *p > '9') {
+				return false;
+			}
+
+			if (num_digits < 9) {
+				nanoseconds = nanoseconds * 10 + (*p - '0');
+			}
+			else if (num_digits == 9) {
+				round_up = (*p >= '5');
+			}
+			num_digits++;
+		}
+
+		for (; num_digits < 9; num_digits++) {
+			nanoseconds *= 10;
+		}
+		if (round_up) {
+			nanoseconds++;
+		}
+	}
+	else if (s_dot == s_seconds) {
+		return false;
 	}
 
-	double tv = n_hours * 3600 + n_minutes * 60 + n_seconds;
-	if (tv < 0) {
-		*p_valid_format = false;
-		return 0;
+	total_seconds = total_seconds * 60 + seconds;
+
+	uint64_t total_ticks = total_seconds * XID6_TICK_UNIT + (nanoseconds * XID6_TICK_UNIT + 500000000) / 1000000000;
+	if (total_ticks > UINT32_MAX) {
+		return false;
 	}
 
-	*p_valid_format = true;
-	return (uint32_t)(tv * XID6_TICK_UNIT + 0.5);
+	ticks = (uint32_t)total_ticks;
+	return true;
+}
+
+uint32_t SPCFile::TimeStringToXID6Ticks(const std::string & str, bool * p_valid_format)
+{
+	uint32_t ticks;
+	bool valid_format = ParseXID6Ticks(str.data(), str.data() + str.size(), ticks);
+
+	if (p_valid_format != NULL) {
+		*p_valid_format = valid_format;
+	}
+	return valid_format ? ticks : 0;
 }
 
 std::string SPCFile::ID666IdToEmulatorName(SPCFile::ID666EmulatorId id)
@@ -860,7 +985,7 @@ SPCFile::ID666EmulatorId SPCFile::EmulatorNameToID666Id(const std::string & name
 	}
 }
 
-bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
+bool SPCFile::TagPatch::Compile(const std::map<std::string, std::string> & psf_tags, std::string * messages)
 {
 	bool no_error = true;
 	char * endptr = NULL;
@@ -880,7 +1005,7 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 		}
 		else if (name == "year") {
 			if (value.empty()) {
-				tags.erase(XID6_COPYRIGHT_YEAR);
+				EraseTag(XID6_COPYRIGHT_YEAR);
 			}
 			else {
 				long num = strtol(value.c_str(), &endptr, 10);
@@ -888,7 +1013,7 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					SetLengthTag(XID6_COPYRIGHT_YEAR, (uint16_t)num);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal number format: year\n");
+					report_message(messages, "Error: Illegal number format: year");
 					no_error = false;
 				}
 			}
@@ -904,25 +1029,25 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 		}
 		else if (name == "volume") {
 			if (value.empty()) {
-				tags.erase(XID6_VOLUME);
+				EraseTag(XID6_VOLUME);
 			}
 			else {
 				double num = strtod(value.c_str(), &endptr);
 				if (*endptr == '\0') {
-					uint32_t volume = (uint32_t)(num * 65536);
+					uint32_t volume = (uint32_t)(num * 65536 + 0.5);
 					SetIntegerTag(XID6_VOLUME, volume, 4);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal number format: volume\n");
+					report_message(messages, "Error: Illegal number format: volume");
 					no_error = false;
 				}
 			}
 		}
 		else if (name == "length") {
-			tags.erase(XID6_INTRO_LENGTH);
-			tags.erase(XID6_LOOP_LENGTH);
-			tags.erase(XID6_LOOP_COUNT);
-			tags.erase(XID6_END_LENGTH);
+			EraseTag(XID6_INTRO_LENGTH);
+			EraseTag(XID6_LOOP_LENGTH);
+			EraseTag(XID6_LOOP_COUNT);
+			EraseTag(XID6_END_LENGTH);
 
 			if (!value.empty()) {
 				bool valid_format;
@@ -931,14 +1056,14 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					SetIntegerTag(XID6_INTRO_LENGTH, ticks, 4);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal time format: length\n");
+					report_message(messages, "Error: Illegal time format: length");
 					no_error = false;
 				}
 			}
 		}
 		else if (name == "fade") {
 			if (value.empty()) {
-				tags.erase(XID6_FADE_LENGTH);
+				EraseTag(XID6_FADE_LENGTH);
 			}
 			else {
 				bool valid_format;
@@ -948,7 +1073,7 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					SetIntegerTag(XID6_FADE_LENGTH, ticks, 4);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal time format: fade\n");
+					report_message(messages, "Error: Illegal time format: fade");
 					no_error = false;
 				}
 			}
@@ -956,7 +1081,7 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 		// unofficial tags
 		else if (name == "created_at") {
 			if (value.empty()) {
-				tags.erase(XID6_DUMPED_DATE);
+				EraseTag(XID6_DUMPED_DATE);
 			}
 			else {
 				int year;
@@ -967,14 +1092,14 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					SetIntegerTag(XID6_DUMPED_DATE, year * 10000 + month * 100 + day, 4);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal date format: created_at\n");
+					report_message(messages, "Error: Illegal date format: created_at");
 					no_error = false;
 				}
 			}
 		}
 		else if (name == "emulator") {
 			if (value.empty()) {
-				tags.erase(XID6_EMULATOR);
+				EraseTag(XID6_EMULATOR);
 			}
 			else {
 				long num = strtol(value.c_str(), &endptr, 10);
@@ -987,7 +1112,7 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 						SetLengthTag(XID6_EMULATOR, (uint16_t)emu_id);
 					}
 					else {
-						fprintf(stderr, "Error: Unable to parse emulator id/name\n");
+						report_message(messages, "Error: Unable to parse emulator id/name");
 						no_error = false;
 					}
 				}
@@ -998,7 +1123,7 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 		}
 		else if (name == "disc") {
 			if (value.empty()) {
-				tags.erase(XID6_OST_DISC);
+				EraseTag(XID6_OST_DISC);
 			}
 			else {
 				long num = strtol(value.c_str(), &endptr, 10);
@@ -1006,14 +1131,14 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					SetLengthTag(XID6_OST_DISC, (uint16_t)num);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal number format: disc\n");
+					report_message(messages, "Error: Illegal number format: disc");
 					no_error = false;
 				}
 			}
 		}
 		else if (name == "track") {
 			if (value.empty()) {
-				tags.erase(XID6_OST_TRACK_NUMBER);
+				EraseTag(XID6_OST_TRACK_NUMBER);
 			}
 			else {
 				const char * c_str = value.c_str();
@@ -1025,14 +1150,14 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					}
 				}
 				else {
-					fprintf(stderr, "Error: Illegal number format: track\n");
+					report_message(messages, "Error: Illegal number format: track");
 					no_error = false;
 				}
 			}
 		}
 		else if (name == "intro") {
 			if (value.empty()) {
-				tags.erase(XID6_INTRO_LENGTH);
+				EraseTag(XID6_INTRO_LENGTH);
 			}
 			else {
 				bool valid_format;
@@ -1041,14 +1166,14 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					SetIntegerTag(XID6_INTRO_LENGTH, ticks, 4);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal time format: intro\n");
+					report_message(messages, "Error: Illegal time format: intro");
 					no_error = false;
 				}
 			}
 		}
 		else if (name == "loop") {
 			if (value.empty()) {
-				tags.erase(XID6_LOOP_LENGTH);
+				EraseTag(XID6_LOOP_LENGTH);
 			}
 			else {
 				bool valid_format;
@@ -1057,14 +1182,14 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					SetIntegerTag(XID6_LOOP_LENGTH, ticks, 4);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal time format: loop\n");
+					report_message(messages, "Error: Illegal time format: loop");
 					no_error = false;
 				}
 			}
 		}
 		else if (name == "end") {
 			if (value.empty()) {
-				tags.erase(XID6_END_LENGTH);
+				EraseTag(XID6_END_LENGTH);
 			}
 			else {
 				bool valid_format;
@@ -1073,14 +1198,14 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					SetIntegerTag(XID6_END_LENGTH, ticks, 4);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal time format: end\n");
+					report_message(messages, "Error: Illegal time format: end");
 					no_error = false;
 				}
 			}
 		}
 		else if (name == "mute") {
 			if (value.empty()) {
-				tags.erase(XID6_MUTED_VOICES);
+				EraseTag(XID6_MUTED_VOICES);
 			}
 			else {
 				long num = strtol(value.c_str(), &endptr, 10);
@@ -1088,14 +1213,14 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					SetLengthTag(XID6_MUTED_VOICES, (uint16_t)num);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal number format: mute\n");
+					report_message(messages, "Error: Illegal number format: mute");
 					no_error = false;
 				}
 			}
 		}
 		else if (name == "loopcount") {
 			if (value.empty()) {
-				tags.erase(XID6_LOOP_COUNT);
+				EraseTag(XID6_LOOP_COUNT);
 			}
 			else {
 				long num = strtol(value.c_str(), &endptr, 10);
@@ -1103,94 +1228,171 @@ bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags)
 					SetLengthTag(XID6_LOOP_COUNT, (uint16_t)num);
 				}
 				else {
-					fprintf(stderr, "Error: Illegal number format: loopcount\n");
+					report_message(messages, "Error: Illegal number format: loopcount");
 					no_error = false;
 				}
 			}
 		}
 		else {
-			fprintf(stderr, "Warning: \"%s\" tag is ignored\n", name.c_str());
+			report_message(messages, ("Warning: \"" + name + "\" tag is ignored").c_str());
 		}
 	}
 	return no_error;
 }
 
-std::map<std::string, std::string> SPCFile::ExportPSFTag(bool unofficial_tags) const
+void SPCFile::TagPatch::EraseTag(XID6ItemId id)
+{
+	Operation operation = Operation();
+	operation.id = id;
+	operation.erase = true;
+	operations.push_back(operation);
+}
+
+void SPCFile::TagPatch::SetLengthTag(XID6ItemId id, uint16_t value)
 {
-	std::map<std::string, std::string> psf_tags;
+	Operation operation;
+	operation.id = id;
+	operation.erase = false;
+	operation.item = MakeIntegerItem(value, 2);
+	operation.item.type = XID6_TYPE_LENGTH;
+	operations.push_back(operation);
+}
+
+void SPCFile::TagPatch::SetIntegerTag(XID6ItemId id, uint32_t value, size_t size)
+{
+	Operation operation;
+	operation.id = id;
+	operation.erase = false;
+	operation.item = MakeIntegerItem(value, size);
+	operations.push_back(operation);
+}
+
+void SPCFile::TagPatch::SetStringTag(XID6ItemId id, const std::string & str)
+{
+	if (str.empty()) {
+		EraseTag(id);
+		return;
+	}
+
+	Operation operation;
+	operation.id = id;
+	operation.erase = false;
+	operation.item = MakeStringItem(str);
+	operations.push_back(operation);
+}
+
+void SPCFile::TagPatch::Apply(SPCFile & spc) const
+{
+	Stats::Scope stats_scope(Stats::PHASE_TAG);
+
+	for (auto itr = operations.begin(); itr != operations.end(); ++itr) {
+		if (itr->erase) {
+			spc.tags.erase(itr->id);
+		}
+		else {
+			spc.tags[itr->id] = itr->item;
+		}
+	}
+}
+
+bool SPCFile::IsPSFTagName(const std::string & name)
+{
+	for (size_t i = 0; i < sizeof(PSF_TAG_NAMES) / sizeof(PSF_TAG_NAMES[0]); i++) {
+		if (name == PSF_TAG_NAMES[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SPCFile::ImportPSFTag(const std::map<std::string, std::string> & psf_tags, std::string * messages)
+{
+	TagPatch patch;
+	bool no_error = patch.Compile(psf_tags, messages);
+	patch.Apply(*this);
+	return no_error;
+}
+
+void SPCFile::VisitPSFTags(bool unofficial_tags, PSFTagVisitor & visitor) const
+{
+	// at most one field per name; values that need formatting live in buffers
+	struct Field {
+		const char * name;
+		const char * value;
+		size_t size;
+	};
+	Field fields[PSF_TAG_FIELD_MAX];
+	char buffers[PSF_TAG_FIELD_MAX][XID6_TIME_STRING_MAX];
+	size_t num_fields = 0;
 
 	uint32_t length_in_ticks = GetPlaybackLength();
 	if (length_in_ticks != 0) {
-		std::string time_string = XID6TicksToTimeString(length_in_ticks, false);
-		psf_tags["length"] = time_string;
+		fields[num_fields].name = "length";
+		fields[num_fields].value = buffers[num_fields];
+		fields[num_fields].size = FormatXID6Ticks(length_in_ticks, false, buffers[num_fields]);
+		num_fields++;
 	}
 
-	for (auto itr = tags.begin(); itr != tags.end(); ++itr) {
-		char s[256];
-
+	for (auto itr = tags.begin(); itr != tags.end() && num_fields < PSF_TAG_FIELD_MAX; ++itr) {
 		const XID6ItemId id = (*itr).first;
+		const std::vector<char> & data = (*itr).second.value;
+
+		Field & field = fields[num_fields];
+		char * s = buffers[num_fields];
+		field.name = NULL;
+		field.value = s;
+		field.size = 0;
 
 		switch (id) {
 		case XID6_SONG_NAME:
-			psf_tags["title"] = GetStringTag(id);
+			field.name = "title";
 			break;
 
 		case XID6_ARTIST_NAME:
-			psf_tags["artist"] = GetStringTag(id);
+			field.name = "artist";
 			break;
 
 		case XID6_GAME_NAME:
-			psf_tags["game"] = GetStringTag(id);
+			field.name = "game";
 			break;
 
 		case XID6_COPYRIGHT_YEAR:
-			sprintf(s, "%d", GetIntegerTag(id));
-			psf_tags["year"] = s;
+			field.name = "year";
+			field.size = sprintf(s, "%d", GetIntegerTag(id));
 			break;
 
 		case XID6_COMMENT:
-			psf_tags["comment"] = GetStringTag(id);
+			field.name = "comment";
 			break;
 
 		case XID6_PUBLISHER_NAME:
-			psf_tags["copyright"] = GetStringTag(id);
+			field.name = "copyright";
 			break;
 
 		case XID6_DUMPER_NAME:
-			psf_tags["snsfby"] = GetStringTag(id);
+			field.name = "snsfby";
 			break;
 
 		case XID6_VOLUME:
 		{
-			sprintf(s, "%.6f", (double)GetIntegerTag(id) / 65536);
+			field.name = "volume";
+			field.size = sprintf(s, "%.6f", (double)(uint32_t)GetIntegerTag(id) / 65536);
 
 			// trim zeros
-			size_t offset = strlen(s) - 1;
-			while (offset > 0) {
-				if (s[offset] == '0') {
-					s[offset] = '\0';
-				}
-				else {
-					if (s[offset] == '.') {
-						s[offset] = '\0';
-					}
-					break;
-				}
-
-				offset--;
+			while (field.size > 1 && s[field.size - 1] == '0') {
+				field.size--;
 			}
-
-			psf_tags["volume"] = s;
+			if (s[field.size - 1] == '.') {
+				field.size--;
+			}
+			s[field.size] = '\0';
 			break;
 		}
 
 		case XID6_FADE_LENGTH:
-		{
-			uint32_t ticks = GetIntegerTag(id);
-			std::string time_string = XID6TicksToTimeString(ticks, false);
-			psf_tags["fade"] = time_string;
+			field.name = "fade";
+			field.size = FormatXID6Ticks(GetIntegerTag(id), false, s);
 			break;
-		}
 
 		default:
 			if (unofficial_tags) {
@@ -1202,23 +1404,23 @@ std::map<std::string, std::string> SPCFile::ExportPSFTag(bool unofficial_tags) c
 					uint32_t month = (yyyymmdd / 100) % 100;
 					uint32_t day = yyyymmdd % 100;
 
-					sprintf(s, "%d/%02d/%02d", year, month, day);
-					psf_tags["created_at"] = s;
+					field.name = "created_at";
+					field.size = sprintf(s, "%d/%02d/%02d", year, month, day);
 					break;
 				}
 
 				case XID6_EMULATOR:
-					sprintf(s, "%d", GetIntegerTag(id));
-					psf_tags["emulator"] = s;
+					field.name = "emulator";
+					field.size = sprintf(s, "%d", GetIntegerTag(id));
 					break;
 
 				case XID6_OST_TITLE:
-					psf_tags["soundtrack"] = GetStringTag(id);
+					field.name = "soundtrack";
 					break;
 
 				case XID6_OST_DISC:
-					sprintf(s, "%d", GetIntegerTag(id));
-					psf_tags["disc"] = s;
+					field.name = "disc";
+					field.size = sprintf(s, "%d", GetIntegerTag(id));
 					break;
 
 				case XID6_OST_TRACK_NUMBER:
@@ -1226,43 +1428,35 @@ std::map<std::string, std::string> SPCFile::ExportPSFTag(bool unofficial_tags) c
 					uint16_t num = GetIntegerTag(id);
 					uint8_t track = num >> 8;
 					uint8_t sym = num & 0xff;
-					sprintf(s, "%d%c", track, sym);
-					psf_tags["track"] = s;
+					field.name = "track";
+					// the letter suffix is optional, 0 when absent
+					field.size = (sym != 0) ? sprintf(s, "%d%c", track, sym) : sprintf(s, "%d", track);
 					break;
 				}
 
 				case XID6_INTRO_LENGTH:
-				{
-					uint32_t ticks = GetIntegerTag(id);
-					std::string time_string = XID6TicksToTimeString(ticks, false);
-					psf_tags["intro"] = time_string;
+					field.name = "intro";
+					field.size = FormatXID6Ticks(GetIntegerTag(id), false, s);
 					break;
-				}
 
 				case XID6_LOOP_LENGTH:
-				{
-					uint32_t ticks = GetIntegerTag(id);
-					std::string time_string = XID6TicksToTimeString(ticks, false);
-					psf_tags["loop"] = time_string;
+					field.name = "loop";
+					field.size = FormatXID6Ticks(GetIntegerTag(id), false, s);
 					break;
-				}
 
 				case XID6_END_LENGTH:
-				{
-					uint32_t ticks = GetIntegerTag(id);
-					std::string time_string = XID6TicksToTimeString(ticks, false);
-					psf_tags["end"] = time_string;
+					field.name = "end";
+					field.size = FormatXID6Ticks(GetIntegerTag(id), false, s);
 					break;
-				}
 
 				case XID6_MUTED_VOICES:
-					sprintf(s, "%d", GetIntegerTag(id));
-					psf_tags["mute"] = s;
+					field.name = "mute";
+					field.size = sprintf(s, "%d", GetIntegerTag(id));
 					break;
 
 				case XID6_LOOP_COUNT:
-					sprintf(s, "%d", GetIntegerTag(id));
-					psf_tags["loopcount"] = s;
+					field.name = "loopcount";
+					field.size = sprintf(s, "%d", GetIntegerTag(id));
 					break;
 
 				default:
@@ -1271,9 +1465,45 @@ std::map<std::string, std::string> SPCFile::ExportPSFTag(bool unofficial_tags) c
 				}
 			}
 		}
+
+		if (field.name == NULL) {
+			continue;
+		}
+
+		if (field.value == s && field.size == 0) {
+			// string tags point straight into the tag data
+			field.value = data.empty() ? "" : &data[0];
+			field.size = strnlen(field.value, data.size());
+		}
+		num_fields++;
+	}
+
+	// same order as the names in a std::map
+	std::sort(fields, fields + num_fields, [](const Field & a, const Field & b) {
+		return strcmp(a.name, b.name) < 0;
+	});
+
+	for (size_t i = 0; i < num_fields; i++) {
+		visitor.Visit(fields[i].name, fields[i].value, fields[i].size);
 	}
+}
+
+std::map<std::string, std::string> SPCFile::ExportPSFTag(bool unofficial_tags) const
+{
+	class MapBuilder : public PSFTagVisitor
+	{
+	public:
+		std::map<std::string, std::string> psf_tags;
+
+		virtual void Visit(const char * name, const char * value, size_t size)
+		{
+			psf_tags[name].assign(value, size);
+		}
+	};
 
-	return psf_tags;
+	MapBuilder builder;
+	VisitPSFTags(unofficial_tags, builder);
+	return builder.psf_tags;
 }
 
 bool SPCFile::ParseDateString(const std::string & str, int & year, int & month, int & day)
@@ -71,9 +71,29 @@ public:
 	uint8_t extra_ram[0x40];
 	std::map<XID6ItemId, XID6TagItem> tags;
 
+	enum ID666Format {
+		ID666_NONE = 0,
+		ID666_TEXT,
+		ID666_BINARY
+	};
+
+	// How the loaded file was laid out; Save always writes text ID666 and xid6 as needed.
+	ID666Format id666_format;
+	bool has_xid6;
+	size_t file_size;
+
 	static bool IsSPCFile(const std::string& filename);
-	static SPCFile * Load(const std::string& filename);
+
+	// Size and signature check on the first SIGNATURE_CHECK_SIZE bytes of a file.
+	static const size_t MIN_FILE_SIZE = 0x10200;
+	static const size_t SIGNATURE_CHECK_SIZE = 0x23;
+	static bool IsSPCHeader(const uint8_t * header, uint64_t file_size);
+
+	// Warnings about tags that cannot be parsed are appended to messages, or printed to stderr if it is NULL.
+	static SPCFile * Load(const std::string& filename, std::string * messages = NULL);
+	static SPCFile * LoadFromMemory(const uint8_t * data, size_t size, std::string * messages = NULL);
 	bool Save(const std::string& filename) const;
+	void Serialize(std::vector<uint8_t> & data) const;
 
 	std::vector<uint8_t> GetXID6Block() const;
 
@@ -91,10 +111,63 @@ public:
 	static std::string XID6TicksToTimeString(uint32_t ticks, bool padding);
 	static uint32_t TimeStringToXID6Ticks(const std::string & str, bool * p_valid_format);
 
+	// Exact tick <-> "[[h:]mm:]ss[.fffffffff]" conversion without heap allocation.
+	// FormatXID6Ticks writes a null-terminated string of at most XID6_TIME_STRING_MAX bytes.
+	static const size_t XID6_TIME_STRING_MAX = 32;
+	static size_t FormatXID6Ticks(uint32_t ticks, bool padding, char * str);
+	static bool ParseXID6Ticks(const char * first, const char * last, uint32_t & ticks);
+
 	static std::string ID666IdToEmulatorName(ID666EmulatorId id);
 	static ID666EmulatorId EmulatorNameToID666Id(const std::string & name);
 
-	bool ImportPSFTag(const std::map<std::string, std::string> & psf_tags);
+	// Tag changes parsed from PSF-style name=value pairs once, then applied to any number of files.
+	class TagPatch
+	{
+	public:
+		// Malformed values are reported and left out; returns false if there were any.
+		// Unknown names are only warned about. Reports go to messages as in Load.
+		bool Compile(const std::map<std::string, std::string> & psf_tags, std::string * messages = NULL);
+
+		bool IsEmpty() const
+		{
+			return operations.empty();
+		}
+
+		void Apply(SPCFile & spc) const;
+
+	private:
+		struct Operation {
+			XID6ItemId id;
+			bool erase;
+			XID6TagItem item;
+		};
+
+		void EraseTag(XID6ItemId id);
+		void SetLengthTag(XID6ItemId id, uint16_t value);
+		void SetIntegerTag(XID6ItemId id, uint32_t value, size_t size);
+		void SetStringTag(XID6ItemId id, const std::string & str);
+
+		std::vector<Operation> operations;
+	};
+
+	class PSFTagVisitor
+	{
+	public:
+		virtual ~PSFTagVisitor() {}
+
+		// value is not null-terminated and only valid during the call.
+		virtual void Visit(const char * name, const char * value, size_t size) = 0;
+	};
+
+	static const size_t PSF_TAG_FIELD_MAX = 24;
+
+	// Visits the tags as PSF name=value pairs in name order, without heap allocation.
+	void VisitPSFTags(bool unofficial_tags, PSFTagVisitor & visitor) const;
+
+	// Whether TagPatch::Compile (and so ImportPSFTag) knows the name.
+	static bool IsPSFTagName(const std::string & name);
+
+	bool ImportPSFTag(const std::map<std::string, std::string> & psf_tags, std::string * messages = NULL);
 	std::map<std::string, std::string> ExportPSFTag(bool unofficial_tags) const;
 
 private:
@@ -102,6 +175,8 @@ private:
 	SPCFile& operator=(const SPCFile&);
 
 	static bool ParseDateString(const std::string & str, int & year, int & month, int & day);
+	static XID6TagItem MakeIntegerItem(uint32_t value, size_t size);
+	static XID6TagItem MakeStringItem(const std::string & str);
 	void SetTagValue(XID6ItemId id, XID6TypeId type, const uint8_t * binary, size_t size);
 };
 
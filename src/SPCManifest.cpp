@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "SPCManifest.h"
+#include "SPCFile.h"
+#include "Hash.h"
+
+#define MANIFEST_HEADER "# spcpoint manifest: size header id666 ram dsp extra_ram xid6 path"
+
+// file offset where each section starts; the last one ends at the end of the file
+static const size_t SECTION_OFFSETS[SPCManifest::SECTION_COUNT] = {
+	0x00,		// header
+	0x2e,		// id666
+	0x100,		// ram
+	0x10100,	// dsp
+	0x101c0,	// extra_ram
+	0x10200		// xid6
+};
+
+// the "ID666 present" byte (0x1a/0x1b) is in the header but changes with the tags
+#define ID666_FLAG_OFFSET	0x23
+
+static const char * const SECTION_NAMES[SPCManifest::SECTION_COUNT] = {
+	"header",
+	"id666",
+	"ram",
+	"dsp",
+	"extra_ram",
+	"xid6"
+};
+
+const char * SPCManifest::GetSectionName(int section)
+{
+	return (section >= 0 && section < SECTION_COUNT) ? SECTION_NAMES[section] : NULL;
+}
+
+bool SPCManifest::Compute(const std::string & filename, Entry & entry)
+{
+	const uint8_t * data = NULL;
+	size_t size = 0;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	HANDLE file_mapping = NULL;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)SPCFile::MIN_FILE_SIZE) {
+		file_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	if (file_mapping != NULL) {
+		data = (const uint8_t *)MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+		size = (size_t)file_size.QuadPart;
+		CloseHandle(file_mapping);
+	}
+	CloseHandle(file);
+#else
+	int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)SPCFile::MIN_FILE_SIZE) {
+		void * p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			data = (const uint8_t *)p;
+			size = (size_t)st.st_size;
+		}
+	}
+	close(fd);
+#endif
+
+	if (data == NULL) {
+		return false;
+	}
+
+	bool valid = SPCFile::IsSPCHeader(data, size);
+	if (valid) {
+		entry.filename = filename;
+		entry.size = size;
+		for (int i = 0; i < SECTION_COUNT; i++) {
+			size_t section_end = (i + 1 < SECTION_COUNT) ? SECTION_OFFSETS[i + 1] : size;
+			uint64_t seed = (i == SECTION_ID666) ? data[ID666_FLAG_OFFSET] : 0;
+			entry.hashes[i] = Hash::XXH64(data + SECTION_OFFSETS[i], section_end - SECTION_OFFSETS[i], seed);
+		}
+
+		// the ID666 flag is counted in id666 instead, so tagging an untagged file is not header damage
+		uint8_t header[0x2e];
+		memcpy(header, data, sizeof(header));
+		header[ID666_FLAG_OFFSET] = 0;
+		entry.hashes[SECTION_HEADER] = Hash::XXH64(header, sizeof(header));
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void *)data, size);
+#endif
+	return valid;
+}
+
+bool SPCManifest::Write(const std::string & filename, const std::vector<Entry> & entries)
+{
+	FILE * fp = fopen(filename.c_str(), "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Unable to open \"%s\"\n", filename.c_str());
+		return false;
+	}
+
+	fputs(MANIFEST_HEADER "\n", fp);
+	for (auto itr = entries.begin(); itr != entries.end(); ++itr) {
+		const Entry & entry = *itr;
+
+		fprintf(fp, "%llu", (unsigned long long)entry.size);
+		for (int i = 0; i < SECTION_COUNT; i++) {
+			fprintf(fp, " %016llx", (unsigned long long)entry.hashes[i]);
+		}
+		fprintf(fp, " %s\n", entry.filename.c_str());
+	}
+
+	bool no_error = ferror(fp) == 0;
+	if (fclose(fp) != 0) {
+		no_error = false;
+	}
+
+	if (!no_error) {
+		fprintf(stderr, "Error: Unable to write \"%s\"\n", filename.c_str());
+	}
+	return no_error;
+}
+
+bool SPCManifest::Read(const std::string & filename, std::vector<Entry> & entries)
+{
+	FILE * fp = fopen(filename.c_str(), "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Unable to open \"%s\"\n", filename.c_str());
+		return false;
+	}
+
+	char line[0x2000];
+	unsigned long line_number = 0;
+	bool no_error = true;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line_number++;
+
+		size_t length = strlen(line);
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+			line[--length] = '\0';
+		}
+		if (length == 0 || line[0] == '#') {
+			continue;
+		}
+
+		Entry entry;
+		char * p = line;
+		char * endptr = NULL;
+
+		entry.size = strtoull(p, &endptr, 10);
+		bool valid = endptr != p && *endptr == ' ';
+		for (int i = 0; i < SECTION_COUNT && valid; i++) {
+			p = endptr + 1;
+			entry.hashes[i] = strtoull(p, &endptr, 16);
+			valid = endptr - p == 16 && *endptr == ' ';
+		}
+
+		if (!valid || endptr[1] == '\0') {
+			fprintf(stderr, "Error: %s:%lu: Invalid manifest line\n", filename.c_str(), line_number);
+			no_error = false;
+			break;
+		}
+
+		entry.filename = endptr + 1;
+		entries.push_back(entry);
+	}
+
+	if (ferror(fp) != 0) {
+		fprintf(stderr, "Error: Unable to read \"%s\"\n", filename.c_str());
+		no_error = false;
+	}
+	fclose(fp);
+	return no_error;
+}
@@ -0,0 +1,50 @@
+/**
+ * Integrity manifest of a collection: a 64-bit hash of each section of every SPC file.
+ *
+ * Hashing the tag sections apart from the sections the music is made of tells a tag edit
+ * from damage to the data that plays. Files are hashed through a memory mapping.
+ */
+
+#ifndef SPCMANIFEST_H_INCLUDED
+#define SPCMANIFEST_H_INCLUDED
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+class SPCManifest
+{
+public:
+	enum Section {
+		SECTION_HEADER = 0,		// signature and CPU registers
+		SECTION_ID666,			// also covers the ID666 flag at 0x23 in the header
+		SECTION_RAM,
+		SECTION_DSP,			// DSP registers and the unused bytes after them
+		SECTION_EXTRA_RAM,
+		SECTION_XID6,			// everything after the extra RAM
+		SECTION_COUNT
+	};
+
+	struct Entry {
+		std::string filename;
+		uint64_t size;
+		uint64_t hashes[SECTION_COUNT];
+	};
+
+	static const char * GetSectionName(int section);
+
+	// ID666 and xid6 only hold tags.
+	static bool IsTagSection(int section)
+	{
+		return section == SECTION_ID666 || section == SECTION_XID6;
+	}
+
+	// Hashes the sections of an SPC file. Returns false if it cannot be read or is not an SPC file.
+	static bool Compute(const std::string & filename, Entry & entry);
+
+	static bool Write(const std::string & filename, const std::vector<Entry> & entries);
+	static bool Read(const std::string & filename, std::vector<Entry> & entries);
+};
+
+#endif /* !SPCMANIFEST_H_INCLUDED */
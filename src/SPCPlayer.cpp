@@ -0,0 +1,93 @@
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "SPCPlayer.h"
+#include "SPCFile.h"
+
+SPCFadeOut::SPCFadeOut() :
+	position(0),
+	play_frames(0),
+	fade_frames(0),
+	volume(0x10000)
+{
+}
+
+void SPCFadeOut::Load(const SPCFile & spc)
+{
+	uint32_t length = spc.GetPlaybackLength();
+	if (length == 0) {
+		length = SPCFile::MilliSecondsToXID6Ticks(DEFAULT_LENGTH * 1000);
+	}
+
+	uint32_t fade_length = SPCFile::MilliSecondsToXID6Ticks(DEFAULT_FADE_LENGTH * 1000);
+	if (spc.tags.count(SPCFile::XID6_FADE_LENGTH) != 0) {
+		fade_length = spc.GetIntegerTag(SPCFile::XID6_FADE_LENGTH);
+	}
+
+	volume = 0x10000;
+	if (spc.tags.count(SPCFile::XID6_VOLUME) != 0) {
+		volume = spc.GetIntegerTag(SPCFile::XID6_VOLUME);
+	}
+
+	position = 0;
+	play_frames = length / SPCPlayer::TICKS_PER_FRAME;
+	fade_frames = fade_length / SPCPlayer::TICKS_PER_FRAME;
+}
+
+void SPCFadeOut::Apply(int16_t * out, size_t num_frames)
+{
+	uint64_t total_frames = GetTotalFrames();
+	for (size_t i = 0; i < num_frames; i++) {
+		uint64_t frame = position + i;
+
+		// linear fade-out, folded into the amplification
+		int64_t gain = volume;
+		if (frame >= play_frames) {
+			gain = gain * (int64_t)(total_frames - frame) / (int64_t)fade_frames;
+		}
+
+		if (gain != 0x10000) {
+			for (int ch = 0; ch < 2; ch++) {
+				int64_t sample = (out[i * 2 + ch] * gain) >> 16;
+				out[i * 2 + ch] = (int16_t)std::max<int64_t>(-32768, std::min<int64_t>(32767, sample));
+			}
+		}
+	}
+
+	position += num_frames;
+}
+
+SPCPlayer::SPCPlayer()
+{
+}
+
+SPCPlayer::~SPCPlayer()
+{
+}
+
+void SPCPlayer::Load(const SPCFile & spc)
+{
+	emulator.Load(spc);
+	emulator.SetMuteMask((uint8_t)spc.GetIntegerTag(SPCFile::XID6_MUTED_VOICES));
+	checkpoints.Reset(emulator);
+	fade.Load(spc);
+}
+
+size_t SPCPlayer::Read(int16_t * out, size_t num_frames)
+{
+	num_frames = (size_t)std::min<uint64_t>(num_frames, fade.GetRemainingFrames());
+	if (num_frames == 0) {
+		return 0;
+	}
+
+	checkpoints.Render(emulator, out, num_frames);
+	fade.Apply(out, num_frames);
+	return num_frames;
+}
+
+void SPCPlayer::Seek(uint64_t frame)
+{
+	fade.Seek(frame);
+	checkpoints.Seek(emulator, fade.GetPosition());
+}
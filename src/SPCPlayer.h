@@ -0,0 +1,111 @@
+/**
+ * Plays back an SPC file for the duration given by its tags,
+ * applying fade-out, amplification and muted voices.
+ */
+
+#ifndef SPCPLAYER_H_INCLUDED
+#define SPCPLAYER_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "SPCEmulator.h"
+#include "SPCCheckpoints.h"
+
+class SPCFile;
+
+// Song length, fade-out and amplification taken from the tags.
+class SPCFadeOut
+{
+public:
+	SPCFadeOut();
+
+	// used when the file does not specify them (in seconds)
+	static const uint32_t DEFAULT_LENGTH = 180;
+	static const uint32_t DEFAULT_FADE_LENGTH = 10;
+
+	void Load(const SPCFile & spc);
+
+	uint64_t GetTotalFrames() const
+	{
+		return play_frames + fade_frames;
+	}
+
+	// Frames before the fade-out starts.
+	uint64_t GetPlayFrames() const
+	{
+		return play_frames;
+	}
+
+	uint64_t GetPosition() const
+	{
+		return position;
+	}
+
+	uint64_t GetRemainingFrames() const
+	{
+		return GetTotalFrames() - position;
+	}
+
+	void Seek(uint64_t frame)
+	{
+		position = (frame < GetTotalFrames()) ? frame : GetTotalFrames();
+	}
+
+	// Applies the gain to frames starting at the current position, then advances it.
+	void Apply(int16_t * out, size_t num_frames);
+
+private:
+	uint64_t position;
+	uint64_t play_frames;
+	uint64_t fade_frames;
+	uint32_t volume;	// 16.16 fixed point
+};
+
+class SPCPlayer
+{
+public:
+	SPCPlayer();
+	virtual ~SPCPlayer();
+
+	static const uint32_t DEFAULT_LENGTH = SPCFadeOut::DEFAULT_LENGTH;
+	static const uint32_t DEFAULT_FADE_LENGTH = SPCFadeOut::DEFAULT_FADE_LENGTH;
+
+	static const int SAMPLE_RATE = SPCEmulator::SAMPLE_RATE;
+
+	// XID6 ticks are 1/64000 seconds
+	static const uint32_t TICKS_PER_FRAME = 64000 / SAMPLE_RATE;
+
+	void Load(const SPCFile & spc);
+
+	// Returns the number of stereo frames written, 0 at the end of the song.
+	size_t Read(int16_t * out, size_t num_frames);
+
+	// Emulates only from the nearest checkpoint recorded so far.
+	void Seek(uint64_t frame);
+
+	uint64_t GetTotalFrames() const
+	{
+		return fade.GetTotalFrames();
+	}
+
+	uint64_t GetPosition() const
+	{
+		return fade.GetPosition();
+	}
+
+	SPCEmulator & GetEmulator()
+	{
+		return emulator;
+	}
+
+private:
+	SPCPlayer(const SPCPlayer&);
+	SPCPlayer& operator=(const SPCPlayer&);
+
+	SPCEmulator emulator;
+	SPCCheckpoints checkpoints;
+	SPCFadeOut fade;
+};
+
+#endif /* !SPCPLAYER_H_INCLUDED */
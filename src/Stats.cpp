@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "Stats.h"
+
+std::atomic<bool> Stats::enabled(false);
+thread_local Stats::Phase Stats::current_phase = Stats::PHASE_NONE;
+
+Stats::PhaseCounters Stats::phases[Stats::PHASE_COUNT];
+std::atomic<uint64_t> Stats::allocations[Stats::PHASE_COUNT];
+std::atomic<uint64_t> Stats::bytes_read(0);
+std::atomic<uint64_t> Stats::bytes_written(0);
+std::atomic<uint64_t> Stats::syscalls(0);
+std::atomic<uint64_t> Stats::files(0);
+
+void Stats::Enable()
+{
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+const char * Stats::PhaseName(Phase phase)
+{
+	switch (phase) {
+	case PHASE_LOAD:
+		return "load";
+
+	case PHASE_TAG:
+		return "tag";
+
+	case PHASE_SERIALIZE:
+		return "serialize";
+
+	case PHASE_SAVE:
+		return "save";
+
+	default:
+		return "other";
+	}
+}
+
+void Stats::Record(Phase phase, std::chrono::steady_clock::duration elapsed)
+{
+	uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+	PhaseCounters & counters = phases[phase];
+
+	counters.count.fetch_add(1, std::memory_order_relaxed);
+	counters.total_ns.fetch_add(ns, std::memory_order_relaxed);
+
+	uint64_t max_ns = counters.max_ns.load(std::memory_order_relaxed);
+	while (ns > max_ns && !counters.max_ns.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed)) {
+	}
+
+	int bucket = 0;
+	for (uint64_t us = ns / 1000; us != 0 && bucket < HISTOGRAM_BUCKETS - 1; us >>= 1) {
+		bucket++;
+	}
+	counters.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Upper bound of the histogram bucket holding the given quantile, in microseconds.
+static uint64_t HistogramQuantile(const std::atomic<uint64_t> * histogram, int num_buckets, uint64_t count, double quantile)
+{
+	uint64_t rank = (uint64_t)(count * quantile);
+	uint64_t seen = 0;
+	for (int i = 0; i < num_buckets; i++) {
+		seen += histogram[i].load(std::memory_order_relaxed);
+		if (seen > rank) {
+			return (uint64_t)1 << i;
+		}
+	}
+	return (uint64_t)1 << (num_buckets - 1);
+}
+
+void Stats::PrintSummary(FILE * fp)
+{
+	uint64_t num_files = files.load(std::memory_order_relaxed);
+
+	fprintf(fp, "-----statistics-----\n");
+	fprintf(fp, "files: %llu\n", (unsigned long long)num_files);
+	fprintf(fp, "bytes read: %llu\n", (unsigned long long)bytes_read.load(std::memory_order_relaxed));
+	fprintf(fp, "bytes written: %llu\n", (unsigned long long)bytes_written.load(std::memory_order_relaxed));
+	fprintf(fp, "syscalls: %llu\n", (unsigned long long)syscalls.load(std::memory_order_relaxed));
+
+	uint64_t total_allocations = 0;
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		total_allocations += allocations[i].load(std::memory_order_relaxed);
+	}
+	fprintf(fp, "heap allocations: %llu", (unsigned long long)total_allocations);
+	if (num_files != 0) {
+		fprintf(fp, " (%.1f per file)", (double)total_allocations / num_files);
+	}
+	fprintf(fp, "\n");
+
+	for (int i = PHASE_NONE + 1; i < PHASE_COUNT; i++) {
+		const PhaseCounters & counters = phases[i];
+		uint64_t count = counters.count.load(std::memory_order_relaxed);
+		if (count == 0) {
+			continue;
+		}
+
+		uint64_t total_ns = counters.total_ns.load(std::memory_order_relaxed);
+		fprintf(fp, "%s: %llu calls, %.3f ms total, %.1f us mean, %.1f us max, p50 < %llu us, p99 < %llu us, %llu allocations\n",
+			PhaseName((Phase)i), (unsigned long long)count,
+			total_ns / 1e6, total_ns / 1e3 / count,
+			counters.max_ns.load(std::memory_order_relaxed) / 1e3,
+			(unsigned long long)HistogramQuantile(counters.histogram, HISTOGRAM_BUCKETS, count, 0.50),
+			(unsigned long long)HistogramQuantile(counters.histogram, HISTOGRAM_BUCKETS, count, 0.99),
+			(unsigned long long)allocations[i].load(std::memory_order_relaxed));
+
+		for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+			uint64_t n = counters.histogram[bucket].load(std::memory_order_relaxed);
+			if (n != 0) {
+				fprintf(fp, "  < %10llu us: %llu\n", (unsigned long long)1 << bucket, (unsigned long long)n);
+			}
+		}
+	}
+
+	fprintf(fp, "--------------------\n");
+}
+
+void Stats::PrintJSON(FILE * fp)
+{
+	fprintf(fp, "{\"files\":%llu,\"bytes_read\":%llu,\"bytes_written\":%llu,\"syscalls\":%llu,\"phases\":{",
+		(unsigned long long)files.load(std::memory_order_relaxed),
+		(unsigned long long)bytes_read.load(std::memory_order_relaxed),
+		(unsigned long long)bytes_written.load(std::memory_order_relaxed),
+		(unsigned long long)syscalls.load(std::memory_order_relaxed));
+
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		const PhaseCounters & counters = phases[i];
+
+		fprintf(fp, "%s\"%s\":{\"count\":%llu,\"total_ns\":%llu,\"max_ns\":%llu,\"allocations\":%llu,\"histogram_us_log2\":[",
+			(i != 0) ? "," : "", PhaseName((Phase)i),
+			(unsigned long long)counters.count.load(std::memory_order_relaxed),
+			(unsigned long long)counters.total_ns.load(std::memory_order_relaxed),
+			(unsigned long long)counters.max_ns.load(std::memory_order_relaxed),
+			(unsigned long long)allocations[i].load(std::memory_order_relaxed));
+
+		for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+			fprintf(fp, "%s%llu", (bucket != 0) ? "," : "",
+				(unsigned long long)counters.histogram[bucket].load(std::memory_order_relaxed));
+		}
+		fprintf(fp, "]}");
+	}
+
+	fprintf(fp, "}}\n");
+}
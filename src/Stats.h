@@ -0,0 +1,144 @@
+/**
+ * Opt-in phase timing and I/O counters for the tagging pipeline.
+ */
+
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "Trace.h"
+
+class Stats
+{
+public:
+	enum Phase {
+		PHASE_NONE = 0,
+		PHASE_LOAD,
+		PHASE_TAG,
+		PHASE_SERIALIZE,
+		PHASE_SAVE,
+		PHASE_COUNT
+	};
+
+	// Wall time histogram buckets, log2 of microseconds (<1us, <2us, ... >=2^30us).
+	static const int HISTOGRAM_BUCKETS = 32;
+
+	// Counters are only touched when this is set, so the disabled cost is one branch.
+	static std::atomic<bool> enabled;
+
+	static void Enable();
+	static bool IsEnabled()
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	// One read/write call of the given size.
+	static void AddRead(uint64_t bytes)
+	{
+		if (IsEnabled()) {
+			syscalls.fetch_add(1, std::memory_order_relaxed);
+			bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+		}
+	}
+
+	static void AddWrite(uint64_t bytes)
+	{
+		if (IsEnabled()) {
+			syscalls.fetch_add(1, std::memory_order_relaxed);
+			bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+		}
+	}
+
+	// Other file system calls (stat, open, seek, close).
+	static void AddSyscalls(uint64_t count)
+	{
+		if (IsEnabled()) {
+			syscalls.fetch_add(count, std::memory_order_relaxed);
+		}
+	}
+
+	static void AddAllocation()
+	{
+		if (IsEnabled()) {
+			allocations[current_phase].fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	static void AddFile()
+	{
+		if (IsEnabled()) {
+			files.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	static const char * PhaseName(Phase phase);
+
+	static void PrintSummary(FILE * fp);
+	static void PrintJSON(FILE * fp);
+
+	// Times the enclosing block as the given phase and attributes allocations to it.
+	// The span is also recorded to the trace output when tracing is enabled.
+	class Scope
+	{
+	public:
+		explicit Scope(Phase phase) : active(IsEnabled() || Trace::IsEnabled())
+		{
+			if (active) {
+				this->phase = phase;
+				previous_phase = current_phase;
+				current_phase = phase;
+				start = std::chrono::steady_clock::now();
+			}
+		}
+
+		~Scope()
+		{
+			if (active) {
+				std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+				current_phase = previous_phase;
+
+				if (IsEnabled()) {
+					Record(phase, end - start);
+				}
+				if (Trace::IsEnabled()) {
+					Trace::AddSpan(PhaseName(phase), start, end);
+				}
+			}
+		}
+
+	private:
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+
+		bool active;
+		Phase phase;
+		Phase previous_phase;
+		std::chrono::steady_clock::time_point start;
+	};
+
+private:
+	struct PhaseCounters {
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> total_ns;
+		std::atomic<uint64_t> max_ns;
+		std::atomic<uint64_t> histogram[HISTOGRAM_BUCKETS];
+	};
+
+	static void Record(Phase phase, std::chrono::steady_clock::duration elapsed);
+
+	static thread_local Phase current_phase;
+
+	static PhaseCounters phases[PHASE_COUNT];
+	static std::atomic<uint64_t> allocations[PHASE_COUNT];
+	static std::atomic<uint64_t> bytes_read;
+	static std::atomic<uint64_t> bytes_written;
+	static std::atomic<uint64_t> syscalls;
+	static std::atomic<uint64_t> files;
+};
+
+#endif /* !STATS_H_INCLUDED */
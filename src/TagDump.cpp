@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "TagDump.h"
+#include "TextEncoding.h"
+
+// Every name VisitPSFTags can produce, in the same (sorted) order.
+static const char * const CSV_TAG_COLUMNS[] = {
+	"artist", "comment", "copyright", "created_at", "disc", "emulator", "end", "fade", "game", "intro",
+	"length", "loop", "loopcount", "mute", "snsfby", "soundtrack", "title", "track", "volume", "year"
+};
+static const size_t CSV_TAG_COLUMN_COUNT = sizeof(CSV_TAG_COLUMNS) / sizeof(CSV_TAG_COLUMNS[0]);
+
+static const char * id666_format_name(SPCFile::ID666Format format)
+{
+	switch (format) {
+	case SPCFile::ID666_TEXT:
+		return "text";
+
+	case SPCFile::ID666_BINARY:
+		return "binary";
+
+	default:
+		return "none";
+	}
+}
+
+bool TagDump::ParseFormat(const char * name, Format & format)
+{
+	if (strcmp(name, "ndjson") == 0) {
+		format = FORMAT_NDJSON;
+		return true;
+	}
+	else if (strcmp(name, "csv") == 0) {
+		format = FORMAT_CSV;
+		return true;
+	}
+	return false;
+}
+
+void TagDump::AppendHeader(Format format, std::string & out)
+{
+	if (format == FORMAT_CSV) {
+		out += "file,size,id666,xid6";
+		for (size_t i = 0; i < CSV_TAG_COLUMN_COUNT; i++) {
+			out += ',';
+			out += CSV_TAG_COLUMNS[i];
+		}
+		out += '\n';
+	}
+}
+
+void TagDump::AppendFile(Format format, const std::string & filename, const SPCFile & spc, std::string & out)
+{
+	char s[32];
+
+	if (format == FORMAT_NDJSON) {
+		class JSONTagWriter : public SPCFile::PSFTagVisitor
+		{
+		public:
+			JSONTagWriter(std::string & out) : out(out), first(true) {}
+
+			virtual void Visit(const char * name, const char * value, size_t size)
+			{
+				if (!first) {
+					out += ',';
+				}
+				first = false;
+
+				out += '"';
+				out += name;
+				out += "\":";
+				AppendJSONString(out, value, size);
+			}
+
+		private:
+			std::string & out;
+			bool first;
+		};
+
+		out += "{\"file\":";
+		AppendJSONString(out, filename.c_str(), filename.size());
+		sprintf(s, ",\"size\":%lu", (unsigned long)spc.file_size);
+		out += s;
+		out += ",\"id666\":\"";
+		out += id666_format_name(spc.id666_format);
+		out += spc.has_xid6 ? "\",\"xid6\":true" : "\",\"xid6\":false";
+		out += ",\"tags\":{";
+
+		JSONTagWriter writer(out);
+		spc.VisitPSFTags(true, writer);
+
+		out += "}}\n";
+	}
+	else {
+		// the tags arrive sorted, so the columns are filled in a single pass
+		class CSVTagWriter : public SPCFile::PSFTagVisitor
+		{
+		public:
+			CSVTagWriter(std::string & out) : out(out), column(0) {}
+
+			virtual void Visit(const char * name, const char * value, size_t size)
+			{
+				while (column < CSV_TAG_COLUMN_COUNT && strcmp(CSV_TAG_COLUMNS[column], name) != 0) {
+					out += ',';
+					column++;
+				}
+				if (column < CSV_TAG_COLUMN_COUNT) {
+					out += ',';
+					AppendCSVField(out, value, size);
+					column++;
+				}
+			}
+
+			void Finish()
+			{
+				for (; column < CSV_TAG_COLUMN_COUNT; column++) {
+					out += ',';
+				}
+			}
+
+		private:
+			std::string & out;
+			size_t column;
+		};
+
+		AppendCSVField(out, filename.c_str(), filename.size());
+		sprintf(s, ",%lu,", (unsigned long)spc.file_size);
+		out += s;
+		out += id666_format_name(spc.id666_format);
+		out += spc.has_xid6 ? ",1" : ",0";
+
+		CSVTagWriter writer(out);
+		spc.VisitPSFTags(true, writer);
+		writer.Finish();
+
+		out += '\n';
+	}
+}
+
+void TagDump::AppendJSONString(std::string & out, const char * str, size_t size)
+{
+	const uint8_t * p = (const uint8_t *)str;
+	char s[8];
+
+	out += '"';
+	for (size_t i = 0; i < size; ) {
+		uint8_t c = p[i];
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += (char)c;
+			i++;
+		}
+		else if (c < 0x20) {
+			switch (c) {
+			case '\n':
+				out += "\\n";
+				break;
+
+			case '\r':
+				out += "\\r";
+				break;
+
+			case '\t':
+				out += "\\t";
+				break;
+
+			default:
+				sprintf(s, "\\u%04x", c);
+				out += s;
+				break;
+			}
+			i++;
+		}
+		else {
+			size_t length = TextEncoding::UTF8SequenceLength(&p[i], size - i);
+			if (length != 0) {
+				out.append(&str[i], length);
+				i += length;
+			}
+			else {
+				// Latin-1
+				out += (char)(0xc0 | (c >> 6));
+				out += (char)(0x80 | (c & 0x3f));
+				i++;
+			}
+		}
+	}
+	out += '"';
+}
+
+void TagDump::AppendCSVField(std::string & out, const char * str, size_t size)
+{
+	bool quote = false;
+	for (size_t i = 0; i < size; i++) {
+		if (str[i] == ',' || str[i] == '"' || str[i] == '\n' || str[i] == '\r') {
+			quote = true;
+			break;
+		}
+	}
+
+	if (!quote) {
+		out.append(str, size);
+		return;
+	}
+
+	out += '"';
+	for (size_t i = 0; i < size; i++) {
+		if (str[i] == '"') {
+			out += '"';
+		}
+		out += str[i];
+	}
+	out += '"';
+}
@@ -0,0 +1,38 @@
+/**
+ * Machine-readable tag dumps: one NDJSON object or CSV row per file.
+ */
+
+#ifndef TAGDUMP_H_INCLUDED
+#define TAGDUMP_H_INCLUDED
+
+#include <stddef.h>
+
+#include <string>
+
+#include "SPCFile.h"
+
+class TagDump
+{
+public:
+	enum Format {
+		FORMAT_NDJSON = 0,
+		FORMAT_CSV
+	};
+
+	// "ndjson" or "csv". Returns false if the name is unknown.
+	static bool ParseFormat(const char * name, Format & format);
+
+	// Appends what comes before the first file (the CSV header row).
+	static void AppendHeader(Format format, std::string & out);
+
+	// Appends the line of one file, including the newline.
+	static void AppendFile(Format format, const std::string & filename, const SPCFile & spc, std::string & out);
+
+	// Strings are written as UTF-8; bytes that are not valid UTF-8 are taken as Latin-1.
+	static void AppendJSONString(std::string & out, const char * str, size_t size);
+
+	// Quotes the field only if it contains a comma, a quote or a line break (RFC 4180).
+	static void AppendCSVField(std::string & out, const char * str, size_t size);
+};
+
+#endif /* !TAGDUMP_H_INCLUDED */
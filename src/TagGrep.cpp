@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TAGGREP_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "TagGrep.h"
+#include "SPCFile.h"
+#include "Stats.h"
+#include "cpath.h"
+
+#define ID666_HEADER_SIZE       0x100
+#define XID6_OFFSET             0x10200
+
+#define ALIGN32(x)  (((x) + 3) & ~3)
+
+struct GrepField {
+	const char * name;
+	int id666_offset;			// -1 if the field is only in xid6
+	int id666_binary_offset;	// offset in binary-format headers
+	int id666_size;
+	SPCFile::XID6ItemId xid6_id;
+};
+
+// The string tags of ImportPSFTag.
+static const GrepField FIELDS[] = {
+	{ "title", 0x2e, 0x2e, 32, SPCFile::XID6_SONG_NAME },
+	{ "game", 0x4e, 0x4e, 32, SPCFile::XID6_GAME_NAME },
+	{ "snsfby", 0x6e, 0x6e, 16, SPCFile::XID6_DUMPER_NAME },
+	{ "spcby", 0x6e, 0x6e, 16, SPCFile::XID6_DUMPER_NAME },
+	{ "comment", 0x7e, 0x7e, 32, SPCFile::XID6_COMMENT },
+	{ "artist", 0xb1, 0xb0, 32, SPCFile::XID6_ARTIST_NAME },
+	{ "soundtrack", -1, -1, 0, SPCFile::XID6_OST_TITLE },
+	{ "copyright", -1, -1, 0, SPCFile::XID6_PUBLISHER_NAME }
+};
+
+static inline char to_lower_ascii(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+static bool equals_case_insensitive(const char * text, const char * pattern, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		if (to_lower_ascii(text[i]) != pattern[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+TagGrep::TagGrep() :
+	field_index(-1)
+{
+}
+
+bool TagGrep::SetQuery(const std::string & field_name, const std::string & pattern)
+{
+	field_index = -1;
+	for (size_t i = 0; i < sizeof(FIELDS) / sizeof(FIELDS[0]); i++) {
+		if (field_name == FIELDS[i].name) {
+			field_index = (int)i;
+			break;
+		}
+	}
+
+	this->pattern.resize(pattern.size());
+	for (size_t i = 0; i < pattern.size(); i++) {
+		this->pattern[i] = to_lower_ascii(pattern[i]);
+	}
+	return field_index != -1;
+}
+
+bool TagGrep::MatchFile(const std::string & filename, bool & matched) const
+{
+	uint8_t header[ID666_HEADER_SIZE];
+
+	matched = false;
+
+	Stats::AddSyscalls(1);
+	off_t file_size = path_getfilesize(filename.c_str());
+	if (file_size == -1) {
+		return false;
+	}
+
+	Stats::AddSyscalls(2);
+	FILE * fp = fopen(filename.c_str(), "rb");
+	if (fp == NULL) {
+		return false;
+	}
+
+	if (fread(header, 1, ID666_HEADER_SIZE, fp) != ID666_HEADER_SIZE || !SPCFile::IsSPCHeader(header, file_size)) {
+		fclose(fp);
+		return false;
+	}
+	Stats::AddRead(ID666_HEADER_SIZE);
+
+	// the xid6 chunk, skipping the RAM and the DSP registers in between
+	std::vector<uint8_t> xid6;
+	if (file_size > XID6_OFFSET + 8) {
+		uint8_t chunk_header[8];
+
+		Stats::AddSyscalls(2);
+		if (fseek(fp, XID6_OFFSET, SEEK_SET) == 0 && fread(chunk_header, 1, 8, fp) == 8 && memcmp(chunk_header, "xid6", 4) == 0) {
+			size_t chunk_size = chunk_header[4] | (chunk_header[5] << 8) | (chunk_header[6] << 16) | ((uint32_t)chunk_header[7] << 24);
+			if (chunk_size > (size_t)file_size - (XID6_OFFSET + 8)) {
+				chunk_size = (size_t)file_size - (XID6_OFFSET + 8);
+			}
+
+			xid6.resize(chunk_size);
+			if (chunk_size != 0) {
+				xid6.resize(fread(&xid6[0], 1, chunk_size, fp));
+			}
+			Stats::AddRead(8 + xid6.size());
+		}
+	}
+	fclose(fp);
+
+	matched = MatchData(header, xid6.empty() ? NULL : &xid6[0], xid6.size());
+	return true;
+}
+
+bool TagGrep::MatchData(const uint8_t * header, const uint8_t * xid6, size_t xid6_size) const
+{
+	const char * value = NULL;
+	size_t value_size = 0;
+
+	if (field_index == -1) {
+		return false;
+	}
+	const GrepField * field = &FIELDS[field_index];
+
+	if (field->id666_offset >= 0 && header[0x23] == 0x1a) {
+		// same test for the binary layout as SPCFile::LoadFromMemory
+		int offset = (header[0xd2] < 0x30) ? field->id666_binary_offset : field->id666_offset;
+		value = (const char *)&header[offset];
+		value_size = strnlen(value, field->id666_size);
+	}
+
+	// a later item with the same id wins, as in SPCFile::Load
+	size_t offset = 0;
+	while (offset + 4 <= xid6_size) {
+		uint8_t id = xid6[offset];
+		uint8_t type = xid6[offset + 1];
+		size_t length = xid6[offset + 2] | (xid6[offset + 3] << 8);
+
+		offset += 4;
+		if (type == SPCFile::XID6_TYPE_LENGTH) {
+			continue;
+		}
+
+		if (id == field->xid6_id && offset + length <= xid6_size) {
+			value = (const char *)&xid6[offset];
+			value_size = strnlen(value, length);
+		}
+		offset += ALIGN32(length);
+	}
+
+	if (value == NULL) {
+		return false;
+	}
+	return FindCaseInsensitive(value, value_size, pattern.data(), pattern.size());
+}
+
+bool TagGrep::FindCaseInsensitive(const char * text, size_t text_size, const char * pattern, size_t pattern_size)
+{
+	if (pattern_size == 0) {
+		return true;
+	}
+	if (pattern_size > text_size) {
+		return false;
+	}
+
+	const size_t last = pattern_size - 1;
+	size_t i = 0;
+
+#ifdef TAGGREP_SSE2
+	// Compare 16 candidate positions at once against the first and the last character of the
+	// pattern, and only check the middle of the positions where both match.
+	const __m128i first_char = _mm_set1_epi8(pattern[0]);
+	const __m128i last_char = _mm_set1_epi8(pattern[last]);
+	const __m128i upper_min = _mm_set1_epi8('A' - 1);
+	const __m128i upper_max = _mm_set1_epi8('Z' + 1);
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+
+	for (; i + last + 16 <= text_size; i += 16) {
+		__m128i block_first = _mm_loadu_si128((const __m128i *)(text + i));
+		__m128i block_last = _mm_loadu_si128((const __m128i *)(text + i + last));
+
+		// bytes above 0x7f are negative and stay as they are
+		block_first = _mm_or_si128(block_first, _mm_and_si128(case_bit,
+			_mm_and_si128(_mm_cmpgt_epi8(block_first, upper_min), _mm_cmplt_epi8(block_first, upper_max))));
+		block_last = _mm_or_si128(block_last, _mm_and_si128(case_bit,
+			_mm_and_si128(_mm_cmpgt_epi8(block_last, upper_min), _mm_cmplt_epi8(block_last, upper_max))));
+
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(block_first, first_char), _mm_cmpeq_epi8(block_last, last_char)));
+		while (mask != 0) {
+			unsigned int bit = 0;
+			while ((mask & (1u << bit)) == 0) {
+				bit++;
+			}
+			if (equals_case_insensitive(text + i + bit + 1, pattern + 1, (pattern_size > 2) ? pattern_size - 2 : 0)) {
+				return true;
+			}
+			mask &= mask - 1;
+		}
+	}
+#endif
+
+	for (; i + last < text_size; i++) {
+		if (equals_case_insensitive(text + i, pattern, pattern_size)) {
+			return true;
+		}
+	}
+	return false;
+}
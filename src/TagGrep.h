@@ -0,0 +1,39 @@
+/**
+ * Substring search in one tag field, reading only the ID666 header and the xid6 block.
+ */
+
+#ifndef TAGGREP_H_INCLUDED
+#define TAGGREP_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+class TagGrep
+{
+public:
+	TagGrep();
+
+	// field is a string tag name as in ImportPSFTag (title, game, artist, ...).
+	// Returns false if it is not one of them.
+	bool SetQuery(const std::string & field, const std::string & pattern);
+
+	// Sets matched if the field contains the pattern, ignoring ASCII case.
+	// Returns false if the file cannot be read or is not an SPC file.
+	bool MatchFile(const std::string & filename, bool & matched) const;
+
+	// Matches a file given its 0x100-byte header and the contents of its xid6 chunk.
+	// As in SPCFile::Load, an xid6 item takes the place of the ID666 field.
+	bool MatchData(const uint8_t * header, const uint8_t * xid6, size_t xid6_size) const;
+
+	// Case-insensitive (ASCII) search for a lowercase pattern, SSE2 when available.
+	static bool FindCaseInsensitive(const char * text, size_t text_size, const char * pattern, size_t pattern_size);
+
+private:
+	int field_index;			// -1 if no query is set
+	std::string pattern;	// lowercase
+};
+
+#endif /* !TAGGREP_H_INCLUDED */
@@ -0,0 +1,625 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "TagIndex.h"
+#include "TagGrep.h"
+
+// Layout (all numbers little-endian):
+//   header       magic, file/string/trigram counts, then the offsets of the sections below
+//   strings      u32 offsets[num_strings + 1] into the string data; string 0 is empty
+//   paths        u32 offsets[num_files + 1] into the path data
+//   file fields  u32 string ids[num_files][FIELD_COUNT]
+//   trigrams     { u32 trigram, u32 postings offset, u32 count }[num_trigrams], sorted by trigram
+//   string files u32 postings offsets[num_strings + 1]: the files each string appears in
+//   postings     varint-encoded ascending ids, each stored as the difference from the previous one
+static const char TAGINDEX_MAGIC[8] = { 'S', 'P', 'C', 'T', 'R', 'I', 'X', 0x01 };
+
+enum {
+	SECTION_STRING_OFFSETS = 0,
+	SECTION_STRING_DATA,
+	SECTION_PATH_OFFSETS,
+	SECTION_PATH_DATA,
+	SECTION_FILE_FIELDS,
+	SECTION_TRIGRAMS,
+	SECTION_STRING_FILES,
+	SECTION_POSTINGS,
+	SECTION_COUNT
+};
+
+static const size_t TAGINDEX_HEADER_SIZE = 24 + 8 * (SECTION_COUNT + 1);
+static const size_t TRIGRAM_ENTRY_SIZE = 12;
+
+static const char * const FIELD_NAMES[TagIndex::FIELD_COUNT] = {
+	"title", "game", "artist", "comment", "soundtrack", "copyright"
+};
+
+static const SPCFile::XID6ItemId FIELD_TAGS[TagIndex::FIELD_COUNT] = {
+	SPCFile::XID6_SONG_NAME,
+	SPCFile::XID6_GAME_NAME,
+	SPCFile::XID6_ARTIST_NAME,
+	SPCFile::XID6_COMMENT,
+	SPCFile::XID6_OST_TITLE,
+	SPCFile::XID6_PUBLISHER_NAME
+};
+
+static inline uint32_t get32(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t get64(const uint8_t * p)
+{
+	return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+static void put32(std::vector<uint8_t> & out, uint32_t value)
+{
+	out.push_back(value & 0xff);
+	out.push_back((value >> 8) & 0xff);
+	out.push_back((value >> 16) & 0xff);
+	out.push_back((value >> 24) & 0xff);
+}
+
+static void put64(std::vector<uint8_t> & out, uint64_t value)
+{
+	put32(out, (uint32_t)value);
+	put32(out, (uint32_t)(value >> 32));
+}
+
+static void put_posting_list(std::vector<uint8_t> & out, const std::vector<uint32_t> & ids)
+{
+	uint32_t previous = 0;
+	for (auto itr = ids.begin(); itr != ids.end(); ++itr) {
+		uint32_t delta = *itr - previous;
+		previous = *itr;
+
+		while (delta >= 0x80) {
+			out.push_back((uint8_t)(delta | 0x80));
+			delta >>= 7;
+		}
+		out.push_back((uint8_t)delta);
+	}
+}
+
+// Decodes count ids starting at offset; stops early at the end of the postings.
+static void get_posting_list(const uint8_t * postings, size_t postings_size, uint32_t offset, uint32_t count, std::vector<uint32_t> & ids)
+{
+	ids.clear();
+	ids.reserve(count);
+
+	uint32_t id = 0;
+	size_t pos = offset;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t delta = 0;
+		int shift = 0;
+		for (;;) {
+			if (pos >= postings_size || shift > 28) {
+				return;
+			}
+			uint8_t byte = postings[pos++];
+			delta |= (uint32_t)(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0) {
+				break;
+			}
+			shift += 7;
+		}
+
+		id += delta;
+		ids.push_back(id);
+	}
+}
+
+static std::string to_lower_ascii(const char * str, size_t size)
+{
+	std::string lower(str, size);
+	for (size_t i = 0; i < size; i++) {
+		if (lower[i] >= 'A' && lower[i] <= 'Z') {
+			lower[i] += 'a' - 'A';
+		}
+	}
+	return lower;
+}
+
+// Distinct trigrams of a lowercase string, sorted.
+static void get_trigrams(const std::string & lower, std::vector<uint32_t> & trigrams)
+{
+	trigrams.clear();
+	for (size_t i = 0; i + 3 <= lower.size(); i++) {
+		trigrams.push_back(((uint8_t)lower[i] << 16) | ((uint8_t)lower[i + 1] << 8) | (uint8_t)lower[i + 2]);
+	}
+	std::sort(trigrams.begin(), trigrams.end());
+	trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+bool TagIndex::ParseField(const std::string & name, Field & field)
+{
+	for (int i = 0; i < FIELD_COUNT; i++) {
+		if (name == FIELD_NAMES[i]) {
+			field = (Field)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TagIndex::GetFields(const SPCFile & spc, std::string values[FIELD_COUNT])
+{
+	for (int i = 0; i < FIELD_COUNT; i++) {
+		values[i] = spc.GetStringTag(FIELD_TAGS[i]);
+	}
+}
+
+TagIndex::Builder::Builder()
+{
+	AddString("");
+}
+
+uint32_t TagIndex::Builder::AddString(const std::string & str)
+{
+	auto itr = string_ids.find(str);
+	if (itr != string_ids.end()) {
+		return itr->second;
+	}
+
+	uint32_t id = (uint32_t)strings.size();
+	strings.push_back(str);
+	string_ids[str] = id;
+	return id;
+}
+
+void TagIndex::Builder::Add(const std::string & filename, const std::string values[FIELD_COUNT])
+{
+	filenames.push_back(filename);
+	for (int i = 0; i < FIELD_COUNT; i++) {
+		file_fields.push_back(AddString(values[i]));
+	}
+}
+
+bool TagIndex::Builder::Write(const std::string & filename) const
+{
+	std::vector<uint8_t> sections[SECTION_COUNT];
+
+	// strings and paths
+	std::vector<uint8_t> & string_offsets = sections[SECTION_STRING_OFFSETS];
+	std::vector<uint8_t> & string_data = sections[SECTION_STRING_DATA];
+	for (auto itr = strings.begin(); itr != strings.end(); ++itr) {
+		put32(string_offsets, (uint32_t)string_data.size());
+		string_data.insert(string_data.end(), itr->begin(), itr->end());
+	}
+	put32(string_offsets, (uint32_t)string_data.size());
+
+	std::vector<uint8_t> & path_offsets = sections[SECTION_PATH_OFFSETS];
+	std::vector<uint8_t> & path_data = sections[SECTION_PATH_DATA];
+	for (auto itr = filenames.begin(); itr != filenames.end(); ++itr) {
+		put32(path_offsets, (uint32_t)path_data.size());
+		path_data.insert(path_data.end(), itr->begin(), itr->end());
+	}
+	put32(path_offsets, (uint32_t)path_data.size());
+
+	for (auto itr = file_fields.begin(); itr != file_fields.end(); ++itr) {
+		put32(sections[SECTION_FILE_FIELDS], *itr);
+	}
+
+	// trigram -> strings, as (trigram, string) pairs sorted by trigram
+	std::vector<std::pair<uint32_t, uint32_t> > pairs;
+	std::vector<uint32_t> trigrams;
+	for (uint32_t id = 1; id < strings.size(); id++) {
+		get_trigrams(to_lower_ascii(strings[id].data(), strings[id].size()), trigrams);
+		for (auto itr = trigrams.begin(); itr != trigrams.end(); ++itr) {
+			pairs.push_back(std::make_pair(*itr, id));
+		}
+	}
+	std::sort(pairs.begin(), pairs.end());
+
+	std::vector<uint8_t> & postings = sections[SECTION_POSTINGS];
+	std::vector<uint32_t> ids;
+	for (size_t i = 0; i < pairs.size(); ) {
+		uint32_t trigram = pairs[i].first;
+		ids.clear();
+		for (; i < pairs.size() && pairs[i].first == trigram; i++) {
+			ids.push_back(pairs[i].second);
+		}
+
+		put32(sections[SECTION_TRIGRAMS], trigram);
+		put32(sections[SECTION_TRIGRAMS], (uint32_t)postings.size());
+		put32(sections[SECTION_TRIGRAMS], (uint32_t)ids.size());
+		put_posting_list(postings, ids);
+	}
+	uint32_t num_trigrams = (uint32_t)(sections[SECTION_TRIGRAMS].size() / TRIGRAM_ENTRY_SIZE);
+
+	// string -> files
+	std::vector<std::vector<uint32_t> > files_of_string(strings.size());
+	for (uint32_t file = 0; file < filenames.size(); file++) {
+		for (int i = 0; i < FIELD_COUNT; i++) {
+			uint32_t id = file_fields[file * FIELD_COUNT + i];
+			if (id != 0 && (files_of_string[id].empty() || files_of_string[id].back() != file)) {
+				files_of_string[id].push_back(file);
+			}
+		}
+	}
+	for (uint32_t id = 0; id < strings.size(); id++) {
+		put32(sections[SECTION_STRING_FILES], (uint32_t)postings.size());
+		put_posting_list(postings, files_of_string[id]);
+	}
+	put32(sections[SECTION_STRING_FILES], (uint32_t)postings.size());
+
+	// 32-bit offsets limit each section to 4 GB
+	for (int i = 0; i < SECTION_COUNT; i++) {
+		if (sections[i].size() > UINT32_MAX) {
+			fprintf(stderr, "Error: Index too large\n");
+			return false;
+		}
+	}
+
+	std::vector<uint8_t> header(TAGINDEX_MAGIC, TAGINDEX_MAGIC + sizeof(TAGINDEX_MAGIC));
+	put32(header, (uint32_t)filenames.size());
+	put32(header, (uint32_t)strings.size());
+	put32(header, num_trigrams);
+	put32(header, 0);
+
+	uint64_t offset = TAGINDEX_HEADER_SIZE;
+	for (int i = 0; i < SECTION_COUNT; i++) {
+		put64(header, offset);
+		offset += sections[i].size();
+	}
+	put64(header, offset);
+
+	FILE * fp = fopen(filename.c_str(), "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Unable to open \"%s\"\n", filename.c_str());
+		return false;
+	}
+
+	bool no_error = fwrite(&header[0], 1, header.size(), fp) == header.size();
+	for (int i = 0; i < SECTION_COUNT && no_error; i++) {
+		if (!sections[i].empty()) {
+			no_error = fwrite(&sections[i][0], 1, sections[i].size(), fp) == sections[i].size();
+		}
+	}
+
+	if (fclose(fp) != 0) {
+		no_error = false;
+	}
+
+	if (!no_error) {
+		fprintf(stderr, "Error: Unable to write \"%s\"\n", filename.c_str());
+	}
+	return no_error;
+}
+
+TagIndex::TagIndex() :
+	data(NULL),
+	size(0),
+	mapped(false),
+	num_files(0),
+	num_strings(0),
+	num_trigrams(0)
+{
+}
+
+TagIndex::~TagIndex()
+{
+	Close();
+}
+
+void TagIndex::Close()
+{
+	if (data != NULL) {
+		if (mapped) {
+#ifdef _WIN32
+			UnmapViewOfFile(data);
+#else
+			munmap((void *)data, size);
+#endif
+		}
+		else {
+			delete[] data;
+		}
+	}
+
+	data = NULL;
+	size = 0;
+	mapped = false;
+	num_files = 0;
+	num_strings = 0;
+	num_trigrams = 0;
+}
+
+bool TagIndex::Open(const std::string & filename)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Error: Unable to open \"%s\"\n", filename.c_str());
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	HANDLE file_mapping = NULL;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)TAGINDEX_HEADER_SIZE) {
+		file_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	if (file_mapping != NULL) {
+		data = (const uint8_t *)MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+		size = (size_t)file_size.QuadPart;
+		CloseHandle(file_mapping);
+	}
+	CloseHandle(file);
+#else
+	int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		fprintf(stderr, "Error: Unable to open \"%s\"\n", filename.c_str());
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)TAGINDEX_HEADER_SIZE) {
+		void * p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			data = (const uint8_t *)p;
+			size = (size_t)st.st_size;
+		}
+	}
+	close(fd);
+#endif
+
+	if (data == NULL) {
+		fprintf(stderr, "Error: Unable to read \"%s\"\n", filename.c_str());
+		return false;
+	}
+	mapped = true;
+
+	// only the header is checked here; offsets inside the sections are checked when used
+	uint64_t offsets[SECTION_COUNT + 1];
+	bool valid = memcmp(data, TAGINDEX_MAGIC, sizeof(TAGINDEX_MAGIC)) == 0;
+	for (int i = 0; i <= SECTION_COUNT && valid; i++) {
+		offsets[i] = get64(data + 24 + 8 * i);
+		valid = offsets[i] >= ((i == 0) ? TAGINDEX_HEADER_SIZE : offsets[i - 1]) && offsets[i] <= size;
+	}
+
+	if (valid) {
+		num_files = get32(data + 8);
+		num_strings = get32(data + 12);
+		num_trigrams = get32(data + 16);
+
+		valid = num_strings >= 1 &&
+			offsets[SECTION_STRING_OFFSETS + 1] - offsets[SECTION_STRING_OFFSETS] == ((uint64_t)num_strings + 1) * 4 &&
+			offsets[SECTION_PATH_OFFSETS + 1] - offsets[SECTION_PATH_OFFSETS] == ((uint64_t)num_files + 1) * 4 &&
+			offsets[SECTION_FILE_FIELDS + 1] - offsets[SECTION_FILE_FIELDS] == (uint64_t)num_files * FIELD_COUNT * 4 &&
+			offsets[SECTION_TRIGRAMS + 1] - offsets[SECTION_TRIGRAMS] == (uint64_t)num_trigrams * TRIGRAM_ENTRY_SIZE &&
+			offsets[SECTION_STRING_FILES + 1] - offsets[SECTION_STRING_FILES] == ((uint64_t)num_strings + 1) * 4;
+	}
+
+	if (!valid) {
+		fprintf(stderr, "Error: \"%s\" is not a tag index\n", filename.c_str());
+		Close();
+		return false;
+	}
+
+	string_offsets = data + offsets[SECTION_STRING_OFFSETS];
+	string_data = data + offsets[SECTION_STRING_DATA];
+	string_data_size = offsets[SECTION_STRING_DATA + 1] - offsets[SECTION_STRING_DATA];
+	path_offsets = data + offsets[SECTION_PATH_OFFSETS];
+	path_data = data + offsets[SECTION_PATH_DATA];
+	path_data_size = offsets[SECTION_PATH_DATA + 1] - offsets[SECTION_PATH_DATA];
+	file_fields = data + offsets[SECTION_FILE_FIELDS];
+	trigrams = data + offsets[SECTION_TRIGRAMS];
+	string_files = data + offsets[SECTION_STRING_FILES];
+	postings = data + offsets[SECTION_POSTINGS];
+	postings_size = offsets[SECTION_POSTINGS + 1] - offsets[SECTION_POSTINGS];
+	return true;
+}
+
+std::string TagIndex::GetFilename(uint32_t file) const
+{
+	if (file >= num_files) {
+		return "";
+	}
+
+	uint32_t start = get32(path_offsets + file * 4);
+	uint32_t end = get32(path_offsets + file * 4 + 4);
+	if (start > end || end > path_data_size) {
+		return "";
+	}
+	return std::string((const char *)path_data + start, end - start);
+}
+
+void TagIndex::GetString(uint32_t id, const char *& str, size_t & str_size) const
+{
+	uint32_t start = get32(string_offsets + id * 4);
+	uint32_t end = get32(string_offsets + id * 4 + 4);
+	if (start > end || end > string_data_size) {
+		start = end = 0;
+	}
+
+	str = (const char *)string_data + start;
+	str_size = end - start;
+}
+
+bool TagIndex::FindTrigram(uint32_t trigram, uint32_t & offset, uint32_t & count) const
+{
+	uint32_t low = 0;
+	uint32_t high = num_trigrams;
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		const uint8_t * entry = trigrams + (size_t)mid * TRIGRAM_ENTRY_SIZE;
+		uint32_t key = get32(entry);
+		if (key == trigram) {
+			offset = get32(entry + 4);
+			count = get32(entry + 8);
+			return true;
+		}
+		else if (key < trigram) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	return false;
+}
+
+void TagIndex::AddFilesOfString(uint32_t id, Field field, std::vector<uint32_t> & files) const
+{
+	std::vector<uint32_t> ids;
+	uint32_t start = get32(string_files + id * 4);
+	uint32_t end = get32(string_files + id * 4 + 4);
+	if (start > end) {
+		return;
+	}
+
+	// the list ends where the next one starts; each id takes at least one byte
+	get_posting_list(postings, std::min<size_t>(end, postings_size), start, end - start, ids);
+	for (auto itr = ids.begin(); itr != ids.end(); ++itr) {
+		if (*itr >= num_files) {
+			break;
+		}
+		if (field == FIELD_ANY || get32(file_fields + ((size_t)*itr * FIELD_COUNT + field) * 4) == id) {
+			files.push_back(*itr);
+		}
+	}
+}
+
+void TagIndex::Search(const std::string & pattern, Field field, std::vector<uint32_t> & files) const
+{
+	files.clear();
+	if (data == NULL) {
+		return;
+	}
+
+	std::string lower = to_lower_ascii(pattern.data(), pattern.size());
+	std::vector<uint32_t> pattern_trigrams;
+	get_trigrams(lower, pattern_trigrams);
+
+	// strings that have every trigram of the pattern, starting from the rarest trigram
+	std::vector<uint32_t> candidates;
+	if (pattern_trigrams.empty()) {
+		for (uint32_t id = 1; id < num_strings; id++) {
+			candidates.push_back(id);
+		}
+	}
+	else {
+		std::vector<std::pair<uint32_t, uint32_t> > lists;
+		for (auto itr = pattern_trigrams.begin(); itr != pattern_trigrams.end(); ++itr) {
+			uint32_t offset;
+			uint32_t count;
+			if (!FindTrigram(*itr, offset, count)) {
+				return;
+			}
+			lists.push_back(std::make_pair(count, offset));
+		}
+		std::sort(lists.begin(), lists.end());
+
+		std::vector<uint32_t> ids;
+		std::vector<uint32_t> intersection;
+		get_posting_list(postings, postings_size, lists[0].second, lists[0].first, candidates);
+		for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+			get_posting_list(postings, postings_size, lists[i].second, lists[i].first, ids);
+			intersection.clear();
+			std::set_intersection(candidates.begin(), candidates.end(), ids.begin(), ids.end(), std::back_inserter(intersection));
+			candidates.swap(intersection);
+		}
+	}
+
+	// trigrams can match out of order, so check the actual strings
+	for (auto itr = candidates.begin(); itr != candidates.end(); ++itr) {
+		if (*itr >= num_strings) {
+			break;
+		}
+
+		const char * str;
+		size_t str_size;
+		GetString(*itr, str, str_size);
+		if (TagGrep::FindCaseInsensitive(str, str_size, lower.data(), lower.size())) {
+			AddFilesOfString(*itr, field, files);
+		}
+	}
+
+	std::sort(files.begin(), files.end());
+	files.erase(std::unique(files.begin(), files.end()), files.end());
+}
+
+void TagIndex::SearchFuzzy(const std::string & pattern, Field field, double threshold, std::vector<std::pair<uint32_t, double> > & files) const
+{
+	files.clear();
+	if (data == NULL) {
+		return;
+	}
+
+	std::string lower = to_lower_ascii(pattern.data(), pattern.size());
+	std::vector<uint32_t> pattern_trigrams;
+	get_trigrams(lower, pattern_trigrams);
+
+	if (pattern_trigrams.empty()) {
+		// too short to have trigrams; only exact substrings can be found
+		std::vector<uint32_t> exact;
+		Search(pattern, field, exact);
+		for (auto itr = exact.begin(); itr != exact.end(); ++itr) {
+			files.push_back(std::make_pair(*itr, 1.0));
+		}
+		return;
+	}
+
+	// count the trigrams of the pattern each string has
+	std::vector<uint16_t> counts(num_strings, 0);
+	std::vector<uint32_t> found_strings;
+	std::vector<uint32_t> ids;
+	for (auto itr = pattern_trigrams.begin(); itr != pattern_trigrams.end(); ++itr) {
+		uint32_t offset;
+		uint32_t count;
+		if (FindTrigram(*itr, offset, count)) {
+			get_posting_list(postings, postings_size, offset, count, ids);
+			for (auto id_itr = ids.begin(); id_itr != ids.end(); ++id_itr) {
+				if (*id_itr < num_strings && counts[*id_itr]++ == 0) {
+					found_strings.push_back(*id_itr);
+				}
+			}
+		}
+	}
+
+	// a file scores as its best matching string
+	std::vector<double> scores(num_files, 0.0);
+	std::vector<uint32_t> found_files;
+	std::vector<uint32_t> files_of_string;
+	for (auto itr = found_strings.begin(); itr != found_strings.end(); ++itr) {
+		double score = (double)counts[*itr] / pattern_trigrams.size();
+		if (score < threshold) {
+			continue;
+		}
+
+		files_of_string.clear();
+		AddFilesOfString(*itr, field, files_of_string);
+		for (auto file_itr = files_of_string.begin(); file_itr != files_of_string.end(); ++file_itr) {
+			if (scores[*file_itr] == 0.0) {
+				found_files.push_back(*file_itr);
+			}
+			scores[*file_itr] = std::max(scores[*file_itr], score);
+		}
+	}
+
+	for (auto itr = found_files.begin(); itr != found_files.end(); ++itr) {
+		files.push_back(std::make_pair(*itr, scores[*itr]));
+	}
+	std::sort(files.begin(), files.end(), [](const std::pair<uint32_t, double> & a, const std::pair<uint32_t, double> & b) {
+		return (a.second != b.second) ? (a.second > b.second) : (a.first < b.first);
+	});
+}
@@ -0,0 +1,119 @@
+/**
+ * Trigram index over the string tags of a collection, for substring and fuzzy search.
+ *
+ * Every distinct tag string is stored once (so a game or artist shared by thousands
+ * of files costs one entry), and the trigram posting lists point at strings rather
+ * than files. Posting lists are delta- and varint-encoded. The file is read through
+ * a memory mapping, so opening it does not parse anything.
+ */
+
+#ifndef TAGINDEX_H_INCLUDED
+#define TAGINDEX_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+#include "SPCFile.h"
+
+class TagIndex
+{
+public:
+	enum Field {
+		FIELD_TITLE = 0,
+		FIELD_GAME,
+		FIELD_ARTIST,
+		FIELD_COMMENT,
+		FIELD_SOUNDTRACK,
+		FIELD_COPYRIGHT,
+		FIELD_COUNT,
+		FIELD_ANY = FIELD_COUNT
+	};
+
+	// "title", "game", "artist", "comment", "soundtrack" or "copyright". Returns false if unknown.
+	static bool ParseField(const std::string & name, Field & field);
+
+	// The values that are indexed, in Field order.
+	static void GetFields(const SPCFile & spc, std::string values[FIELD_COUNT]);
+
+	class Builder
+	{
+	public:
+		Builder();
+
+		void Add(const std::string & filename, const std::string values[FIELD_COUNT]);
+
+		size_t GetFileCount() const
+		{
+			return filenames.size();
+		}
+
+		size_t GetStringCount() const
+		{
+			return strings.size();
+		}
+
+		bool Write(const std::string & filename) const;
+
+	private:
+		uint32_t AddString(const std::string & str);
+
+		std::vector<std::string> filenames;
+		std::vector<uint32_t> file_fields;				// FIELD_COUNT string ids per file
+		std::vector<std::string> strings;				// id 0 is the empty string
+		std::map<std::string, uint32_t> string_ids;
+	};
+
+	TagIndex();
+	virtual ~TagIndex();
+
+	bool Open(const std::string & filename);
+	void Close();
+
+	size_t GetFileCount() const
+	{
+		return num_files;
+	}
+
+	std::string GetFilename(uint32_t file) const;
+
+	// Files whose field (or any field) contains pattern, ignoring ASCII case, in index order.
+	void Search(const std::string & pattern, Field field, std::vector<uint32_t> & files) const;
+
+	// Files with a value sharing at least the given fraction of the trigrams of pattern,
+	// best match first, as (file, score) pairs.
+	void SearchFuzzy(const std::string & pattern, Field field, double threshold, std::vector<std::pair<uint32_t, double> > & files) const;
+
+private:
+	TagIndex(const TagIndex&);
+	TagIndex& operator=(const TagIndex&);
+
+	void GetString(uint32_t id, const char *& str, size_t & size) const;
+	bool FindTrigram(uint32_t trigram, uint32_t & offset, uint32_t & count) const;
+	void AddFilesOfString(uint32_t id, Field field, std::vector<uint32_t> & files) const;
+
+	const uint8_t * data;
+	size_t size;
+	bool mapped;			// else data was read into memory
+
+	uint32_t num_files;
+	uint32_t num_strings;
+	uint32_t num_trigrams;
+	const uint8_t * string_offsets;
+	const uint8_t * string_data;
+	size_t string_data_size;
+	const uint8_t * path_offsets;
+	const uint8_t * path_data;
+	size_t path_data_size;
+	const uint8_t * file_fields;
+	const uint8_t * trigrams;
+	const uint8_t * string_files;
+	const uint8_t * postings;
+	size_t postings_size;
+};
+
+#endif /* !TAGINDEX_H_INCLUDED */
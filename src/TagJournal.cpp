@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/locking.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#endif
+
+#include "TagJournal.h"
+#include "TagLine.h"
+#include "cpath.h"
+
+TagJournal::TagJournal(const std::string & filename) :
+	filename(filename),
+	append_fp(NULL),
+	lock_fd(-1)
+{
+}
+
+TagJournal::~TagJournal()
+{
+	Close();
+}
+
+std::string TagJournal::GetKey(const std::string & spc_filename)
+{
+	char absolute_path[PATH_MAX];
+	if (path_getabspath(spc_filename.c_str(), absolute_path) == NULL) {
+		return spc_filename;
+	}
+	return absolute_path;
+}
+
+void TagJournal::AppendLine(std::string & out, const std::string & key, const std::map<std::string, std::string> & psf_tags)
+{
+	TagLine::AppendEscaped(out, key);
+	TagLine::AppendTags(out, psf_tags);
+	out += '\n';
+}
+
+bool TagJournal::Lock()
+{
+	if (lock_fd != -1) {
+		return true;
+	}
+
+	// the journal itself is replaced by Rewrite, so the lock lives in a file of its own
+	std::string lock_filename = filename + ".lock";
+#ifdef _WIN32
+	int fd = _open(lock_filename.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+	// _locking gives up after 10 attempts, one second apart
+	if (fd != -1 && _locking(fd, _LK_LOCK, 1) != 0) {
+		_close(fd);
+		fd = -1;
+	}
+#else
+	int fd = open(lock_filename.c_str(), O_RDWR | O_CREAT, 0666);
+	if (fd != -1 && flock(fd, LOCK_EX) != 0) {
+		close(fd);
+		fd = -1;
+	}
+#endif
+	if (fd == -1) {
+		fprintf(stderr, "Error: Unable to lock journal \"%s\"\n", filename.c_str());
+		return false;
+	}
+
+	lock_fd = fd;
+	return true;
+}
+
+void TagJournal::Unlock()
+{
+	if (lock_fd == -1) {
+		return;
+	}
+
+#ifdef _WIN32
+	_locking(lock_fd, _LK_UNLCK, 1);
+	_close(lock_fd);
+#else
+	// closing the descriptor releases the lock
+	close(lock_fd);
+#endif
+	lock_fd = -1;
+}
+
+bool TagJournal::Read(std::string & content)
+{
+	FILE * fp = fopen(filename.c_str(), "rb");
+	if (fp == NULL) {
+		// nothing journaled yet
+		return !path_isdir(filename.c_str()) && path_getfilesize(filename.c_str()) == -1;
+	}
+
+	char buffer[0x10000];
+	size_t read_size;
+	while ((read_size = fread(buffer, 1, sizeof(buffer), fp)) != 0) {
+		content.append(buffer, read_size);
+	}
+
+	bool no_error = ferror(fp) == 0;
+	fclose(fp);
+	if (!no_error) {
+		fprintf(stderr, "Error: Unable to read journal \"%s\"\n", filename.c_str());
+	}
+	return no_error;
+}
+
+bool TagJournal::Load()
+{
+	edits.clear();
+
+	// an append in progress elsewhere is not read half-written
+	bool was_locked = lock_fd != -1;
+	if (!Lock()) {
+		return false;
+	}
+
+	std::string content;
+	bool no_error = Read(content);
+	if (!was_locked) {
+		Unlock();
+	}
+	if (!no_error) {
+		return false;
+	}
+
+	size_t line_start = 0;
+	size_t line_number = 1;
+	for (size_t line_end; (line_end = content.find('\n', line_start)) != std::string::npos; line_start = line_end + 1, line_number++) {
+		std::vector<std::string> fields = TagLine::Split(&content[line_start], line_end - line_start);
+
+		std::map<std::string, std::string> psf_tags;
+		bool valid = fields.size() >= 2 && !fields[0].empty() && TagLine::ParseTags(fields, 1, psf_tags);
+
+		if (!valid) {
+			fprintf(stderr, "Warning: Ignoring malformed journal line %lu\n", (unsigned long)line_number);
+			continue;
+		}
+		edits[fields[0]].push_back(psf_tags);
+	}
+
+	// a write interrupted before its newline is not an edit
+	if (line_start != content.size()) {
+		fprintf(stderr, "Warning: Ignoring incomplete journal line %lu\n", (unsigned long)line_number);
+	}
+	return true;
+}
+
+bool TagJournal::Append(const std::string & spc_filename, const std::map<std::string, std::string> & psf_tags)
+{
+	return Append(spc_filename, std::string(), psf_tags);
+}
+
+bool TagJournal::Append(const std::string & spc_filename, const std::string & tag_fields, const std::map<std::string, std::string> & psf_tags)
+{
+	if (append_fp == NULL) {
+		if (!Lock()) {
+			return false;
+		}
+
+		append_fp = fopen(filename.c_str(), "ab");
+		if (append_fp == NULL) {
+			fprintf(stderr, "Error: Unable to open journal \"%s\"\n", filename.c_str());
+			return false;
+		}
+	}
+
+	// one write per line, so an interrupted run leaves at most one incomplete line
+	// (the last field of a name wins when the line is read back)
+	append_line.clear();
+	TagLine::AppendEscaped(append_line, GetKey(spc_filename));
+	append_line += tag_fields;
+	TagLine::AppendTags(append_line, psf_tags);
+	append_line += '\n';
+	return fwrite(append_line.data(), 1, append_line.size(), append_fp) == append_line.size();
+}
+
+bool TagJournal::Close()
+{
+	bool no_error = true;
+	if (append_fp != NULL) {
+		no_error = fclose(append_fp) == 0;
+		append_fp = NULL;
+	}
+
+	Unlock();
+	return no_error;
+}
+
+bool TagJournal::HasEdits(const std::string & spc_filename) const
+{
+	return !edits.empty() && edits.count(GetKey(spc_filename)) != 0;
+}
+
+bool TagJournal::Apply(const std::string & spc_filename, SPCFile & spc) const
+{
+	if (edits.empty()) {
+		return true;
+	}
+
+	auto itr = edits.find(GetKey(spc_filename));
+	if (itr == edits.end()) {
+		return true;
+	}
+
+	bool no_error = true;
+	for (auto edit_itr = itr->second.begin(); edit_itr != itr->second.end(); ++edit_itr) {
+		if (!spc.ImportPSFTag(*edit_itr)) {
+			no_error = false;
+		}
+	}
+	return no_error;
+}
+
+std::vector<std::string> TagJournal::GetFilenames() const
+{
+	std::vector<std::string> filenames;
+	for (auto itr = edits.begin(); itr != edits.end(); ++itr) {
+		filenames.push_back(itr->first);
+	}
+	return filenames;
+}
+
+bool TagJournal::Rewrite(const std::vector<std::string> & keep_filenames)
+{
+	// the lock, if held, is kept until the journal is replaced
+	if (append_fp != NULL) {
+		fclose(append_fp);
+		append_fp = NULL;
+	}
+
+	if (!Lock()) {
+		return false;
+	}
+
+	bool no_error = WriteEdits(keep_filenames);
+	Unlock();
+	return no_error;
+}
+
+bool TagJournal::WriteEdits(const std::vector<std::string> & keep_filenames)
+{
+	std::string content;
+	for (auto itr = keep_filenames.begin(); itr != keep_filenames.end(); ++itr) {
+		auto edit_itr = edits.find(*itr);
+		if (edit_itr == edits.end()) {
+			continue;
+		}
+
+		for (auto tags_itr = edit_itr->second.begin(); tags_itr != edit_itr->second.end(); ++tags_itr) {
+			AppendLine(content, edit_itr->first, *tags_itr);
+		}
+	}
+
+	if (content.empty()) {
+		if (remove(filename.c_str()) != 0 && path_getfilesize(filename.c_str()) != -1) {
+			fprintf(stderr, "Error: Unable to remove journal \"%s\"\n", filename.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// replace the journal as a whole, so it is never left half-written
+	std::string temp_filename = filename + ".tmp";
+	FILE * fp = fopen(temp_filename.c_str(), "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Unable to open \"%s\"\n", temp_filename.c_str());
+		return false;
+	}
+
+	bool no_error = fwrite(content.data(), 1, content.size(), fp) == content.size();
+	if (fclose(fp) != 0) {
+		no_error = false;
+	}
+
+	if (!no_error || !path_replacefile(temp_filename.c_str(), filename.c_str())) {
+		fprintf(stderr, "Error: Unable to write journal \"%s\"\n", filename.c_str());
+		remove(temp_filename.c_str());
+		return false;
+	}
+	return true;
+}
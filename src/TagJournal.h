@@ -0,0 +1,85 @@
+/**
+ * Append-only journal of tag edits, kept beside a collection instead of rewriting each file.
+ *
+ * Each line is one edit of one file: the absolute path and the PSF-style name=value pairs,
+ * separated by tabs (tabs, newlines and backslashes escaped as \t, \n and \\, as in spcpointd).
+ * Readers replay the edits of a file over its own tags in the order they were made.
+ *
+ * Access is serialized through an exclusive lock on a "<journal>.lock" file beside it.
+ */
+
+#ifndef TAGJOURNAL_H_INCLUDED
+#define TAGJOURNAL_H_INCLUDED
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "SPCFile.h"
+
+class TagJournal
+{
+public:
+	explicit TagJournal(const std::string & filename);
+	virtual ~TagJournal();
+
+	const std::string & GetFilename() const
+	{
+		return filename;
+	}
+
+	// Waits for the journal lock and holds it until Close or Rewrite, so that nothing can be
+	// appended between Load and Rewrite. Load, Append and Rewrite take the lock themselves.
+	bool Lock();
+
+	// Reads the pending edits. A journal that does not exist yet is empty.
+	bool Load();
+
+	// Appends an edit to the journal file (the loaded edits are not updated).
+	// The lock is held from the first append until Close.
+	bool Append(const std::string & spc_filename, const std::map<std::string, std::string> & psf_tags);
+
+	// Same, with tags shared by many files formatted once by TagLine::AppendTags.
+	// psf_tags follow them, and a name given in both takes its value from psf_tags.
+	bool Append(const std::string & spc_filename, const std::string & tag_fields, const std::map<std::string, std::string> & psf_tags);
+
+	// Flushes and closes the journal file after appending, and releases the lock.
+	bool Close();
+
+	bool HasEdits(const std::string & spc_filename) const;
+
+	// Replays the pending edits of the file over its tags. Returns false if an edit is malformed.
+	bool Apply(const std::string & spc_filename, SPCFile & spc) const;
+
+	// Absolute paths of the edited files, sorted.
+	std::vector<std::string> GetFilenames() const;
+
+	// Replaces the journal with the edits of the given files only, or removes it if there are none.
+	// Edits appended since Load are lost unless the lock was taken before Load.
+	bool Rewrite(const std::vector<std::string> & keep_filenames);
+
+	// Journal entries are keyed by absolute path.
+	static std::string GetKey(const std::string & spc_filename);
+
+private:
+	TagJournal(const TagJournal&);
+	TagJournal& operator=(const TagJournal&);
+
+	typedef std::vector<std::map<std::string, std::string> > EditList;
+
+	static void AppendLine(std::string & out, const std::string & key, const std::map<std::string, std::string> & psf_tags);
+
+	bool Read(std::string & content);
+	bool WriteEdits(const std::vector<std::string> & keep_filenames);
+	void Unlock();
+
+	std::string filename;
+	std::map<std::string, EditList> edits;
+	FILE * append_fp;
+	std::string append_line;
+	int lock_fd;			// -1 if not locked
+};
+
+#endif /* !TAGJOURNAL_H_INCLUDED */
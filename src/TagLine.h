@@ -0,0 +1,86 @@
+/**
+ * Line format shared by the tag journal and spcpointd: tab-separated fields with tabs,
+ * newlines and backslashes escaped as \t, \n and \\, tags as PSF-style name=value fields.
+ */
+
+#ifndef TAGLINE_H_INCLUDED
+#define TAGLINE_H_INCLUDED
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+class TagLine
+{
+public:
+	static void AppendEscaped(std::string & out, const std::string & field)
+	{
+		for (size_t i = 0; i < field.size(); i++) {
+			switch (field[i]) {
+			case '\t':
+				out += "\\t";
+				break;
+
+			case '\n':
+				out += "\\n";
+				break;
+
+			case '\\':
+				out += "\\\\";
+				break;
+
+			default:
+				out += field[i];
+				break;
+			}
+		}
+	}
+
+	// Appends a tab and an escaped name=value field for each tag.
+	static void AppendTags(std::string & out, const std::map<std::string, std::string> & psf_tags)
+	{
+		for (auto itr = psf_tags.begin(); itr != psf_tags.end(); ++itr) {
+			out += '\t';
+			AppendEscaped(out, (*itr).first);
+			out += '=';
+			AppendEscaped(out, (*itr).second);
+		}
+	}
+
+	// Splits a line (without its newline) into unescaped fields.
+	static std::vector<std::string> Split(const char * line, size_t size)
+	{
+		std::vector<std::string> fields(1);
+		for (size_t i = 0; i < size; i++) {
+			char c = line[i];
+			if (c == '\t') {
+				fields.push_back(std::string());
+			}
+			else if (c == '\\' && i + 1 < size) {
+				c = line[++i];
+				fields.back() += (c == 't') ? '\t' : (c == 'n') ? '\n' : c;
+			}
+			else {
+				fields.back() += c;
+			}
+		}
+		return fields;
+	}
+
+	// Reads fields[first] onwards as name=value tags. Returns false if one has no name.
+	static bool ParseTags(const std::vector<std::string> & fields, size_t first, std::map<std::string, std::string> & psf_tags)
+	{
+		for (size_t i = first; i < fields.size(); i++) {
+			std::string::size_type offset_equal = fields[i].find('=');
+			if (offset_equal == std::string::npos || offset_equal == 0) {
+				return false;
+			}
+			psf_tags[fields[i].substr(0, offset_equal)] = fields[i].substr(offset_equal + 1);
+		}
+		return true;
+	}
+};
+
+#endif /* !TAGLINE_H_INCLUDED */
@@ -0,0 +1,185 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTENCODING_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "TextEncoding.h"
+#include "ShiftJISTable.h"
+
+static void append_utf8(std::string & out, uint32_t code)
+{
+	if (code < 0x80) {
+		out += (char)code;
+	}
+	else if (code < 0x800) {
+		out += (char)(0xc0 | (code >> 6));
+		out += (char)(0x80 | (code & 0x3f));
+	}
+	else {
+		out += (char)(0xe0 | (code >> 12));
+		out += (char)(0x80 | ((code >> 6) & 0x3f));
+		out += (char)(0x80 | (code & 0x3f));
+	}
+}
+
+const char * TextEncoding::GetEncodingName(Encoding encoding)
+{
+	switch (encoding) {
+	case ENCODING_SHIFT_JIS:
+		return "Shift-JIS";
+
+	case ENCODING_LATIN1:
+		return "Latin-1";
+
+	default:
+		return "UTF-8";
+	}
+}
+
+size_t TextEncoding::UTF8SequenceLength(const uint8_t * str, size_t size)
+{
+	uint8_t c = str[0];
+	size_t length;
+	uint32_t min_code;
+	uint32_t code;
+
+	if (c < 0x80) {
+		return 1;
+	}
+	else if (c >= 0xc2 && c <= 0xdf) {
+		length = 2;
+		min_code = 0x80;
+		code = c & 0x1f;
+	}
+	else if (c >= 0xe0 && c <= 0xef) {
+		length = 3;
+		min_code = 0x800;
+		code = c & 0x0f;
+	}
+	else if (c >= 0xf0 && c <= 0xf4) {
+		length = 4;
+		min_code = 0x10000;
+		code = c & 0x07;
+	}
+	else {
+		return 0;
+	}
+
+	if (length > size) {
+		return 0;
+	}
+
+	for (size_t i = 1; i < length; i++) {
+		if ((str[i] & 0xc0) != 0x80) {
+			return 0;
+		}
+		code = (code << 6) | (str[i] & 0x3f);
+	}
+
+	if (code < min_code || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff)) {
+		return 0;
+	}
+	return length;
+}
+
+bool TextEncoding::IsValidUTF8(const char * str, size_t size)
+{
+	const uint8_t * p = (const uint8_t *)str;
+	size_t i = 0;
+
+	while (i < size) {
+#ifdef TEXTENCODING_SSE2
+		// most tags are ASCII: a block without any high bit needs no further look
+		while (i + 16 <= size && _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i))) == 0) {
+			i += 16;
+		}
+		if (i == size) {
+			break;
+		}
+#endif
+
+		size_t length = UTF8SequenceLength(&p[i], size - i);
+		if (length == 0) {
+			return false;
+		}
+		i += length;
+	}
+	return true;
+}
+
+bool TextEncoding::AppendShiftJISAsUTF8(std::string & out, const char * str, size_t size)
+{
+	const uint8_t * p = (const uint8_t *)str;
+
+	for (size_t i = 0; i < size; i++) {
+		uint8_t c = p[i];
+		if (c < 0x80) {
+			out += (char)c;
+		}
+		else if (c >= 0xa1 && c <= 0xdf) {
+			// half-width katakana
+			append_utf8(out, 0xff61 + (c - 0xa1));
+		}
+		else if ((c >= 0x81 && c <= 0x9f) || (c >= 0xe0 && c <= 0xfc)) {
+			if (i + 1 >= size) {
+				return false;
+			}
+
+			uint8_t trail = p[i + 1];
+			if (trail < 0x40 || trail == 0x7f || trail > 0xfc) {
+				return false;
+			}
+
+			size_t row = (c <= 0x9f) ? (c - 0x81) : (c - 0xe0 + 0x1f);
+			size_t column = (trail < 0x7f) ? (trail - 0x40) : (trail - 0x41);
+			uint16_t code = SHIFTJIS_TABLE[row * SHIFTJIS_TRAIL_COUNT + column];
+			if (code == 0) {
+				return false;
+			}
+
+			append_utf8(out, code);
+			i++;
+		}
+		else {
+			return false;
+		}
+	}
+	return true;
+}
+
+void TextEncoding::AppendLatin1AsUTF8(std::string & out, const char * str, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		append_utf8(out, (uint8_t)str[i]);
+	}
+}
+
+TextEncoding::Encoding TextEncoding::NormalizeToUTF8(const std::string & str, std::string & out)
+{
+	size_t start = str.find_first_not_of(' ');
+	size_t end = str.find_last_not_of(' ') + 1;
+	if (start == std::string::npos) {
+		start = end = 0;
+	}
+	const char * p = str.data() + start;
+	size_t size = end - start;
+
+	out.clear();
+	if (IsValidUTF8(p, size)) {
+		out.assign(p, size);
+		return ENCODING_UTF8;
+	}
+
+	if (AppendShiftJISAsUTF8(out, p, size)) {
+		return ENCODING_SHIFT_JIS;
+	}
+
+	out.clear();
+	AppendLatin1AsUTF8(out, p, size);
+	return ENCODING_LATIN1;
+}
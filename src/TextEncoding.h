@@ -0,0 +1,42 @@
+/**
+ * Character encoding of tag strings: UTF-8 validation and conversion of the
+ * Shift-JIS and Latin-1 strings found in older dumps.
+ */
+
+#ifndef TEXTENCODING_H_INCLUDED
+#define TEXTENCODING_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+class TextEncoding
+{
+public:
+	enum Encoding {
+		ENCODING_UTF8 = 0,		// includes plain ASCII
+		ENCODING_SHIFT_JIS,
+		ENCODING_LATIN1
+	};
+
+	static const char * GetEncodingName(Encoding encoding);
+
+	// Length of the well-formed UTF-8 sequence at str, or 0 if there is none.
+	static size_t UTF8SequenceLength(const uint8_t * str, size_t size);
+
+	// Skips ASCII 16 bytes at a time with SSE2 and checks the rest sequence by sequence.
+	static bool IsValidUTF8(const char * str, size_t size);
+
+	// Appends the string decoded as Shift-JIS (code page 932). Returns false, after appending
+	// what could be decoded, if it holds a byte sequence that is not a mapped character.
+	static bool AppendShiftJISAsUTF8(std::string & out, const char * str, size_t size);
+
+	static void AppendLatin1AsUTF8(std::string & out, const char * str, size_t size);
+
+	// Converts a tag string to UTF-8: kept if it is valid UTF-8 already, else decoded as
+	// Shift-JIS if possible, else as Latin-1. Surrounding spaces are trimmed.
+	static Encoding NormalizeToUTF8(const std::string & str, std::string & out);
+};
+
+#endif /* !TEXTENCODING_H_INCLUDED */
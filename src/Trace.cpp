@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include "Trace.h"
+
+struct Trace::Event {
+	const char * name;
+	size_t file_index;
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point end;
+};
+
+// Events are appended by the owning thread only; the registry lock is taken once per thread.
+struct Trace::ThreadBuffer {
+	int tid;
+	std::vector<Event> events;
+	std::vector<std::string> files;
+	size_t current_file;
+	std::chrono::steady_clock::time_point file_start;
+};
+
+static const size_t NO_FILE = (size_t)-1;
+
+std::atomic<bool> Trace::enabled(false);
+
+std::vector<Trace::ThreadBuffer *> * Trace::buffers = NULL;
+
+static std::mutex trace_mutex;
+static std::string trace_filename;
+static std::chrono::steady_clock::time_point trace_epoch;
+
+bool Trace::Start(const std::string & filename)
+{
+	std::lock_guard<std::mutex> lock(trace_mutex);
+
+	// fail early rather than after a multi-hour run
+	FILE * fp = fopen(filename.c_str(), "w");
+	if (fp == NULL) {
+		return false;
+	}
+	fclose(fp);
+
+	trace_filename = filename;
+	trace_epoch = std::chrono::steady_clock::now();
+	if (buffers == NULL) {
+		buffers = new std::vector<ThreadBuffer *>();
+	}
+
+	enabled.store(true, std::memory_order_relaxed);
+	return true;
+}
+
+Trace::ThreadBuffer * Trace::GetThreadBuffer()
+{
+	static thread_local ThreadBuffer * buffer = NULL;
+	if (buffer == NULL) {
+		buffer = new ThreadBuffer();
+		buffer->current_file = NO_FILE;
+		buffer->events.reserve(4096);
+
+		std::lock_guard<std::mutex> lock(trace_mutex);
+		buffer->tid = (int)buffers->size() + 1;
+		buffers->push_back(buffer);
+	}
+	return buffer;
+}
+
+void Trace::BeginFile(const std::string & filename)
+{
+	if (!IsEnabled()) {
+		return;
+	}
+
+	ThreadBuffer * buffer = GetThreadBuffer();
+	buffer->files.push_back(filename);
+	buffer->current_file = buffer->files.size() - 1;
+	buffer->file_start = std::chrono::steady_clock::now();
+}
+
+void Trace::EndFile()
+{
+	if (!IsEnabled()) {
+		return;
+	}
+
+	ThreadBuffer * buffer = GetThreadBuffer();
+	AddSpan("file", buffer->file_start, std::chrono::steady_clock::now());
+	buffer->current_file = NO_FILE;
+}
+
+void Trace::AddSpan(const char * name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	ThreadBuffer * buffer = GetThreadBuffer();
+
+	Event event;
+	event.name = name;
+	event.file_index = buffer->current_file;
+	event.start = start;
+	event.end = end;
+	buffer->events.push_back(event);
+}
+
+static void WriteJSONString(FILE * fp, const std::string & str)
+{
+	fputc('"', fp);
+	for (size_t i = 0; i < str.size(); i++) {
+		unsigned char c = (unsigned char)str[i];
+		if (c == '"' || c == '\\') {
+			fputc('\\', fp);
+			fputc(c, fp);
+		}
+		else if (c < 0x20) {
+			fprintf(fp, "\\u%04x", c);
+		}
+		else {
+			fputc(c, fp);
+		}
+	}
+	fputc('"', fp);
+}
+
+static double MicroSeconds(std::chrono::steady_clock::duration duration)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / 1000.0;
+}
+
+bool Trace::Finish()
+{
+	if (!IsEnabled()) {
+		return true;
+	}
+	enabled.store(false, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(trace_mutex);
+
+	FILE * fp = fopen(trace_filename.c_str(), "w");
+	if (fp == NULL) {
+		return false;
+	}
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"spcpoint\"}}");
+
+	for (size_t i = 0; i < buffers->size(); i++) {
+		const ThreadBuffer * buffer = (*buffers)[i];
+
+		fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}", buffer->tid, buffer->tid);
+
+		for (size_t j = 0; j < buffer->events.size(); j++) {
+			const Event & event = buffer->events[j];
+
+			fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"spcpoint\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+				event.name, buffer->tid,
+				MicroSeconds(event.start - trace_epoch), MicroSeconds(event.end - event.start));
+
+			if (event.file_index != NO_FILE) {
+				fprintf(fp, ",\"args\":{\"file\":");
+				WriteJSONString(fp, buffer->files[event.file_index]);
+				fprintf(fp, "}");
+			}
+			fprintf(fp, "}");
+		}
+	}
+
+	fprintf(fp, "\n]}\n");
+
+	bool success = (ferror(fp) == 0);
+	if (fclose(fp) != 0) {
+		success = false;
+	}
+	return success;
+}
@@ -0,0 +1,63 @@
+/**
+ * Trace Event Format (Chrome trace / Perfetto) output for batch runs.
+ */
+
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+class Trace
+{
+public:
+	static std::atomic<bool> enabled;
+
+	static bool IsEnabled()
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	// Starts collecting events which will be written to the given path by Finish().
+	// Finish() must be called after all worker threads have been joined.
+	static bool Start(const std::string & filename);
+	static bool Finish();
+
+	// Spans recorded on this thread between BeginFile and EndFile are tagged with the filename.
+	static void BeginFile(const std::string & filename);
+	static void EndFile();
+
+	static void AddSpan(const char * name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+	class FileScope
+	{
+	public:
+		explicit FileScope(const std::string & filename)
+		{
+			BeginFile(filename);
+		}
+
+		~FileScope()
+		{
+			EndFile();
+		}
+
+	private:
+		FileScope(const FileScope&);
+		FileScope& operator=(const FileScope&);
+	};
+
+private:
+	struct Event;
+	struct ThreadBuffer;
+
+	static ThreadBuffer * GetThreadBuffer();
+
+	static std::vector<ThreadBuffer *> * buffers;
+};
+
+#endif /* !TRACE_H_INCLUDED */
@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "WAVWriter.h"
+
+static void put_le16(uint8_t * p, uint16_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static void put_le32(uint8_t * p, uint32_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+	p[2] = (uint8_t)(value >> 16);
+	p[3] = (uint8_t)(value >> 24);
+}
+
+WAVWriter::WAVWriter() : fp(NULL), channels(2), error(false)
+{
+}
+
+WAVWriter::~WAVWriter()
+{
+	Close();
+}
+
+bool WAVWriter::Open(const std::string & filename, uint32_t sample_rate, uint32_t num_frames, uint16_t channels)
+{
+	Close();
+
+	fp = fopen(filename.c_str(), "wb");
+	if (fp == NULL) {
+		return false;
+	}
+	error = false;
+	this->channels = channels;
+
+	const uint16_t block_align = channels * 2;
+	uint32_t data_size = num_frames * block_align;
+
+	uint8_t header[44];
+	memcpy(&header[0], "RIFF", 4);
+	put_le32(&header[4], 36 + data_size);
+	memcpy(&header[8], "WAVE", 4);
+	memcpy(&header[12], "fmt ", 4);
+	put_le32(&header[16], 16);
+	put_le16(&header[20], 1); // PCM
+	put_le16(&header[22], channels);
+	put_le32(&header[24], sample_rate);
+	put_le32(&header[28], sample_rate * block_align);
+	put_le16(&header[32], block_align);
+	put_le16(&header[34], 16);
+	memcpy(&header[36], "data", 4);
+	put_le32(&header[40], data_size);
+
+	if (fwrite(header, sizeof(header), 1, fp) != 1) {
+		error = true;
+	}
+	return !error;
+}
+
+bool WAVWriter::Write(const int16_t * samples, size_t num_frames)
+{
+	if (fp == NULL) {
+		return false;
+	}
+
+	uint8_t buf[4096];
+	size_t num_samples = num_frames * channels;
+	while (num_samples != 0) {
+		size_t count = num_samples;
+		if (count > sizeof(buf) / 2) {
+			count = sizeof(buf) / 2;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			put_le16(&buf[i * 2], (uint16_t)samples[i]);
+		}
+
+		if (fwrite(buf, 2, count, fp) != count) {
+			error = true;
+			return false;
+		}
+
+		samples += count;
+		num_samples -= count;
+	}
+	return true;
+}
+
+bool WAVWriter::Close()
+{
+	if (fp == NULL) {
+		return !error;
+	}
+
+	if (fclose(fp) != 0) {
+		error = true;
+	}
+	fp = NULL;
+	return !error;
+}
@@ -0,0 +1,33 @@
+/**
+ * 16-bit PCM WAV output.
+ */
+
+#ifndef WAVWRITER_H_INCLUDED
+#define WAVWRITER_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+class WAVWriter
+{
+public:
+	WAVWriter();
+	virtual ~WAVWriter();
+
+	// The frame count is known up front, so the header is final when written.
+	bool Open(const std::string & filename, uint32_t sample_rate, uint32_t num_frames, uint16_t channels = 2);
+	bool Write(const int16_t * samples, size_t num_frames);
+	bool Close();
+
+private:
+	WAVWriter(const WAVWriter&);
+	WAVWriter& operator=(const WAVWriter&);
+
+	FILE * fp;
+	uint16_t channels;
+	bool error;
+};
+
+#endif /* !WAVWRITER_H_INCLUDED */
@@ -5,6 +5,7 @@
 #ifndef CPATH_H_INCLUDED
 #define CPATH_H_INCLUDED
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
@@ -39,9 +40,9 @@ typedef int bool;
 #endif /* C++ */
 
 #ifndef INLINE
-#ifdef inline
+#if defined(__cplusplus) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
 #define INLINE  inline
-#elsif defined(__inline)
+#elif defined(_MSC_VER)
 #define INLINE  __inline
 #else
 #define INLINE
@@ -155,7 +156,7 @@ static INLINE bool path_isdir(const char *path)
 	return false;
 }
 
-static off_t path_getfilesize(const char *path)
+static INLINE off_t path_getfilesize(const char *path)
 {
 	struct stat st;
 	if (stat(path, &st) == 0)
@@ -165,7 +166,17 @@ static off_t path_getfilesize(const char *path)
 	return -1;
 }
 
-static char *path_getabspath(const char *path, char *absolute_path)
+/* Moves a fully written temporary file over path. */
+static INLINE bool path_replacefile(const char *tmp_path, const char *path)
+{
+#ifdef _WIN32
+	/* rename does not replace an existing file on Windows */
+	remove(path);
+#endif
+	return rename(tmp_path, path) == 0;
+}
+
+static INLINE char *path_getabspath(const char *path, char *absolute_path)
 {
 #ifdef _WIN32
 	char *szFilePart;
@@ -204,7 +215,7 @@ static char *path_getabspath(const char *path, char *absolute_path)
 #endif
 }
 
-static void path_modulepath(char * path)
+static INLINE void path_modulepath(char * path)
 {
 #ifdef _WIN32
 	GetModuleFileNameA(GetModuleHandleA(NULL), path, PATH_MAX);
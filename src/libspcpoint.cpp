@@ -0,0 +1,255 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "SPCFile.h"
+#include "libspcpoint.h"
+#include "cpath.h"
+
+struct spcpoint_file {
+	SPCFile * spc;
+	std::string messages;
+};
+
+// Finds one tag among the ones VisitPSFTags produces, without building the whole map.
+class PSFTagFinder : public SPCFile::PSFTagVisitor
+{
+public:
+	PSFTagFinder(const char * name, char * buffer, size_t buffer_size) :
+		name(name),
+		buffer(buffer),
+		buffer_size(buffer_size),
+		found(false),
+		value_size(0)
+	{
+	}
+
+	virtual void Visit(const char * name, const char * value, size_t size)
+	{
+		if (found || strcmp(name, this->name) != 0) {
+			return;
+		}
+
+		found = true;
+		value_size = size;
+		if (size < buffer_size) {
+			memcpy(buffer, value, size);
+			buffer[size] = '\0';
+		}
+	}
+
+	bool IsFound() const
+	{
+		return found;
+	}
+
+	size_t GetValueSize() const
+	{
+		return value_size;
+	}
+
+private:
+	const char * name;
+	char * buffer;
+	size_t buffer_size;
+	bool found;
+	size_t value_size;
+};
+
+static spcpoint_status WrapSPCFile(SPCFile * spc, const std::string & messages, spcpoint_file ** out_file)
+{
+	spcpoint_file * file = new (std::nothrow) spcpoint_file;
+	if (file == NULL) {
+		delete spc;
+		return SPCPOINT_ERROR_OUT_OF_MEMORY;
+	}
+
+	file->spc = spc;
+	file->messages = messages;
+	*out_file = file;
+	return SPCPOINT_OK;
+}
+
+int spcpoint_abi_version(void)
+{
+	return SPCPOINT_ABI_VERSION;
+}
+
+const char * spcpoint_status_string(spcpoint_status status)
+{
+	switch (status) {
+	case SPCPOINT_OK:
+		return "ok";
+
+	case SPCPOINT_ERROR_INVALID_ARGUMENT:
+		return "invalid argument";
+
+	case SPCPOINT_ERROR_IO:
+		return "i/o error";
+
+	case SPCPOINT_ERROR_FORMAT:
+		return "not an SPC file";
+
+	case SPCPOINT_ERROR_TAG:
+		return "illegal tag value";
+
+	case SPCPOINT_ERROR_NOT_FOUND:
+		return "tag not found";
+
+	case SPCPOINT_ERROR_BUFFER_TOO_SMALL:
+		return "buffer too small";
+
+	case SPCPOINT_ERROR_OUT_OF_MEMORY:
+		return "out of memory";
+
+	case SPCPOINT_ERROR_UNKNOWN_TAG:
+		return "unknown tag";
+
+	default:
+		return "unknown error";
+	}
+}
+
+spcpoint_status spcpoint_open_file(const char * path, spcpoint_file ** out_file)
+{
+	if (path == NULL || out_file == NULL) {
+		return SPCPOINT_ERROR_INVALID_ARGUMENT;
+	}
+	*out_file = NULL;
+
+	try {
+		std::string messages;
+		SPCFile * spc = SPCFile::Load(path, &messages);
+		if (spc == NULL) {
+			// tell a missing file apart from a malformed one
+			return (path_getfilesize(path) == -1) ? SPCPOINT_ERROR_IO : SPCPOINT_ERROR_FORMAT;
+		}
+		return WrapSPCFile(spc, messages, out_file);
+	}
+	catch (const std::bad_alloc &) {
+		return SPCPOINT_ERROR_OUT_OF_MEMORY;
+	}
+}
+
+spcpoint_status spcpoint_open_buffer(const void * data, size_t size, spcpoint_file ** out_file)
+{
+	if (data == NULL || out_file == NULL) {
+		return SPCPOINT_ERROR_INVALID_ARGUMENT;
+	}
+	*out_file = NULL;
+
+	try {
+		std::string messages;
+		SPCFile * spc = SPCFile::LoadFromMemory((const uint8_t *)data, size, &messages);
+		if (spc == NULL) {
+			return SPCPOINT_ERROR_FORMAT;
+		}
+		return WrapSPCFile(spc, messages, out_file);
+	}
+	catch (const std::bad_alloc &) {
+		return SPCPOINT_ERROR_OUT_OF_MEMORY;
+	}
+}
+
+void spcpoint_close(spcpoint_file * file)
+{
+	if (file != NULL) {
+		delete file->spc;
+		delete file;
+	}
+}
+
+spcpoint_status spcpoint_get_tag(const spcpoint_file * file, const char * name, char * buffer, size_t buffer_size, size_t * out_size)
+{
+	if (file == NULL || name == NULL || (buffer == NULL && buffer_size != 0)) {
+		return SPCPOINT_ERROR_INVALID_ARGUMENT;
+	}
+
+	PSFTagFinder finder(name, buffer, buffer_size);
+	file->spc->VisitPSFTags(true, finder);
+	if (!finder.IsFound()) {
+		return SPCPOINT_ERROR_NOT_FOUND;
+	}
+
+	if (out_size != NULL) {
+		*out_size = finder.GetValueSize() + 1;
+	}
+	return (buffer_size < finder.GetValueSize() + 1) ? SPCPOINT_ERROR_BUFFER_TOO_SMALL : SPCPOINT_OK;
+}
+
+spcpoint_status spcpoint_set_tag(spcpoint_file * file, const char * name, const char * value)
+{
+	if (file == NULL || name == NULL || value == NULL) {
+		return SPCPOINT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		file->messages.clear();
+		if (!SPCFile::IsPSFTagName(name)) {
+			file->messages = std::string("Error: Unknown tag \"") + name + "\"\n";
+			return SPCPOINT_ERROR_UNKNOWN_TAG;
+		}
+
+		std::map<std::string, std::string> psf_tags;
+		psf_tags[name] = value;
+		return file->spc->ImportPSFTag(psf_tags, &file->messages) ? SPCPOINT_OK : SPCPOINT_ERROR_TAG;
+	}
+	catch (const std::bad_alloc &) {
+		return SPCPOINT_ERROR_OUT_OF_MEMORY;
+	}
+}
+
+spcpoint_status spcpoint_serialize(const spcpoint_file * file, void ** out_data, size_t * out_size)
+{
+	if (file == NULL || out_data == NULL || out_size == NULL) {
+		return SPCPOINT_ERROR_INVALID_ARGUMENT;
+	}
+	*out_data = NULL;
+	*out_size = 0;
+
+	try {
+		std::vector<uint8_t> data;
+		file->spc->Serialize(data);
+
+		void * buffer = malloc(data.size());
+		if (buffer == NULL) {
+			return SPCPOINT_ERROR_OUT_OF_MEMORY;
+		}
+		memcpy(buffer, &data[0], data.size());
+
+		*out_data = buffer;
+		*out_size = data.size();
+		return SPCPOINT_OK;
+	}
+	catch (const std::bad_alloc &) {
+		return SPCPOINT_ERROR_OUT_OF_MEMORY;
+	}
+}
+
+const char * spcpoint_get_messages(const spcpoint_file * file)
+{
+	return (file != NULL) ? file->messages.c_str() : "";
+}
+
+void spcpoint_free_buffer(void * data)
+{
+	free(data);
+}
+
+spcpoint_status spcpoint_save(const spcpoint_file * file, const char * path)
+{
+	if (file == NULL || path == NULL) {
+		return SPCPOINT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return file->spc->Save(path) ? SPCPOINT_OK : SPCPOINT_ERROR_IO;
+	}
+	catch (const std::bad_alloc &) {
+		return SPCPOINT_ERROR_OUT_OF_MEMORY;
+	}
+}
@@ -0,0 +1,83 @@
+/**
+ * libspcpoint: C interface for reading and writing SPC tags in-process.
+ *
+ * All functions are thread-safe as long as a handle is not shared between
+ * threads without synchronization. Tag names are the same as the ones used
+ * by the spcpoint command line (title, game, artist, length, fade, ...).
+ */
+
+#ifndef LIBSPCPOINT_H_INCLUDED
+#define LIBSPCPOINT_H_INCLUDED
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(SPCPOINT_SHARED)
+#ifdef SPCPOINT_BUILDING
+#define SPCPOINT_API __declspec(dllexport)
+#else
+#define SPCPOINT_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__) && defined(SPCPOINT_BUILDING)
+#define SPCPOINT_API __attribute__((visibility("default")))
+#else
+#define SPCPOINT_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped only when the ABI changes incompatibly. */
+#define SPCPOINT_ABI_VERSION 1
+
+typedef struct spcpoint_file spcpoint_file;
+
+typedef enum spcpoint_status {
+	SPCPOINT_OK = 0,
+	SPCPOINT_ERROR_INVALID_ARGUMENT = 1,
+	SPCPOINT_ERROR_IO = 2,
+	SPCPOINT_ERROR_FORMAT = 3,
+	SPCPOINT_ERROR_TAG = 4,
+	SPCPOINT_ERROR_NOT_FOUND = 5,
+	SPCPOINT_ERROR_BUFFER_TOO_SMALL = 6,
+	SPCPOINT_ERROR_OUT_OF_MEMORY = 7,
+	SPCPOINT_ERROR_UNKNOWN_TAG = 8
+} spcpoint_status;
+
+SPCPOINT_API int spcpoint_abi_version(void);
+SPCPOINT_API const char * spcpoint_status_string(spcpoint_status status);
+
+/* Opens an SPC file from disk or from a memory buffer (the buffer is copied). */
+SPCPOINT_API spcpoint_status spcpoint_open_file(const char * path, spcpoint_file ** out_file);
+SPCPOINT_API spcpoint_status spcpoint_open_buffer(const void * data, size_t size, spcpoint_file ** out_file);
+SPCPOINT_API void spcpoint_close(spcpoint_file * file);
+
+/*
+ * Copies the null-terminated tag value into buffer. The required size
+ * (including the terminator) is stored in out_size if it is not NULL, so
+ * passing a NULL buffer with zero size queries the length (the call then
+ * returns SPCPOINT_ERROR_BUFFER_TOO_SMALL).
+ */
+SPCPOINT_API spcpoint_status spcpoint_get_tag(const spcpoint_file * file, const char * name, char * buffer, size_t buffer_size, size_t * out_size);
+
+/* Sets a tag; an empty value deletes it. Unknown names fail with SPCPOINT_ERROR_UNKNOWN_TAG. */
+SPCPOINT_API spcpoint_status spcpoint_set_tag(spcpoint_file * file, const char * name, const char * value);
+
+/*
+ * Diagnostics of opening the file or of the last spcpoint_set_tag (tag values that
+ * could not be parsed), one per line, or an empty string. The library never prints.
+ * The string stays valid until the next spcpoint_set_tag or spcpoint_close.
+ */
+SPCPOINT_API const char * spcpoint_get_messages(const spcpoint_file * file);
+
+/* Serializes the file into a newly allocated buffer, released by spcpoint_free_buffer. */
+SPCPOINT_API spcpoint_status spcpoint_serialize(const spcpoint_file * file, void ** out_data, size_t * out_size);
+SPCPOINT_API void spcpoint_free_buffer(void * data);
+
+SPCPOINT_API spcpoint_status spcpoint_save(const spcpoint_file * file, const char * path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !LIBSPCPOINT_H_INCLUDED */
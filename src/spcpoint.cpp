@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <time.h>
 #include <math.h>
 
@@ -13,34 +14,1687 @@
 #include <iterator>
 #include <limits>
 #include <algorithm>
+#include <set>
+#include <mutex>
+#include <atomic>
 
 #include "SPCFile.h"
+#include "SPCPlayer.h"
+#include "SPCBatch.h"
+#include "SPCDSPKernel.h"
+#include "BRR.h"
+#include "Hash.h"
+#include "SPCDriverDatabase.h"
+#include "SPCDiff.h"
+#include "SPCManifest.h"
+#include "WAVWriter.h"
+#include "LoudnessMeter.h"
+#include "TagDump.h"
+#include "TagGrep.h"
+#include "TagIndex.h"
+#include "TagJournal.h"
+#include "TagLine.h"
+#include "TextEncoding.h"
+#include "DirectoryWalker.h"
+#include "Parallel.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "cpath.h"
 
 #define APP_NAME    "spcpoint"
 #define APP_VER     "[2015-04-16]"
 #define APP_URL     "http://github.com/loveemu/spcpoint"
 
+// -autovolume target in LUFS, the ReplayGain 2.0 reference level
+#define AUTOVOLUME_REFERENCE    (-18.0)
+
 bool both_are_spaces(char lhs, char rhs)
 {
-	return (lhs == rhs) && (lhs == ' ');
+	return (lhs == rhs) && (lhs == ' ');
+}
+
+void replace_all(std::string& str, const std::string& from, const std::string& to)
+{
+	std::string::size_type pos = 0;
+	while (pos = str.find(from, pos), pos != std::string::npos) {
+		str.replace(pos, from.length(), to);
+		pos += to.length();
+	}
+}
+
+// One result flag per file or track. Not vector<bool>: the flags are written from several threads.
+typedef std::vector<uint8_t> FileFlags;
+
+static bool parse_thread_count(const char * str, unsigned int & num_threads)
+{
+	char * endptr = NULL;
+	long n = strtol(str, &endptr, 10);
+	if (*endptr != '\0' || n <= 0) {
+		fprintf(stderr, "Error: Number format error \"%s\"\n", str);
+		return false;
+	}
+	num_threads = (unsigned int)n;
+	return true;
+}
+
+static void usage(const char * progname)
+{
+	printf("%s %s\n", APP_NAME, APP_VER);
+	printf("<%s>\n", APP_URL);
+	printf("\n");
+	printf("Usage: `%s [-tf] [-autovolume] [--stats[=json]] [--trace out.json] [--journal file] [-r dir ...] [-variable=value ...] spc-file(s)`\n", progname);
+	printf("       `%s --format=ndjson|csv [--journal file] [-r dir ...] spc-file(s)`\n", progname);
+	printf("       `%s render [-j threads] [-o outdir] [--kernel name] [--start time] [--checkpoints] spc-file(s)`\n", progname);
+	printf("       `%s activity [-j threads] [--mute] spc-file(s)`\n", progname);
+	printf("       `%s samples [-j threads] [-o storedir] [--wav] spc-file(s)`\n", progname);
+	printf("       `%s identify [-j threads] --db signatures.txt spc-file(s)`\n", progname);
+	printf("       `%s grep [-j threads] [-r dir ...] field=pattern spc-file(s)`\n", progname);
+	printf("       `%s index [-j threads] [--journal file] [-r dir ...] -o index-file spc-file(s)`\n", progname);
+	printf("       `%s search [--fuzzy] index-file [field=]pattern`\n", progname);
+	printf("       `%s compact journal-file`\n", progname);
+	printf("       `%s hash [-j threads] [-r dir ...] -o manifest spc-file(s)`\n", progname);
+	printf("       `%s verify [-j threads] manifest`\n", progname);
+	printf("       `%s diff [-j threads] spc-file spc-file(s)|dir ...`\n", progname);
+	printf("       `%s normalize [-j threads] [-n] [-r dir ...] spc-file(s)`\n", progname);
+	printf("\n");
+}
+
+// Writes each track of a batch to its own WAV file. Files are opened as their tracks start
+// and closed as they finish, so only the tracks being rendered hold a file open.
+class WAVBatchSink : public SPCBatchSink
+{
+public:
+	WAVBatchSink(size_t num_tracks) :
+		wavs(num_tracks),
+		filenames(num_tracks),
+		frame_counts(num_tracks, 0),
+		open_errors(num_tracks, 0),
+		opened(num_tracks, false),
+		errors(num_tracks, false)
+	{
+	}
+
+	void SetOutput(size_t track, const std::string & filename, uint32_t num_frames)
+	{
+		filenames[track] = filename;
+		frame_counts[track] = num_frames;
+	}
+
+	virtual bool Open(size_t track)
+	{
+		errno = 0;
+		if (!wavs[track].Open(filenames[track], SPCPlayer::SAMPLE_RATE, frame_counts[track])) {
+			open_errors[track] = errno;
+			wavs[track].Close();
+			return false;
+		}
+		opened[track] = true;
+		return true;
+	}
+
+	virtual bool Write(size_t track, const int16_t * samples, size_t num_frames)
+	{
+		if (!wavs[track].Write(samples, num_frames)) {
+			errors[track] = true;
+		}
+		return !errors[track];
+	}
+
+	virtual void Close(size_t track)
+	{
+		if (opened[track] && !wavs[track].Close()) {
+			errors[track] = true;
+		}
+	}
+
+	bool IsOpened(size_t track) const
+	{
+		return opened[track] != 0;
+	}
+
+	// errno of a failed Open, 0 if there was none
+	int GetOpenError(size_t track) const
+	{
+		return open_errors[track];
+	}
+
+	bool HasWriteError(size_t track) const
+	{
+		return errors[track] != 0;
+	}
+
+private:
+	std::vector<WAVWriter> wavs;
+	std::vector<std::string> filenames;
+	std::vector<uint32_t> frame_counts;
+	std::vector<int> open_errors;
+	FileFlags opened;
+	FileFlags errors;
+};
+
+// Measures the playback window of each track, without the fade-out.
+class LoudnessBatchSink : public SPCBatchSink
+{
+public:
+	LoudnessBatchSink(const SPCBatch & batch)
+	{
+		for (size_t i = 0; i < batch.GetTrackCount(); i++) {
+			meters.push_back(new LoudnessMeter(SPCPlayer::SAMPLE_RATE));
+			frames_left.push_back(batch.GetPlayFrames(i));
+		}
+	}
+
+	virtual ~LoudnessBatchSink()
+	{
+		for (auto itr = meters.begin(); itr != meters.end(); ++itr) {
+			delete *itr;
+		}
+	}
+
+	virtual bool Write(size_t track, const int16_t * samples, size_t num_frames)
+	{
+		num_frames = (size_t)std::min<uint64_t>(num_frames, frames_left[track]);
+		meters[track]->Write(samples, num_frames);
+		frames_left[track] -= num_frames;
+		return frames_left[track] != 0;
+	}
+
+	const LoudnessMeter & GetMeter(size_t track) const
+	{
+		return *meters[track];
+	}
+
+private:
+	std::vector<LoudnessMeter *> meters;
+	std::vector<uint64_t> frames_left;
+};
+
+// Prints the tags as spcpoint arguments, straight from the tag data.
+class TagArgumentPrinter : public SPCFile::PSFTagVisitor
+{
+public:
+	virtual void Visit(const char * name, const char * value, size_t size)
+	{
+		bool quote = strchr(name, ' ') != NULL || memchr(value, ' ', size) != NULL;
+
+		fputs(quote ? " \"-" : " -", stdout);
+		fputs(name, stdout);
+		putchar('=');
+		fwrite(value, 1, size, stdout);
+		if (quote) {
+			putchar('"');
+		}
+	}
+};
+
+// Computes XID6 volumes that bring every file to the same loudness. The common target is
+// AUTOVOLUME_REFERENCE, lowered if needed so that no file has to be amplified into clipping.
+static void measure_autovolume(const std::vector<std::string> & filenames, const TagJournal * journal, const SPCFile::TagPatch & patch, std::map<std::string, uint32_t> & volumes)
+{
+	SPCBatch batch;
+	std::vector<size_t> track_of_file(filenames.size(), SIZE_MAX);
+	std::vector<uint32_t> current_volumes(filenames.size(), 0x10000);
+	for (size_t i = 0; i < filenames.size(); i++) {
+		SPCFile * spc = SPCFile::Load(filenames[i]);
+		if (spc == NULL) {
+			continue;
+		}
+
+		// measure what the tags will make it sound like
+		if (journal != NULL) {
+			journal->Apply(filenames[i], *spc);
+		}
+		patch.Apply(*spc);
+		if (spc->tags.count(SPCFile::XID6_VOLUME) != 0) {
+			current_volumes[i] = spc->GetIntegerTag(SPCFile::XID6_VOLUME);
+		}
+		track_of_file[i] = batch.Add(*spc, filenames[i]);
+		delete spc;
+	}
+
+	LoudnessBatchSink sink(batch);
+	batch.Run(sink, Parallel::DefaultThreadCount());
+
+	double target = AUTOVOLUME_REFERENCE;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (track_of_file[i] == SIZE_MAX) {
+			continue;
+		}
+
+		const LoudnessMeter & meter = sink.GetMeter(track_of_file[i]);
+		double loudness = meter.GetIntegratedLoudness();
+		if (loudness != -HUGE_VAL && meter.GetPeak() != 0) {
+			target = std::min(target, loudness + 20.0 * log10(32767.0 / meter.GetPeak()));
+		}
+	}
+
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (track_of_file[i] == SIZE_MAX) {
+			continue;
+		}
+
+		double loudness = sink.GetMeter(track_of_file[i]).GetIntegratedLoudness();
+		if (loudness == -HUGE_VAL) {
+			// silence stays as it is
+			continue;
+		}
+
+		double volume = current_volumes[i] * pow(10.0, (target - loudness) / 20.0);
+		volumes[filenames[i]] = (uint32_t)std::min<double>(volume + 0.5, 0xffffffffu);
+	}
+}
+
+static int render_main(int argc, char *argv[])
+{
+	unsigned int num_threads = Parallel::DefaultThreadCount();
+	std::string outdir;
+	const SPCDSPKernel * kernel = SPCDSPKernel::GetDefault();
+	uint64_t start_frame = 0;
+	bool use_checkpoints = false;
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "--checkpoints") == 0) {
+			use_checkpoints = true;
+		}
+		else if (strcmp(argv[argi], "--start") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			bool valid_format;
+			uint32_t ticks = SPCFile::TimeStringToXID6Ticks(argv[argi + 1], &valid_format);
+			if (!valid_format) {
+				fprintf(stderr, "Error: Illegal time format \"%s\"\n", argv[argi + 1]);
+				return EXIT_FAILURE;
+			}
+			start_frame = ticks / SPCPlayer::TICKS_PER_FRAME;
+			argi++;
+		}
+		else if (strcmp(argv[argi], "--kernel") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			kernel = SPCDSPKernel::Find(argv[argi + 1]);
+			if (kernel == NULL) {
+				fprintf(stderr, "Error: DSP kernel \"%s\" is not available\n", argv[argi + 1]);
+				return EXIT_FAILURE;
+			}
+			argi++;
+		}
+		else if (strcmp(argv[argi], "-j") == 0 || strcmp(argv[argi], "-o") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (argv[argi][1] == 'j') {
+				if (!parse_thread_count(argv[argi + 1], num_threads)) {
+					return EXIT_FAILURE;
+				}
+			}
+			else {
+				outdir = argv[argi + 1];
+			}
+			argi++;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (argi == argc) {
+		fprintf(stderr, "Error: No input files\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::string> filenames(argv + argi, argv + argc);
+
+	// Files are rendered as one batch, so tracks sharing a snapshot are emulated once.
+	SPCBatch batch;
+	std::vector<size_t> track_of_file(filenames.size(), SIZE_MAX);
+	std::vector<std::string> checkpoint_filenames(filenames.size());
+	for (size_t i = 0; i < filenames.size(); i++) {
+		SPCFile * spc = SPCFile::Load(filenames[i]);
+		if (spc != NULL) {
+			track_of_file[i] = batch.Add(*spc, filenames[i]);
+			delete spc;
+		}
+
+		// sidecar next to the SPC file, reused by later renders
+		if (use_checkpoints && track_of_file[i] != SIZE_MAX) {
+			char checkpoint_filename[PATH_MAX];
+			snprintf(checkpoint_filename, sizeof(checkpoint_filename), "%s", filenames[i].c_str());
+			path_stripext(checkpoint_filename);
+			strncat(checkpoint_filename, ".ckpt", sizeof(checkpoint_filename) - strlen(checkpoint_filename) - 1);
+
+			checkpoint_filenames[i] = checkpoint_filename;
+			batch.SetCheckpointFile(track_of_file[i], checkpoint_filenames[i]);
+		}
+	}
+	batch.SetDSPKernel(kernel);
+	batch.SetStart(start_frame);
+
+	WAVBatchSink sink(batch.GetTrackCount());
+	std::vector<std::string> wav_filenames(filenames.size());
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (track_of_file[i] == SIZE_MAX) {
+			continue;
+		}
+
+		char wav_filename[PATH_MAX];
+		if (outdir.empty()) {
+			snprintf(wav_filename, sizeof(wav_filename), "%s", filenames[i].c_str());
+		}
+		else {
+			snprintf(wav_filename, sizeof(wav_filename), "%s" PATH_SEPARATOR_STR "%s", outdir.c_str(), path_findbase(filenames[i].c_str()));
+		}
+		path_stripext(wav_filename);
+		strncat(wav_filename, ".wav", sizeof(wav_filename) - strlen(wav_filename) - 1);
+
+		uint64_t total_frames = batch.GetTotalFrames(track_of_file[i]);
+		uint64_t num_frames = (start_frame < total_frames) ? total_frames - start_frame : 0;
+		wav_filenames[i] = wav_filename;
+		sink.SetOutput(track_of_file[i], wav_filename, (uint32_t)num_frames);
+	}
+
+	batch.Run(sink, num_threads);
+
+	int num_errors = 0;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		size_t track = track_of_file[i];
+		const char * error = NULL;
+		if (track == SIZE_MAX || batch.HasLoadError(track)) {
+			error = "load error";
+		}
+		else if (!sink.IsOpened(track)) {
+			int open_error = sink.GetOpenError(track);
+			fprintf(stderr, "Error: Unable to open \"%s\": %s\n", wav_filenames[i].c_str(), (open_error != 0) ? strerror(open_error) : "write error");
+			error = "unable to open output";
+		}
+		else if (sink.HasWriteError(track)) {
+			fprintf(stderr, "Error: Unable to write \"%s\"\n", wav_filenames[i].c_str());
+			error = "write error";
+		}
+
+		bool ok = (error == NULL);
+		if (ok && batch.HasCheckpointError(track)) {
+			fprintf(stderr, "Warning: Unable to save \"%s\"\n", checkpoint_filenames[i].c_str());
+		}
+		if (!ok) {
+			num_errors++;
+		}
+
+		printf("%s: %s\n", filenames[i].c_str(), ok ? "ok" : error);
+	}
+
+	return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+struct VoiceActivity {
+	bool ok;
+	const char * error;
+	std::vector<uint8_t> seconds;	// voices heard in each second of the playback window
+	uint8_t silent_voices;
+	bool muted;
+};
+
+static void analyze_voice_activity(const std::string & filename, bool set_mute, VoiceActivity & result)
+{
+	result.ok = false;
+	result.error = "load error";
+	result.silent_voices = 0;
+	result.muted = false;
+
+	SPCFile * spc = SPCFile::Load(filename);
+	if (spc == NULL) {
+		return;
+	}
+
+	SPCEmulator * emulator = new SPCEmulator();
+	emulator->Load(*spc);
+
+	SPCFadeOut fade;
+	fade.Load(*spc);
+
+	uint8_t heard = 0;
+	uint64_t frames_left = fade.GetPlayFrames();
+	while (frames_left != 0) {
+		size_t num_frames = (size_t)std::min<uint64_t>(frames_left, SPCEmulator::SAMPLE_RATE);
+		emulator->Render(NULL, num_frames);
+		frames_left -= num_frames;
+
+		uint8_t activity = emulator->TakeVoiceActivity();
+		result.seconds.push_back(activity);
+		heard |= activity;
+	}
+	delete emulator;
+
+	result.ok = true;
+	result.silent_voices = ~heard;
+
+	uint8_t mute = (uint8_t)spc->GetIntegerTag(SPCFile::XID6_MUTED_VOICES);
+	if (set_mute && (mute | result.silent_voices) != mute) {
+		spc->SetIntegerTag(SPCFile::XID6_MUTED_VOICES, mute | result.silent_voices, 1);
+		if (spc->Save(filename)) {
+			result.muted = true;
+		}
+		else {
+			result.ok = false;
+			result.error = "save error";
+		}
+	}
+
+	delete spc;
+}
+
+static int activity_main(int argc, char *argv[])
+{
+	unsigned int num_threads = Parallel::DefaultThreadCount();
+	bool set_mute = false;
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "--mute") == 0) {
+			set_mute = true;
+		}
+		else if (strcmp(argv[argi], "-j") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (!parse_thread_count(argv[argi + 1], num_threads)) {
+				return EXIT_FAILURE;
+			}
+			argi++;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (argi == argc) {
+		fprintf(stderr, "Error: No input files\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::string> filenames(argv + argi, argv + argc);
+	std::vector<VoiceActivity> results(filenames.size());
+	Parallel::For(filenames.size(), num_threads, [&](size_t i) {
+		analyze_voice_activity(filenames[i], set_mute, results[i]);
+	});
+
+	int num_errors = 0;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		const VoiceActivity & result = results[i];
+		if (!result.ok) {
+			printf("%s: %s\n", filenames[i].c_str(), result.error);
+			num_errors++;
+			continue;
+		}
+
+		printf("%s: silent voices", filenames[i].c_str());
+		if (result.silent_voices == 0) {
+			printf(" none");
+		}
+		for (int voice = 0; voice < SPCDSP::VOICE_COUNT; voice++) {
+			if ((result.silent_voices & (1 << voice)) != 0) {
+				printf(" %d", voice);
+			}
+		}
+		printf("%s\n", result.muted ? " (muted)" : "");
+
+		// the seconds each voice was heard, as ranges
+		for (int voice = 0; voice < SPCDSP::VOICE_COUNT; voice++) {
+			printf("  voice %d:", voice);
+			if ((result.silent_voices & (1 << voice)) != 0) {
+				printf(" -");
+			}
+
+			const std::vector<uint8_t> & seconds = result.seconds;
+			for (size_t start = 0; start < seconds.size(); start++) {
+				if ((seconds[start] & (1 << voice)) == 0) {
+					continue;
+				}
+
+				size_t end = start + 1;
+				while (end < seconds.size() && (seconds[end] & (1 << voice)) != 0) {
+					end++;
+				}
+				printf(" %d:%02d-%d:%02d", (int)(start / 60), (int)(start % 60), (int)(end / 60), (int)(end % 60));
+				start = end;
+			}
+			printf("\n");
+		}
+	}
+
+	return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Moves a fully written temporary file into place, or removes it if writing it failed.
+static bool replace_file(const char * tmp_filename, const char * filename, bool ok)
+{
+	if (!ok || !path_replacefile(tmp_filename, filename)) {
+		remove(tmp_filename);
+		return false;
+	}
+	return true;
+}
+
+// Decodes a BRR sample to a mono WAV file next to blob_filename, played at the DSP's own rate.
+static bool export_brr_wav(const uint8_t * data, uint32_t size, const char * blob_filename)
+{
+	char wav_filename[PATH_MAX];
+	snprintf(wav_filename, sizeof(wav_filename), "%s", blob_filename);
+	path_stripext(wav_filename);
+	strncat(wav_filename, ".wav", sizeof(wav_filename) - strlen(wav_filename) - 1);
+
+	size_t num_blocks = size / BRR::BLOCK_SIZE;
+	std::vector<int16_t> pcm(num_blocks * BRR::SAMPLES_PER_BLOCK);
+	int16_t history[2] = { 0, 0 };
+	BRR::Decode(data, num_blocks, pcm.data(), history);
+
+	std::string tmp_filename = std::string(wav_filename) + ".tmp";
+
+	WAVWriter wav;
+	bool ok = wav.Open(tmp_filename, SPCDSP::SAMPLE_RATE, (uint32_t)pcm.size(), 1) &&
+		wav.Write(pcm.data(), pcm.size());
+	if (!wav.Close()) {
+		ok = false;
+	}
+	return replace_file(tmp_filename.c_str(), wav_filename, ok);
+}
+
+// Writes the file through a temporary name, so an interrupted write never leaves a partial file behind.
+static bool write_file_atomic(const uint8_t * data, size_t size, const char * filename)
+{
+	std::string tmp_filename = std::string(filename) + ".tmp";
+
+	FILE * fp = fopen(tmp_filename.c_str(), "wb");
+	if (fp == NULL) {
+		return false;
+	}
+
+	bool ok = fwrite(data, size, 1, fp) == 1;
+	if (fclose(fp) != 0) {
+		ok = false;
+	}
+	return replace_file(tmp_filename.c_str(), filename, ok);
+}
+
+// Stores a sample blob under its content hash. Returns 1 if written, 0 if an intact blob
+// was already there, and -1 on error. A blob of the wrong length is rewritten.
+static int store_blob(const uint8_t * data, uint32_t size, const char * blob_filename)
+{
+	if (path_getfilesize(blob_filename) == (off_t)size) {
+		return 0;
+	}
+	return write_file_atomic(data, size, blob_filename) ? 1 : -1;
+}
+
+struct SampleScan {
+	bool ok;
+	uint8_t dir;
+	std::vector<BRR::Sample> samples;
+	std::vector<uint64_t> hashes;
+};
+
+static int samples_main(int argc, char *argv[])
+{
+	unsigned int num_threads = Parallel::DefaultThreadCount();
+	std::string storedir;
+	bool export_wav = false;
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "--wav") == 0) {
+			export_wav = true;
+		}
+		else if (strcmp(argv[argi], "-j") == 0 || strcmp(argv[argi], "-o") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (argv[argi][1] == 'j') {
+				if (!parse_thread_count(argv[argi + 1], num_threads)) {
+					return EXIT_FAILURE;
+				}
+			}
+			else {
+				storedir = argv[argi + 1];
+			}
+			argi++;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (argi == argc) {
+		fprintf(stderr, "Error: No input files\n");
+		return EXIT_FAILURE;
+	}
+
+	if (export_wav && storedir.empty()) {
+		fprintf(stderr, "Error: \"--wav\" requires \"-o\"\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::string> filenames(argv + argi, argv + argc);
+	std::vector<SampleScan> scans(filenames.size());
+
+	// hashes already in the store or claimed by another thread
+	std::mutex store_mutex;
+	std::set<uint64_t> stored_hashes;
+	std::atomic<int> num_store_errors(0);
+	std::atomic<int> num_written(0);
+
+	Parallel::For(filenames.size(), num_threads, [&](size_t i) {
+		SampleScan & scan = scans[i];
+		scan.ok = false;
+
+		SPCFile * spc = SPCFile::Load(filenames[i]);
+		if (spc == NULL) {
+			return;
+		}
+
+		scan.ok = true;
+		scan.dir = spc->dsp[SPCDSP::R_DIR];
+		BRR::ReadDirectory(spc->ram, scan.dir, scan.samples);
+
+		for (auto itr = scan.samples.begin(); itr != scan.samples.end(); ++itr) {
+			const uint8_t * data = &spc->ram[itr->start];
+			uint64_t hash = Hash::FNV1a64(data, itr->size);
+			scan.hashes.push_back(hash);
+
+			if (storedir.empty()) {
+				continue;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(store_mutex);
+				if (!stored_hashes.insert(hash).second) {
+					continue;
+				}
+			}
+
+			char blob_filename[PATH_MAX];
+			snprintf(blob_filename, sizeof(blob_filename), "%s" PATH_SEPARATOR_STR "%016llx.brr", storedir.c_str(), (unsigned long long)hash);
+			int stored = store_blob(data, itr->size, blob_filename);
+			if (stored < 0) {
+				num_store_errors++;
+				continue;
+			}
+			if (stored == 0) {
+				continue;
+			}
+			num_written++;
+
+			if (export_wav && !export_brr_wav(data, itr->size, blob_filename)) {
+				num_store_errors++;
+			}
+		}
+
+		delete spc;
+	});
+
+	int num_errors = 0;
+	size_t num_samples = 0;
+	std::set<uint64_t> unique_hashes;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		const SampleScan & scan = scans[i];
+		if (!scan.ok) {
+			printf("%s: load error\n", filenames[i].c_str());
+			num_errors++;
+			continue;
+		}
+
+		printf("%s: %d samples in directory $%02x00\n", filenames[i].c_str(), (int)scan.samples.size(), scan.dir);
+		for (size_t j = 0; j < scan.samples.size(); j++) {
+			const BRR::Sample & sample = scan.samples[j];
+			printf("  %02x $%04x %5u bytes", sample.srcn, sample.start, sample.size);
+			if (sample.loops) {
+				printf(", loop +%-5u", sample.loop - sample.start);
+			}
+			else {
+				printf("              ");
+			}
+			printf(" %016llx\n", (unsigned long long)scan.hashes[j]);
+
+			unique_hashes.insert(scan.hashes[j]);
+		}
+		num_samples += scan.samples.size();
+	}
+
+	printf("%d samples, %d unique", (int)num_samples, (int)unique_hashes.size());
+	if (!storedir.empty()) {
+		printf(", %d added to the store", (int)num_written);
+	}
+	printf("\n");
+
+	if (num_store_errors != 0) {
+		fprintf(stderr, "Error: Unable to write %d samples to \"%s\"\n", (int)num_store_errors, storedir.c_str());
+		num_errors++;
+	}
+
+	return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int identify_main(int argc, char *argv[])
+{
+	unsigned int num_threads = Parallel::DefaultThreadCount();
+	std::string db_filename;
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "-j") == 0 || strcmp(argv[argi], "--db") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (argv[argi][1] == 'j') {
+				if (!parse_thread_count(argv[argi + 1], num_threads)) {
+					return EXIT_FAILURE;
+				}
+			}
+			else {
+				db_filename = argv[argi + 1];
+			}
+			argi++;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (db_filename.empty()) {
+		fprintf(stderr, "Error: No signature database (\"--db\")\n");
+		return EXIT_FAILURE;
+	}
+
+	if (argi == argc) {
+		fprintf(stderr, "Error: No input files\n");
+		return EXIT_FAILURE;
+	}
+
+	SPCDriverDatabase db;
+	if (!db.Load(db_filename)) {
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::string> filenames(argv + argi, argv + argc);
+	std::vector<std::string> results(filenames.size());
+	FileFlags loaded(filenames.size(), false);
+	Parallel::For(filenames.size(), num_threads, [&](size_t i) {
+		SPCFile * spc = SPCFile::Load(filenames[i]);
+		if (spc == NULL) {
+			return;
+		}
+
+		std::vector<std::string> drivers = db.Identify(*spc);
+		for (auto itr = drivers.begin(); itr != drivers.end(); ++itr) {
+			if (itr != drivers.begin()) {
+				results[i] += ",";
+			}
+			results[i] += *itr;
+		}
+		delete spc;
+
+		loaded[i] = true;
+	});
+
+	int num_errors = 0;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (!loaded[i]) {
+			printf("%s: load error\n", filenames[i].c_str());
+			num_errors++;
+		}
+		else {
+			printf("%s: %s\n", filenames[i].c_str(), results[i].empty() ? "unknown" : results[i].c_str());
+		}
+	}
+
+	return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int grep_main(int argc, char *argv[])
+{
+	unsigned int num_threads = Parallel::DefaultThreadCount();
+	std::vector<std::string> dirs;
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "-j") == 0 || strcmp(argv[argi], "-r") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (argv[argi][1] == 'j') {
+				if (!parse_thread_count(argv[argi + 1], num_threads)) {
+					return EXIT_FAILURE;
+				}
+			}
+			else {
+				dirs.push_back(argv[argi + 1]);
+			}
+			argi++;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (argi == argc) {
+		fprintf(stderr, "Error: No search pattern\n");
+		return EXIT_FAILURE;
+	}
+
+	const char * p_equal = strchr(argv[argi], '=');
+	if (p_equal == NULL) {
+		fprintf(stderr, "Error: Search pattern must be field=pattern \"%s\"\n", argv[argi]);
+		return EXIT_FAILURE;
+	}
+
+	TagGrep grep;
+	std::string field(argv[argi], p_equal - argv[argi]);
+	if (!grep.SetQuery(field, p_equal + 1)) {
+		fprintf(stderr, "Error: Unknown string field \"%s\"\n", field.c_str());
+		return EXIT_FAILURE;
+	}
+	argi++;
+
+	if (argi == argc && dirs.empty()) {
+		fprintf(stderr, "Error: No input files\n");
+		return EXIT_FAILURE;
+	}
+
+	int num_errors = 0;
+	std::vector<std::string> filenames(argv + argi, argv + argc);
+	for (auto itr = dirs.begin(); itr != dirs.end(); ++itr) {
+		if (!DirectoryWalker::FindSPCFiles(*itr, num_threads, filenames)) {
+			num_errors++;
+		}
+	}
+
+	FileFlags loaded(filenames.size(), false);
+	FileFlags matched(filenames.size(), false);
+	Parallel::For(filenames.size(), num_threads, [&](size_t i) {
+		bool file_matched;
+		loaded[i] = grep.MatchFile(filenames[i], file_matched);
+		matched[i] = file_matched;
+	});
+
+	size_t num_matches = 0;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (!loaded[i]) {
+			fprintf(stderr, "%s: load error\n", filenames[i].c_str());
+			num_errors++;
+		}
+		else if (matched[i]) {
+			printf("%s\n", filenames[i].c_str());
+			num_matches++;
+		}
+	}
+
+	return (num_errors == 0 && num_matches != 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int index_main(int argc, char *argv[])
+{
+	unsigned int num_threads = Parallel::DefaultThreadCount();
+	std::vector<std::string> dirs;
+	std::string index_filename;
+	std::string journal_filename;
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "--journal") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			journal_filename = argv[argi + 1];
+			argi++;
+		}
+		else if (strcmp(argv[argi], "-j") == 0 || strcmp(argv[argi], "-r") == 0 || strcmp(argv[argi], "-o") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (argv[argi][1] == 'j') {
+				if (!parse_thread_count(argv[argi + 1], num_threads)) {
+					return EXIT_FAILURE;
+				}
+			}
+			else if (argv[argi][1] == 'r') {
+				dirs.push_back(argv[argi + 1]);
+			}
+			else {
+				index_filename = argv[argi + 1];
+			}
+			argi++;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (index_filename.empty()) {
+		fprintf(stderr, "Error: No index file (\"-o\")\n");
+		return EXIT_FAILURE;
+	}
+
+	if (argi == argc && dirs.empty()) {
+		fprintf(stderr, "Error: No input files\n");
+		return EXIT_FAILURE;
+	}
+
+	int num_errors = 0;
+	std::vector<std::string> filenames(argv + argi, argv + argc);
+	for (auto itr = dirs.begin(); itr != dirs.end(); ++itr) {
+		if (!DirectoryWalker::FindSPCFiles(*itr, num_threads, filenames)) {
+			num_errors++;
+		}
+	}
+
+	// index the tags as they will be once the journal is compacted
+	TagJournal journal(journal_filename);
+	if (!journal_filename.empty() && !journal.Load()) {
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::string> values(filenames.size() * TagIndex::FIELD_COUNT);
+	FileFlags loaded(filenames.size(), false);
+	Parallel::For(filenames.size(), num_threads, [&](size_t i) {
+		SPCFile * spc = SPCFile::Load(filenames[i]);
+		if (spc == NULL) {
+			return;
+		}
+
+		journal.Apply(filenames[i], *spc);
+
+		TagIndex::GetFields(*spc, &values[i * TagIndex::FIELD_COUNT]);
+		delete spc;
+
+		loaded[i] = true;
+	});
+
+	TagIndex::Builder builder;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (!loaded[i]) {
+			printf("%s: load error\n", filenames[i].c_str());
+			num_errors++;
+		}
+		else {
+			builder.Add(filenames[i], &values[i * TagIndex::FIELD_COUNT]);
+		}
+	}
+
+	if (!builder.Write(index_filename)) {
+		return EXIT_FAILURE;
+	}
+	printf("%s: %lu files, %lu distinct strings\n", index_filename.c_str(),
+		(unsigned long)builder.GetFileCount(), (unsigned long)(builder.GetStringCount() - 1));
+
+	return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int search_main(int argc, char *argv[])
+{
+	bool fuzzy = false;
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "--fuzzy") == 0) {
+			fuzzy = true;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (argc - argi != 2) {
+		fprintf(stderr, "Error: Too few arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	TagIndex index;
+	if (!index.Open(argv[argi])) {
+		return EXIT_FAILURE;
+	}
+
+	// a known field name before '=' selects the field, anything else is part of the pattern
+	std::string pattern(argv[argi + 1]);
+	TagIndex::Field field = TagIndex::FIELD_ANY;
+	std::string::size_type offset_equal = pattern.find('=');
+	if (offset_equal != std::string::npos && TagIndex::ParseField(pattern.substr(0, offset_equal), field)) {
+		pattern = pattern.substr(offset_equal + 1);
+	}
+
+	size_t num_matches;
+	if (fuzzy) {
+		std::vector<std::pair<uint32_t, double> > files;
+		index.SearchFuzzy(pattern, field, 0.5, files);
+		for (auto itr = files.begin(); itr != files.end(); ++itr) {
+			printf("%.2f %s\n", itr->second, index.GetFilename(itr->first).c_str());
+		}
+		num_matches = files.size();
+	}
+	else {
+		std::vector<uint32_t> files;
+		index.Search(pattern, field, files);
+		for (auto itr = files.begin(); itr != files.end(); ++itr) {
+			printf("%s\n", index.GetFilename(*itr).c_str());
+		}
+		num_matches = files.size();
+	}
+
+	return (num_matches != 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Writes the pending edits of a journal into the files, in path order, and removes them from the journal.
+static int compact_main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		fprintf(stderr, "Error: Too few arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	// locked until Rewrite, so no edit can be appended between reading and replacing the journal
+	TagJournal journal(argv[1]);
+	if (!journal.Lock() || !journal.Load()) {
+		return EXIT_FAILURE;
+	}
+
+	int num_errors = 0;
+	std::vector<std::string> failed_filenames;
+	std::vector<std::string> filenames = journal.GetFilenames();
+	for (auto itr = filenames.begin(); itr != filenames.end(); ++itr) {
+		const std::string & filename = *itr;
+		Stats::AddFile();
+
+		SPCFile * spc = SPCFile::Load(filename);
+		if (spc == NULL) {
+			printf("%s: load error\n", filename.c_str());
+			failed_filenames.push_back(filename);
+			num_errors++;
+			continue;
+		}
+
+		if (!journal.Apply(filename, *spc)) {
+			printf("%s: tag error\n", filename.c_str());
+			failed_filenames.push_back(filename);
+			num_errors++;
+			delete spc;
+			continue;
+		}
+
+		if (!spc->Save(filename)) {
+			printf("%s: save error\n", filename.c_str());
+			failed_filenames.push_back(filename);
+			num_errors++;
+			delete spc;
+			continue;
+		}
+
+		printf("%s: ok\n", filename.c_str());
+		delete spc;
+	}
+
+	// the edits that could not be written stay for the next run
+	if (!journal.Rewrite(failed_filenames)) {
+		num_errors++;
+	}
+
+	return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int hash_main(int argc, char *argv[])
+{
+	unsigned int num_threads = Parallel::DefaultThreadCount();
+	std::vector<std::string> dirs;
+	std::string manifest_filename;
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "-j") == 0 || strcmp(argv[argi], "-r") == 0 || strcmp(argv[argi], "-o") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (argv[argi][1] == 'j') {
+				if (!parse_thread_count(argv[argi + 1], num_threads)) {
+					return EXIT_FAILURE;
+				}
+			}
+			else if (argv[argi][1] == 'r') {
+				dirs.push_back(argv[argi + 1]);
+			}
+			else {
+				manifest_filename = argv[argi + 1];
+			}
+			argi++;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (manifest_filename.empty()) {
+		fprintf(stderr, "Error: No manifest file (\"-o\")\n");
+		return EXIT_FAILURE;
+	}
+
+	if (argi == argc && dirs.empty()) {
+		fprintf(stderr, "Error: No input files\n");
+		return EXIT_FAILURE;
+	}
+
+	int num_errors = 0;
+	std::vector<std::string> filenames(argv + argi, argv + argc);
+	for (auto itr = dirs.begin(); itr != dirs.end(); ++itr) {
+		if (!DirectoryWalker::FindSPCFiles(*itr, num_threads, filenames)) {
+			num_errors++;
+		}
+	}
+
+	std::vector<SPCManifest::Entry> entries(filenames.size());
+	FileFlags hashed(filenames.size(), false);
+	Parallel::For(filenames.size(), num_threads, [&](size_t i) {
+		hashed[i] = SPCManifest::Compute(filenames[i], entries[i]);
+	});
+
+	std::vector<SPCManifest::Entry> hashed_entries;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (!hashed[i]) {
+			printf("%s: load error\n", filenames[i].c_str());
+			num_errors++;
+		}
+		else {
+			hashed_entries.push_back(entries[i]);
+		}
+	}
+
+	if (!SPCManifest::Write(manifest_filename, hashed_entries)) {
+		return EXIT_FAILURE;
+	}
+	printf("%s: %lu files\n", manifest_filename.c_str(), (unsigned long)hashed_entries.size());
+
+	return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Rehashes the files of a manifest. Tag-only changes are reported but are not failures.
+static int verify_main(int argc, char *argv[])
+{
+	unsigned int num_threads = Parallel::DefaultThreadCount();
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "-j") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (!parse_thread_count(argv[argi + 1], num_threads)) {
+				return EXIT_FAILURE;
+			}
+			argi++;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (argc - argi != 1) {
+		fprintf(stderr, "Error: Too few arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<SPCManifest::Entry> expected;
+	if (!SPCManifest::Read(argv[argi], expected)) {
+		return EXIT_FAILURE;
+	}
+
+	std::vector<SPCManifest::Entry> actual(expected.size());
+	FileFlags hashed(expected.size(), false);
+	Parallel::For(expected.size(), num_threads, [&](size_t i) {
+		hashed[i] = SPCManifest::Compute(expected[i].filename, actual[i]);
+	});
+
+	int num_errors = 0;
+	for (size_t i = 0; i < expected.size(); i++) {
+		const std::string & filename = expected[i].filename;
+		if (!hashed[i]) {
+			printf("%s: load error\n", filename.c_str());
+			num_errors++;
+			continue;
+		}
+
+		std::string changed_sections;
+		bool payload_changed = false;
+		for (int section = 0; section < SPCManifest::SECTION_COUNT; section++) {
+			if (actual[i].hashes[section] != expected[i].hashes[section]) {
+				changed_sections += ' ';
+				changed_sections += SPCManifest::GetSectionName(section);
+				if (!SPCManifest::IsTagSection(section)) {
+					payload_changed = true;
+				}
+			}
+		}
+
+		if (payload_changed) {
+			printf("%s: FAILED:%s\n", filename.c_str(), changed_sections.c_str());
+			num_errors++;
+		}
+		else if (!changed_sections.empty()) {
+			printf("%s: tags changed:%s\n", filename.c_str(), changed_sections.c_str());
+		}
+		else {
+			printf("%s: ok\n", filename.c_str());
+		}
+	}
+
+	return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static unsigned int get_register(const SPCFile & spc, const char * name)
+{
+	switch (name[0]) {
+	case 'a':
+		return spc.regs.a;
+	case 'x':
+		return spc.regs.x;
+	case 'y':
+		return spc.regs.y;
+	default:
+		return (strcmp(name, "pc") == 0) ? spc.regs.pc : (strcmp(name, "psw") == 0) ? spc.regs.psw : spc.regs.sp;
+	}
 }
 
-void replace_all(std::string& str, const std::string& from, const std::string& to)
+// Prints every difference, down to the bytes of each differing RAM page.
+static void print_diff(const SPCFile & a, const SPCFile & b, const SPCDiff::Result & result)
 {
-	std::string::size_type pos = 0;
-	while (pos = str.find(from, pos), pos != std::string::npos) {
-		str.replace(pos, from.length(), to);
-		pos += to.length();
+	for (auto itr = result.registers.begin(); itr != result.registers.end(); ++itr) {
+		printf("regs %s: $%02X -> $%02X\n", *itr, get_register(a, *itr), get_register(b, *itr));
+	}
+
+	if (!result.tags.empty()) {
+		std::map<std::string, std::string> a_tags = a.ExportPSFTag(true);
+		std::map<std::string, std::string> b_tags = b.ExportPSFTag(true);
+		for (auto itr = result.tags.begin(); itr != result.tags.end(); ++itr) {
+			auto a_itr = a_tags.find(*itr);
+			auto b_itr = b_tags.find(*itr);
+			printf("tag %s: %s%s%s -> %s%s%s\n", itr->c_str(),
+				(a_itr != a_tags.end()) ? "\"" : "", (a_itr != a_tags.end()) ? a_itr->second.c_str() : "(none)", (a_itr != a_tags.end()) ? "\"" : "",
+				(b_itr != b_tags.end()) ? "\"" : "", (b_itr != b_tags.end()) ? b_itr->second.c_str() : "(none)", (b_itr != b_tags.end()) ? "\"" : "");
+		}
+	}
+
+	for (auto itr = result.dsp_registers.begin(); itr != result.dsp_registers.end(); ++itr) {
+		printf("dsp $%02X: $%02X -> $%02X\n", *itr, a.dsp[*itr], b.dsp[*itr]);
+	}
+
+	for (auto itr = result.extra_ram_offsets.begin(); itr != result.extra_ram_offsets.end(); ++itr) {
+		printf("extra_ram $%02X: $%02X -> $%02X\n", *itr, a.extra_ram[*itr], b.extra_ram[*itr]);
+	}
+
+	for (auto itr = result.ram_pages.begin(); itr != result.ram_pages.end(); ++itr) {
+		size_t page_offset = *itr * SPCDiff::PAGE_SIZE;
+		size_t first_offset;
+		size_t count = SPCDiff::CountDifferences(&a.ram[page_offset], &b.ram[page_offset], SPCDiff::PAGE_SIZE, first_offset);
+		printf("ram page $%02X: %lu bytes differ, first at $%04X\n", *itr, (unsigned long)count, (unsigned int)(page_offset + first_offset));
 	}
 }
 
-static void usage(const char * progname)
+// One line per file: what kind of data differs and how much of it.
+static std::string summarize_diff(const SPCDiff::Result & result)
 {
-	printf("%s %s\n", APP_NAME, APP_VER);
-	printf("<%s>\n", APP_URL);
-	printf("\n");
-	printf("Usage: `%s [-tf] [-variable=value ...] spc-file(s)`\n", progname);
-	printf("\n");
+	if (result.IsEmpty()) {
+		return "identical";
+	}
+
+	std::string summary;
+	char s[64];
+	if (!result.registers.empty()) {
+		summary += "regs";
+		for (auto itr = result.registers.begin(); itr != result.registers.end(); ++itr) {
+			summary += ' ';
+			summary += *itr;
+		}
+	}
+	if (!result.tags.empty()) {
+		summary += summary.empty() ? "tags" : ", tags";
+		for (auto itr = result.tags.begin(); itr != result.tags.end(); ++itr) {
+			summary += ' ';
+			summary += *itr;
+		}
+	}
+	if (!result.dsp_registers.empty()) {
+		sprintf(s, "%s%lu dsp registers", summary.empty() ? "" : ", ", (unsigned long)result.dsp_registers.size());
+		summary += s;
+	}
+	if (!result.extra_ram_offsets.empty()) {
+		sprintf(s, "%s%lu extra_ram bytes", summary.empty() ? "" : ", ", (unsigned long)result.extra_ram_offsets.size());
+		summary += s;
+	}
+	if (!result.ram_pages.empty()) {
+		sprintf(s, "%s%lu ram pages", summary.empty() ? "" : ", ", (unsigned long)result.ram_pages.size());
+		summary += s;
+	}
+	return summary;
+}
+
+// Compares one file with one other file in detail, or with many files (and directories) one line each.
+static int diff_main(int argc, char *argv[])
+{
+	unsigned int num_threads = Parallel::DefaultThreadCount();
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "-j") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (!parse_thread_count(argv[argi + 1], num_threads)) {
+				return EXIT_FAILURE;
+			}
+			argi++;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (argc - argi < 2) {
+		fprintf(stderr, "Error: Too few arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	SPCFile * reference = SPCFile::Load(argv[argi]);
+	if (reference == NULL) {
+		printf("%s: load error\n", argv[argi]);
+		return EXIT_FAILURE;
+	}
+
+	int num_errors = 0;
+	std::vector<std::string> filenames;
+	bool detailed = argc - argi == 2 && !path_isdir(argv[argi + 1]);
+	for (int i = argi + 1; i < argc; i++) {
+		if (path_isdir(argv[i])) {
+			if (!DirectoryWalker::FindSPCFiles(argv[i], num_threads, filenames)) {
+				num_errors++;
+			}
+		}
+		else {
+			filenames.push_back(argv[i]);
+		}
+	}
+
+	if (detailed) {
+		SPCFile * spc = SPCFile::Load(filenames[0]);
+		if (spc == NULL) {
+			printf("%s: load error\n", filenames[0].c_str());
+			delete reference;
+			return EXIT_FAILURE;
+		}
+
+		SPCDiff::Result result;
+		SPCDiff::Compare(*reference, *spc, result);
+		print_diff(*reference, *spc, result);
+		delete spc;
+		delete reference;
+
+		return result.IsEmpty() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	std::vector<std::string> summaries(filenames.size());
+	FileFlags identical(filenames.size(), false);
+	Parallel::For(filenames.size(), num_threads, [&](size_t i) {
+		SPCFile * spc = SPCFile::Load(filenames[i]);
+		if (spc == NULL) {
+			return;
+		}
+
+		SPCDiff::Result result;
+		SPCDiff::Compare(*reference, *spc, result);
+		summaries[i] = summarize_diff(result);
+		identical[i] = result.IsEmpty();
+		delete spc;
+	});
+	delete reference;
+
+	size_t num_different = 0;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (summaries[i].empty()) {
+			printf("%s: load error\n", filenames[i].c_str());
+			num_errors++;
+		}
+		else {
+			printf("%s: %s\n", filenames[i].c_str(), summaries[i].c_str());
+			if (!identical[i]) {
+				num_different++;
+			}
+		}
+	}
+
+	return (num_errors == 0 && num_different == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Rewrites the string tags of each file as UTF-8, converting Shift-JIS and Latin-1 and trimming spaces.
+static int normalize_main(int argc, char *argv[])
+{
+	static const struct {
+		const char * name;
+		SPCFile::XID6ItemId id;
+	} string_tags[] = {
+		{ "title", SPCFile::XID6_SONG_NAME },
+		{ "game", SPCFile::XID6_GAME_NAME },
+		{ "artist", SPCFile::XID6_ARTIST_NAME },
+		{ "snsfby", SPCFile::XID6_DUMPER_NAME },
+		{ "comment", SPCFile::XID6_COMMENT },
+		{ "soundtrack", SPCFile::XID6_OST_TITLE },
+		{ "copyright", SPCFile::XID6_PUBLISHER_NAME }
+	};
+
+	unsigned int num_threads = Parallel::DefaultThreadCount();
+	std::vector<std::string> dirs;
+	bool dry_run = false;
+
+	int argi = 1;
+	while (argi < argc && argv[argi][0] == '-')
+	{
+		if (strcmp(argv[argi], "-n") == 0) {
+			dry_run = true;
+		}
+		else if (strcmp(argv[argi], "-j") == 0 || strcmp(argv[argi], "-r") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (argv[argi][1] == 'j') {
+				if (!parse_thread_count(argv[argi + 1], num_threads)) {
+					return EXIT_FAILURE;
+				}
+			}
+			else {
+				dirs.push_back(argv[argi + 1]);
+			}
+			argi++;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+
+		argi++;
+	}
+
+	if (argi == argc && dirs.empty()) {
+		fprintf(stderr, "Error: No input files\n");
+		return EXIT_FAILURE;
+	}
+
+	int num_errors = 0;
+	std::vector<std::string> filenames(argv + argi, argv + argc);
+	for (auto itr = dirs.begin(); itr != dirs.end(); ++itr) {
+		if (!DirectoryWalker::FindSPCFiles(*itr, num_threads, filenames)) {
+			num_errors++;
+		}
+	}
+
+	// per file: the changed tags, or the error
+	std::vector<std::string> reports(filenames.size());
+	FileFlags failed(filenames.size(), false);
+	Parallel::For(filenames.size(), num_threads, [&](size_t i) {
+		SPCFile * spc = SPCFile::Load(filenames[i]);
+		if (spc == NULL) {
+			reports[i] = "load error";
+			failed[i] = true;
+			return;
+		}
+
+		std::string report;
+		std::string normalized;
+		for (size_t tag = 0; tag < sizeof(string_tags) / sizeof(string_tags[0]); tag++) {
+			std::string value = spc->GetStringTag(string_tags[tag].id);
+			TextEncoding::Encoding encoding = TextEncoding::NormalizeToUTF8(value, normalized);
+			if (normalized == value) {
+				continue;
+			}
+
+			spc->SetStringTag(string_tags[tag].id, normalized);
+			report += report.empty() ? "" : ", ";
+			report += string_tags[tag].name;
+			report += (encoding == TextEncoding::ENCODING_UTF8) ? " (trimmed)" : (encoding == TextEncoding::ENCODING_SHIFT_JIS) ? " (Shift-JIS)" : " (Latin-1)";
+		}
+
+		if (!report.empty() && !dry_run && !spc->Save(filenames[i])) {
+			report = "save error";
+			failed[i] = true;
+		}
+		reports[i].swap(report);
+		delete spc;
+	});
+
+	size_t num_changed = 0;
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (failed[i]) {
+			num_errors++;
+		}
+		else if (!reports[i].empty()) {
+			num_changed++;
+		}
+		else {
+			continue;
+		}
+		printf("%s: %s\n", filenames[i].c_str(), reports[i].c_str());
+	}
+	printf("%lu of %lu files %s\n", (unsigned long)num_changed, (unsigned long)filenames.size(), dry_run ? "to change" : "changed");
+
+	return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Loads the files in parallel and writes their tags to stdout in the order given,
+// each line as soon as it and all lines before it are ready. Returns the number of load errors.
+static int dump_tags(const std::vector<std::string> & filenames, const TagJournal * journal, TagDump::Format format)
+{
+	static char stdout_buffer[0x10000];
+	setvbuf(stdout, stdout_buffer, _IOFBF, sizeof(stdout_buffer));
+
+	std::string header;
+	TagDump::AppendHeader(format, header);
+	fwrite(header.data(), 1, header.size(), stdout);
+
+	std::vector<std::string> lines(filenames.size());
+	std::vector<uint8_t> ready(filenames.size(), 0);
+	size_t next_line = 0;
+	std::mutex output_mutex;
+	std::atomic<int> num_errors(0);
+
+	Parallel::For(filenames.size(), Parallel::DefaultThreadCount(), [&](size_t i) {
+		const std::string & filename = filenames[i];
+		Stats::AddFile();
+		Trace::FileScope trace_scope(filename);
+
+		std::string line;
+		SPCFile * spc = SPCFile::Load(filename);
+		if (spc != NULL) {
+			if (journal != NULL) {
+				journal->Apply(filename, *spc);
+			}
+			TagDump::AppendFile(format, filename, *spc, line);
+			delete spc;
+		}
+		else {
+			fprintf(stderr, "%s: load error\n", filename.c_str());
+			num_errors++;
+		}
+
+		std::lock_guard<std::mutex> lock(output_mutex);
+		lines[i].swap(line);
+		ready[i] = 1;
+		for (; next_line < filenames.size() && ready[next_line]; next_line++) {
+			fwrite(lines[next_line].data(), 1, lines[next_line].size(), stdout);
+			std::string().swap(lines[next_line]);
+		}
+	});
+
+	fflush(stdout);
+	return num_errors;
 }
 
 int main(int argc, char *argv[])
@@ -50,15 +1704,94 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (strcmp(argv[1], "render") == 0) {
+		return render_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "activity") == 0) {
+		return activity_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "samples") == 0) {
+		return samples_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "identify") == 0) {
+		return identify_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "grep") == 0) {
+		return grep_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "index") == 0) {
+		return index_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "search") == 0) {
+		return search_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "compact") == 0) {
+		return compact_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "hash") == 0) {
+		return hash_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "verify") == 0) {
+		return verify_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "diff") == 0) {
+		return diff_main(argc - 1, argv + 1);
+	}
+	if (strcmp(argv[1], "normalize") == 0) {
+		return normalize_main(argc - 1, argv + 1);
+	}
+
 	std::map<std::string, std::string> opt_tags;
 	bool title_from_filename = false;
+	bool autovolume = false;
+	bool stats_json = false;
+	bool dump = false;
+	TagDump::Format dump_format = TagDump::FORMAT_NDJSON;
+	std::vector<std::string> dirs;
+	TagJournal * journal = NULL;
 
 	int argi = 1;
 	while (argi < argc && argv[argi][0] == '-')
 	{
 		char * p_equal = strchr(argv[argi], '=');
 
-		if (p_equal != NULL) {
+		if (strcmp(argv[argi], "--stats") == 0) {
+			Stats::Enable();
+		}
+		else if (strcmp(argv[argi], "--stats=json") == 0) {
+			Stats::Enable();
+			stats_json = true;
+		}
+		else if (strncmp(argv[argi], "--format=", 9) == 0) {
+			if (!TagDump::ParseFormat(argv[argi] + 9, dump_format)) {
+				fprintf(stderr, "Error: Unknown format \"%s\"\n", argv[argi] + 9);
+				return EXIT_FAILURE;
+			}
+			dump = true;
+		}
+		else if (strcmp(argv[argi], "--trace") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			if (!Trace::Start(argv[argi + 1])) {
+				fprintf(stderr, "Error: Unable to open trace output \"%s\"\n", argv[argi + 1]);
+				return EXIT_FAILURE;
+			}
+			argi++;
+		}
+		else if (strcmp(argv[argi], "--journal") == 0) {
+			if (argi + 1 >= argc) {
+				fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+				return EXIT_FAILURE;
+			}
+
+			delete journal;
+			journal = new TagJournal(argv[argi + 1]);
+			argi++;
+		}
+		else if (p_equal != NULL) {
 			// tag option
 			std::string name(argv[argi], 1, p_equal - argv[argi] - 1);
 			std::string value(p_equal + 1);
@@ -73,6 +1806,18 @@ int main(int argc, char *argv[])
 			else if (strcmp(argv[argi], "-tf") == 0) {
 				title_from_filename = true;
 			}
+			else if (strcmp(argv[argi], "-autovolume") == 0) {
+				autovolume = true;
+			}
+			else if (strcmp(argv[argi], "-r") == 0) {
+				if (argi + 1 >= argc) {
+					fprintf(stderr, "Error: Too few arguments for \"%s\"\n", argv[argi]);
+					return EXIT_FAILURE;
+				}
+
+				dirs.push_back(argv[argi + 1]);
+				argi++;
+			}
 			else {
 				fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
 				return EXIT_FAILURE;
@@ -82,24 +1827,76 @@ int main(int argc, char *argv[])
 		argi++;
 	}
 
-	int argnum = argc - argi;
-	if (argnum == 0) {
+	if (argi == argc && dirs.empty()) {
 		fprintf(stderr, "Error: No input files\n");
 		return EXIT_FAILURE;
 	}
 
-	if (opt_tags.size() != 0) {
+	int num_errors = 0;
+	std::vector<std::string> filenames(argv + argi, argv + argc);
+	for (auto itr = dirs.begin(); itr != dirs.end(); ++itr) {
+		if (!DirectoryWalker::FindSPCFiles(*itr, Parallel::DefaultThreadCount(), filenames)) {
+			num_errors++;
+		}
+	}
+
+	if (journal != NULL && !journal->Load()) {
+		delete journal;
+		return EXIT_FAILURE;
+	}
+
+	if (dump) {
+		if (opt_tags.size() != 0 || title_from_filename || autovolume) {
+			fprintf(stderr, "Error: --format cannot be combined with tag changes\n");
+			return EXIT_FAILURE;
+		}
+
+		num_errors += dump_tags(filenames, journal, dump_format);
+		delete journal;
+
+		if (!Trace::Finish()) {
+			fprintf(stderr, "Error: Unable to write trace output\n");
+			num_errors++;
+		}
+
+		if (Stats::IsEnabled()) {
+			if (stats_json) {
+				Stats::PrintJSON(stderr);
+			}
+			else {
+				Stats::PrintSummary(stderr);
+			}
+		}
+
+		return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// the title comes from each filename instead
+	if (title_from_filename) {
+		opt_tags.erase("title");
+	}
+
+	SPCFile::TagPatch patch;
+	if (!patch.Compile(opt_tags)) {
+		return EXIT_FAILURE;
+	}
+
+	bool modify = !patch.IsEmpty() || title_from_filename || autovolume;
+	if (modify) {
 		printf("-----replacing variables-----\n");
 
 		if (title_from_filename) {
 			printf("title=[from filename]\n");
 		}
+		if (autovolume) {
+			printf("volume=[auto]\n");
+		}
 
 		for (auto itr = opt_tags.begin(); itr != opt_tags.end(); ++itr) {
 			const std::string & name = (*itr).first;
 			const std::string & value = (*itr).second;
 
-			if (!title_from_filename || name != "title") {
+			if (!autovolume || name != "volume") {
 				printf("%s=%s\n", name.c_str(), value.c_str());
 			}
 		}
@@ -107,9 +1904,19 @@ int main(int argc, char *argv[])
 		printf("-----------------------------\n");
 	}
 
-	int num_errors = 0;
-	for (; argi < argc; argi++) {
-		std::string filename(argv[argi]);
+	std::map<std::string, uint32_t> auto_volumes;
+	if (autovolume) {
+		measure_autovolume(filenames, journal, patch, auto_volumes);
+	}
+
+	// the journal fields of the command line tags, the same for every file
+	std::string journal_tag_fields;
+	TagLine::AppendTags(journal_tag_fields, opt_tags);
+
+	for (auto itr = filenames.begin(); itr != filenames.end(); ++itr) {
+		const std::string & filename = *itr;
+		Stats::AddFile();
+		Trace::FileScope trace_scope(filename);
 
 		SPCFile * spc = SPCFile::Load(filename);
 		if (spc == NULL) {
@@ -118,7 +1925,15 @@ int main(int argc, char *argv[])
 			continue;
 		}
 
-		std::map<std::string, std::string> psf_tags(opt_tags);
+		// show (and edit) the tags with the pending edits
+		if (journal != NULL) {
+			journal->Apply(filename, *spc);
+		}
+
+		if (modify) {
+			patch.Apply(*spc);
+		}
+
 		if (title_from_filename) {
 			std::string title(filename);
 
@@ -142,18 +1957,36 @@ int main(int argc, char *argv[])
 			std::string::iterator new_end = std::unique(title.begin(), title.end(), both_are_spaces);
 			title.erase(new_end, title.end());
 
-			psf_tags["title"] = title;
+			spc->SetStringTag(SPCFile::XID6_SONG_NAME, title);
 		}
 
-		if (psf_tags.size() != 0) {
-			if (!spc->ImportPSFTag(psf_tags)) {
-				printf("%s: tag error\n", filename.c_str());
-				num_errors++;
-				delete spc;
-				continue;
+		if (modify) {
+			auto volume_itr = auto_volumes.find(filename);
+			if (volume_itr != auto_volumes.end()) {
+				spc->SetIntegerTag(SPCFile::XID6_VOLUME, volume_itr->second, 4);
 			}
 
-			if (!spc->Save(filename)) {
+			if (journal != NULL) {
+				// record the edit instead of rewriting the file;
+				// these per-file tags replace command line tags of the same name
+				std::map<std::string, std::string> psf_tags;
+				if (title_from_filename) {
+					psf_tags["title"] = spc->GetStringTag(SPCFile::XID6_SONG_NAME);
+				}
+				if (volume_itr != auto_volumes.end()) {
+					char s[32];
+					sprintf(s, "%.17g", (double)volume_itr->second / 65536);
+					psf_tags["volume"] = s;
+				}
+
+				if ((!journal_tag_fields.empty() || !psf_tags.empty()) && !journal->Append(filename, journal_tag_fields, psf_tags)) {
+					printf("%s: journal error\n", filename.c_str());
+					num_errors++;
+					delete spc;
+					continue;
+				}
+			}
+			else if (!spc->Save(filename)) {
 				printf("%s: save error\n", filename.c_str());
 				num_errors++;
 				delete spc;
@@ -164,20 +1997,9 @@ int main(int argc, char *argv[])
 		}
 		else {
 			// Put tag variables for SPC to SNSF tagging
-			std::map<std::string, std::string> current_tags = spc->ExportPSFTag(false);
-
-			printf("spcpoint");
-			for (auto itr = current_tags.begin(); itr != current_tags.end(); ++itr) {
-				const std::string & name = (*itr).first;
-				const std::string & value = (*itr).second;
-
-				if (name.find_first_of(" ") != std::string::npos || value.find_first_of(" ") != std::string::npos) {
-					printf(" \"-%s=%s\"", name.c_str(), value.c_str());
-				}
-				else {
-					printf(" -%s=%s", name.c_str(), value.c_str());
-				}
-			}
+			TagArgumentPrinter printer;
+			fputs("spcpoint", stdout);
+			spc->VisitPSFTags(false, printer);
 
 			if (filename.find_first_of(" ") != std::string::npos) {
 				printf(" \"%s\"", filename.c_str());
@@ -191,5 +2013,27 @@ int main(int argc, char *argv[])
 		delete spc;
 	}
 
+	if (journal != NULL) {
+		if (!journal->Close()) {
+			fprintf(stderr, "Error: Unable to write journal \"%s\"\n", journal->GetFilename().c_str());
+			num_errors++;
+		}
+		delete journal;
+	}
+
+	if (!Trace::Finish()) {
+		fprintf(stderr, "Error: Unable to write trace output\n");
+		num_errors++;
+	}
+
+	if (Stats::IsEnabled()) {
+		if (stats_json) {
+			Stats::PrintJSON(stderr);
+		}
+		else {
+			Stats::PrintSummary(stderr);
+		}
+	}
+
 	return (num_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
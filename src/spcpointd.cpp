@@ -0,0 +1,506 @@
+/**
+ * spcpointd: resident SPC tag server on a Unix domain socket.
+ *
+ * Requests and responses are single lines of tab-separated fields. Tabs,
+ * newlines and backslashes inside a field are escaped as \t, \n and \\.
+ * Clients may pipeline any number of requests; responses come back in order.
+ *
+ *   GET <path>                      OK <name>=<value> ...
+ *   SET <path> <name>=<value> ...   OK
+ *   STATS                           OK hits=<n> misses=<n> entries=<n>
+ *   PING                            OK
+ *   QUIT                            (connection is closed)
+ *
+ * Errors are reported as "ERR <message>". A client that lets more than
+ * MAX_CLIENT_OUTPUT bytes of responses pile up unread is disconnected.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <unordered_map>
+
+#include "SPCFile.h"
+#include "TagLine.h"
+
+#define APP_NAME    "spcpointd"
+#define APP_VER     "[2015-04-16]"
+#define APP_URL     "http://github.com/loveemu/spcpoint"
+
+#define DEFAULT_SOCKET_PATH     "/tmp/spcpointd.sock"
+#define DEFAULT_CACHE_ENTRIES   65536
+#define MAX_REQUEST_LINE        65536
+#define MAX_CLIENT_OUTPUT       0x400000
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+struct TagCacheEntry {
+	struct timespec mtime;
+	off_t size;
+	std::map<std::string, std::string> psf_tags;
+	std::list<std::string>::iterator lru_position;
+};
+
+// Tag state of recently requested files, keyed by path and validated by mtime and size.
+class TagCache
+{
+public:
+	explicit TagCache(size_t max_entries) : max_entries(max_entries), hits(0), misses(0)
+	{
+	}
+
+	const TagCacheEntry * Get(const std::string & path)
+	{
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			Erase(path);
+			return NULL;
+		}
+
+		auto itr = entries.find(path);
+		if (itr != entries.end()) {
+			TagCacheEntry & entry = (*itr).second;
+			if (IsSameFile(entry, st)) {
+				lru.splice(lru.begin(), lru, entry.lru_position);
+				hits++;
+				return &entry;
+			}
+		}
+
+		misses++;
+		SPCFile * spc = SPCFile::Load(path);
+		if (spc == NULL) {
+			Erase(path);
+			return NULL;
+		}
+
+		TagCacheEntry * entry = Put(path, st, *spc);
+		delete spc;
+		return entry;
+	}
+
+	TagCacheEntry * Put(const std::string & path, const struct stat & st, const SPCFile & spc)
+	{
+		auto itr = entries.find(path);
+		if (itr == entries.end()) {
+			if (entries.size() >= max_entries && !lru.empty()) {
+				std::string oldest_path(lru.back());
+				Erase(oldest_path);
+			}
+
+			lru.push_front(path);
+			itr = entries.insert(std::make_pair(path, TagCacheEntry())).first;
+			(*itr).second.lru_position = lru.begin();
+		}
+		else {
+			lru.splice(lru.begin(), lru, (*itr).second.lru_position);
+		}
+
+		TagCacheEntry & entry = (*itr).second;
+		entry.mtime = st.st_mtim;
+		entry.size = st.st_size;
+		entry.psf_tags = spc.ExportPSFTag(true);
+		return &entry;
+	}
+
+	void Erase(const std::string & path)
+	{
+		auto itr = entries.find(path);
+		if (itr != entries.end()) {
+			lru.erase((*itr).second.lru_position);
+			entries.erase(itr);
+		}
+	}
+
+	size_t max_entries;
+	uint64_t hits;
+	uint64_t misses;
+	std::unordered_map<std::string, TagCacheEntry> entries;
+	std::list<std::string> lru;
+
+private:
+	static bool IsSameFile(const TagCacheEntry & entry, const struct stat & st)
+	{
+		return entry.size == st.st_size &&
+			entry.mtime.tv_sec == st.st_mtim.tv_sec &&
+			entry.mtime.tv_nsec == st.st_mtim.tv_nsec;
+	}
+};
+
+struct Client {
+	int fd;
+	std::string input;
+	std::string output;
+	bool closing;
+};
+
+static volatile sig_atomic_t g_terminate = 0;
+
+static void on_terminate(int)
+{
+	g_terminate = 1;
+}
+
+static void handle_get(TagCache & cache, const std::vector<std::string> & fields, std::string & out)
+{
+	if (fields.size() != 2) {
+		out += "ERR\tusage: GET <path>\n";
+		return;
+	}
+
+	const TagCacheEntry * entry = cache.Get(fields[1]);
+	if (entry == NULL) {
+		out += "ERR\tload error\n";
+		return;
+	}
+
+	out += "OK";
+	TagLine::AppendTags(out, entry->psf_tags);
+	out += '\n';
+}
+
+static void handle_set(TagCache & cache, const std::vector<std::string> & fields, std::string & out)
+{
+	if (fields.size() < 3) {
+		out += "ERR\tusage: SET <path> <name>=<value> ...\n";
+		return;
+	}
+
+	std::map<std::string, std::string> psf_tags;
+	if (!TagLine::ParseTags(fields, 2, psf_tags)) {
+		out += "ERR\tmalformed tag\n";
+		return;
+	}
+
+	for (auto itr = psf_tags.begin(); itr != psf_tags.end(); ++itr) {
+		if (!SPCFile::IsPSFTagName((*itr).first)) {
+			out += "ERR\tunknown tag\t";
+			TagLine::AppendEscaped(out, (*itr).first);
+			out += '\n';
+			return;
+		}
+	}
+
+	const std::string & path = fields[1];
+	SPCFile * spc = SPCFile::Load(path);
+	if (spc == NULL) {
+		cache.Erase(path);
+		out += "ERR\tload error\n";
+		return;
+	}
+
+	std::string messages;
+	if (!spc->ImportPSFTag(psf_tags, &messages)) {
+		if (!messages.empty() && messages[messages.size() - 1] == '\n') {
+			messages.erase(messages.size() - 1);
+		}
+		out += "ERR\ttag error\t";
+		TagLine::AppendEscaped(out, messages);
+		out += '\n';
+		delete spc;
+		return;
+	}
+
+	if (!spc->Save(path)) {
+		cache.Erase(path);
+		out += "ERR\tsave error\n";
+		delete spc;
+		return;
+	}
+
+	// refresh the entry so the next GET is served from memory
+	struct stat st;
+	if (stat(path.c_str(), &st) == 0) {
+		cache.Put(path, st, *spc);
+	}
+	else {
+		cache.Erase(path);
+	}
+
+	out += "OK\n";
+	delete spc;
+}
+
+static void handle_request(TagCache & cache, Client & client, const std::string & line)
+{
+	std::vector<std::string> fields = TagLine::Split(line.data(), line.size());
+	const std::string & command = fields[0];
+
+	if (command == "GET") {
+		handle_get(cache, fields, client.output);
+	}
+	else if (command == "SET") {
+		handle_set(cache, fields, client.output);
+	}
+	else if (command == "STATS") {
+		char s[256];
+		sprintf(s, "OK\thits=%llu\tmisses=%llu\tentries=%llu\n",
+			(unsigned long long)cache.hits, (unsigned long long)cache.misses,
+			(unsigned long long)cache.entries.size());
+		client.output += s;
+	}
+	else if (command == "PING") {
+		client.output += "OK\n";
+	}
+	else if (command == "QUIT") {
+		client.closing = true;
+	}
+	else {
+		client.output += "ERR\tunknown command\n";
+	}
+}
+
+// Handles every complete line received so far.
+static void process_input(TagCache & cache, Client & client)
+{
+	std::string::size_type start = 0;
+	std::string::size_type end;
+	while (!client.closing && (end = client.input.find('\n', start)) != std::string::npos) {
+		std::string line(client.input, start, end - start);
+		if (!line.empty() && line[line.size() - 1] == '\r') {
+			line.erase(line.size() - 1);
+		}
+
+		if (!line.empty()) {
+			handle_request(cache, client, line);
+		}
+		start = end + 1;
+	}
+	client.input.erase(0, start);
+
+	if (client.input.size() > MAX_REQUEST_LINE) {
+		client.output += "ERR\trequest too long\n";
+		client.closing = true;
+	}
+}
+
+// Removes a socket left behind by a daemon that is no longer running.
+// Anything else at the path, including a live socket, is left alone.
+static bool remove_stale_socket(const struct sockaddr_un & addr)
+{
+	struct stat st;
+	if (lstat(addr.sun_path, &st) != 0) {
+		if (errno == ENOENT) {
+			return true;
+		}
+		perror(addr.sun_path);
+		return false;
+	}
+
+	if (!S_ISSOCK(st.st_mode)) {
+		fprintf(stderr, "Error: \"%s\" exists and is not a socket\n", addr.sun_path);
+		return false;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		perror("socket");
+		return false;
+	}
+
+	bool in_use = connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) == 0;
+	close(fd);
+	if (in_use) {
+		fprintf(stderr, "Error: \"%s\" is in use by another server\n", addr.sun_path);
+		return false;
+	}
+
+	if (unlink(addr.sun_path) != 0) {
+		perror(addr.sun_path);
+		return false;
+	}
+	return true;
+}
+
+static int open_listen_socket(const char * socket_path)
+{
+	struct sockaddr_un addr;
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Error: Socket path too long\n");
+		return -1;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+
+	if (!remove_stale_socket(addr)) {
+		close(fd);
+		return -1;
+	}
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+
+	if (listen(fd, SOMAXCONN) != 0) {
+		perror("listen");
+		close(fd);
+		unlink(socket_path);
+		return -1;
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+static void usage(const char * progname)
+{
+	printf("%s %s\n", APP_NAME, APP_VER);
+	printf("<%s>\n", APP_URL);
+	printf("\n");
+	printf("Usage: `%s [--socket path] [--cache-entries n]`\n", progname);
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char * socket_path = DEFAULT_SOCKET_PATH;
+	size_t cache_entries = DEFAULT_CACHE_ENTRIES;
+
+	for (int argi = 1; argi < argc; argi++) {
+		if (strcmp(argv[argi], "--help") == 0) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		else if (strcmp(argv[argi], "--socket") == 0 && argi + 1 < argc) {
+			socket_path = argv[++argi];
+		}
+		else if (strcmp(argv[argi], "--cache-entries") == 0 && argi + 1 < argc) {
+			char * endptr;
+			long num = strtol(argv[++argi], &endptr, 10);
+			if (*endptr != '\0' || num <= 0) {
+				fprintf(stderr, "Error: Illegal number format: cache-entries\n");
+				return EXIT_FAILURE;
+			}
+			cache_entries = (size_t)num;
+		}
+		else {
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", argv[argi]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, on_terminate);
+	signal(SIGTERM, on_terminate);
+
+	int listen_fd = open_listen_socket(socket_path);
+	if (listen_fd == -1) {
+		return EXIT_FAILURE;
+	}
+
+	TagCache cache(cache_entries);
+	std::list<Client> clients;
+	std::vector<struct pollfd> pollfds;
+
+	while (!g_terminate) {
+		pollfds.clear();
+
+		struct pollfd listen_pfd = { listen_fd, POLLIN, 0 };
+		pollfds.push_back(listen_pfd);
+		for (auto itr = clients.begin(); itr != clients.end(); ++itr) {
+			struct pollfd pfd = { (*itr).fd, POLLIN, 0 };
+			if (!(*itr).output.empty()) {
+				pfd.events |= POLLOUT;
+			}
+			pollfds.push_back(pfd);
+		}
+
+		if (poll(&pollfds[0], pollfds.size(), -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll");
+			break;
+		}
+
+		size_t index = 1;
+		for (auto itr = clients.begin(); itr != clients.end(); index++) {
+			Client & client = *itr;
+			short revents = pollfds[index].revents;
+			bool drop = false;
+
+			if ((revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+				char buf[16384];
+				ssize_t len = read(client.fd, buf, sizeof(buf));
+				if (len > 0) {
+					client.input.append(buf, (size_t)len);
+					process_input(cache, client);
+				}
+				else if (len == 0 || (errno != EAGAIN && errno != EINTR)) {
+					drop = true;
+				}
+			}
+
+			if (!drop && !client.output.empty()) {
+				ssize_t len = write(client.fd, client.output.data(), client.output.size());
+				if (len > 0) {
+					client.output.erase(0, (size_t)len);
+				}
+				else if (len == -1 && errno != EAGAIN && errno != EINTR) {
+					drop = true;
+				}
+			}
+
+			// a client that pipelines requests without reading the responses
+			if (client.output.size() > MAX_CLIENT_OUTPUT) {
+				fprintf(stderr, "Error: Dropping client with %llu bytes of unread output\n",
+					(unsigned long long)client.output.size());
+				drop = true;
+			}
+
+			if (drop || (client.closing && client.output.empty())) {
+				close(client.fd);
+				itr = clients.erase(itr);
+			}
+			else {
+				++itr;
+			}
+		}
+
+		if ((pollfds[0].revents & POLLIN) != 0) {
+			int fd;
+			while ((fd = accept(listen_fd, NULL, NULL)) != -1) {
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+				Client client;
+				client.fd = fd;
+				client.closing = false;
+				clients.push_back(client);
+			}
+		}
+	}
+
+	for (auto itr = clients.begin(); itr != clients.end(); ++itr) {
+		close((*itr).fd);
+	}
+	close(listen_fd);
+	unlink(socket_path);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,31 @@
+/**
+ * Minimal assertions shared by the test programs.
+ */
+
+#ifndef CHECK_H_INCLUDED
+#define CHECK_H_INCLUDED
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int num_failures = 0;
+
+#define CHECK(expr) \
+	do { \
+		if (!(expr)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+			num_failures++; \
+		} \
+	} while (0)
+
+// Exit status for main.
+static int check_result()
+{
+	if (num_failures != 0) {
+		fprintf(stderr, "%d check(s) failed\n", num_failures);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+#endif /* !CHECK_H_INCLUDED */
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AhoCorasick.h"
+#include "check.h"
+
+typedef std::set<std::pair<size_t, size_t> > MatchSet;	// (pattern id, offset)
+
+static MatchSet find_all(const AhoCorasick & matcher, const std::string & data)
+{
+	MatchSet matches;
+	matcher.Find((const uint8_t *)data.data(), data.size(), [&](size_t id, size_t offset) {
+		matches.insert(std::make_pair(id, offset));
+	});
+	return matches;
+}
+
+static MatchSet find_all_naive(const std::vector<std::string> & patterns, const std::string & data)
+{
+	MatchSet matches;
+	for (size_t id = 0; id < patterns.size(); id++) {
+		for (size_t offset = 0; offset + patterns[id].size() <= data.size(); offset++) {
+			if (data.compare(offset, patterns[id].size(), patterns[id]) == 0) {
+				matches.insert(std::make_pair(id, offset));
+			}
+		}
+	}
+	return matches;
+}
+
+static void test_overlapping_patterns()
+{
+	// suffixes of each other, a duplicate, and patterns spanning a failed prefix
+	const char * const pattern_strings[] = { "he", "she", "his", "hers", "he", "e", "ushers" };
+	std::vector<std::string> patterns(pattern_strings, pattern_strings + sizeof(pattern_strings) / sizeof(pattern_strings[0]));
+
+	AhoCorasick matcher;
+	for (size_t i = 0; i < patterns.size(); i++) {
+		CHECK(matcher.AddPattern((const uint8_t *)patterns[i].data(), patterns[i].size()) == i);
+	}
+	matcher.Build();
+	CHECK(matcher.GetPatternCount() == patterns.size());
+
+	const std::string data = "ushers and his sheep";
+	MatchSet matches = find_all(matcher, data);
+	CHECK(matches == find_all_naive(patterns, data));
+	CHECK(matches.count(std::make_pair((size_t)6, (size_t)0)) == 1);
+	CHECK(matches.count(std::make_pair((size_t)0, (size_t)2)) == 1);
+	CHECK(matches.count(std::make_pair((size_t)4, (size_t)2)) == 1);
+
+	CHECK(find_all(matcher, "").empty());
+	CHECK(find_all(matcher, "xyz").empty());
+}
+
+static void test_binary_random()
+{
+	// binary patterns over a small alphabet, so matches overlap often
+	uint32_t seed = 2024;
+	std::vector<std::string> patterns;
+	for (int i = 0; i < 40; i++) {
+		seed = seed * 1103515245 + 12345;
+		std::string pattern((seed >> 16) % 6 + 1, '\0');
+		for (size_t j = 0; j < pattern.size(); j++) {
+			seed = seed * 1103515245 + 12345;
+			pattern[j] = (char)(((seed >> 16) % 3) * 0x7f);
+		}
+		patterns.push_back(pattern);
+	}
+
+	AhoCorasick matcher;
+	for (size_t i = 0; i < patterns.size(); i++) {
+		matcher.AddPattern((const uint8_t *)patterns[i].data(), patterns[i].size());
+	}
+	matcher.Build();
+
+	std::string data(4096, '\0');
+	for (size_t i = 0; i < data.size(); i++) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = (char)(((seed >> 16) % 3) * 0x7f);
+	}
+	CHECK(find_all(matcher, data) == find_all_naive(patterns, data));
+}
+
+int main()
+{
+	test_overlapping_patterns();
+	test_binary_random();
+
+	return check_result();
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "BRR.h"
+#include "check.h"
+
+static uint32_t seed = 2024;
+
+static uint8_t random_byte()
+{
+	seed = seed * 1103515245 + 12345;
+	return (uint8_t)(seed >> 16);
+}
+
+// Random blocks, cycling through every shift and filter so each pair appears several times.
+static std::vector<uint8_t> make_blocks(size_t num_blocks)
+{
+	std::vector<uint8_t> data(num_blocks * BRR::BLOCK_SIZE);
+	for (size_t block = 0; block < num_blocks; block++) {
+		uint8_t * p = &data[block * BRR::BLOCK_SIZE];
+		int shift = block % 16;
+		int filter = (block / 16) % 4;
+		p[0] = (uint8_t)((shift << 4) | (filter << 2) | (random_byte() & 0x03));
+		for (int i = 1; i < BRR::BLOCK_SIZE; i++) {
+			// extreme nybbles now and then, to push the filters into clamping
+			uint8_t byte = random_byte();
+			switch (random_byte() % 8) {
+			case 0:
+				byte = 0x77;
+				break;
+			case 1:
+				byte = 0x88;
+				break;
+			}
+			p[i] = byte;
+		}
+	}
+	return data;
+}
+
+static void test_single_call()
+{
+	const size_t num_blocks = 16 * 4 * 8;
+	std::vector<uint8_t> data = make_blocks(num_blocks);
+
+	const int16_t start_histories[][2] = { { 0, 0 }, { 32767, -32768 }, { -32768, 32767 }, { 1234, -4322 } };
+	for (size_t h = 0; h < sizeof(start_histories) / sizeof(start_histories[0]); h++) {
+		std::vector<int16_t> expected(num_blocks * BRR::SAMPLES_PER_BLOCK);
+		std::vector<int16_t> actual(num_blocks * BRR::SAMPLES_PER_BLOCK);
+		int16_t expected_history[2] = { start_histories[h][0], start_histories[h][1] };
+		int16_t actual_history[2] = { start_histories[h][0], start_histories[h][1] };
+
+		BRR::DecodeScalar(data.data(), num_blocks, expected.data(), expected_history);
+		BRR::Decode(data.data(), num_blocks, actual.data(), actual_history);
+		CHECK(expected == actual);
+		CHECK(expected_history[0] == actual_history[0] && expected_history[1] == actual_history[1]);
+	}
+}
+
+static void test_every_block_kind()
+{
+	// each shift and filter on its own, from the same history, so a mismatch points at one pair
+	for (int shift = 0; shift < 16; shift++) {
+		for (int filter = 0; filter < 4; filter++) {
+			std::vector<uint8_t> data = make_blocks(1);
+			data[0] = (uint8_t)((shift << 4) | (filter << 2));
+
+			int16_t expected[BRR::SAMPLES_PER_BLOCK];
+			int16_t actual[BRR::SAMPLES_PER_BLOCK];
+			int16_t expected_history[2] = { -3000, 5000 };
+			int16_t actual_history[2] = { -3000, 5000 };
+			BRR::DecodeScalar(data.data(), 1, expected, expected_history);
+			BRR::Decode(data.data(), 1, actual, actual_history);
+			if (memcmp(expected, actual, sizeof(expected)) != 0 ||
+				expected_history[0] != actual_history[0] || expected_history[1] != actual_history[1]) {
+				fprintf(stderr, "mismatch at shift %d, filter %d\n", shift, filter);
+				CHECK(false);
+			}
+		}
+	}
+}
+
+static void test_split_calls()
+{
+	// the history carried between calls must give the same samples as one call
+	const size_t num_blocks = 16 * 4 * 4;
+	std::vector<uint8_t> data = make_blocks(num_blocks);
+
+	std::vector<int16_t> expected(num_blocks * BRR::SAMPLES_PER_BLOCK);
+	int16_t expected_history[2] = { 0, 0 };
+	BRR::DecodeScalar(data.data(), num_blocks, expected.data(), expected_history);
+
+	std::vector<int16_t> actual(num_blocks * BRR::SAMPLES_PER_BLOCK);
+	int16_t actual_history[2] = { 0, 0 };
+	size_t block = 0;
+	while (block < num_blocks) {
+		size_t count = random_byte() % 5;
+		if (count > num_blocks - block) {
+			count = num_blocks - block;
+		}
+		BRR::Decode(&data[block * BRR::BLOCK_SIZE], count, &actual[block * BRR::SAMPLES_PER_BLOCK], actual_history);
+		block += count;
+	}
+	CHECK(expected == actual);
+	CHECK(expected_history[0] == actual_history[0] && expected_history[1] == actual_history[1]);
+}
+
+int main()
+{
+	test_single_call();
+	test_every_block_kind();
+	test_split_calls();
+
+	return check_result();
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "SPCManifest.h"
+#include "SPCFile.h"
+#include "Hash.h"
+#include "check.h"
+
+#define TEST_SPC_FILENAME       "test_manifest.spc"
+#define TEST_MANIFEST_FILENAME  "test_manifest.txt"
+
+// Bit mask of the sections whose hashes differ.
+static int changed_sections(const SPCManifest::Entry & before, const SPCManifest::Entry & after)
+{
+	int changed = 0;
+	for (int i = 0; i < SPCManifest::SECTION_COUNT; i++) {
+		if (before.hashes[i] != after.hashes[i]) {
+			changed |= 1 << i;
+		}
+	}
+	return changed;
+}
+
+static bool only_tag_sections(int changed)
+{
+	for (int i = 0; i < SPCManifest::SECTION_COUNT; i++) {
+		if ((changed & (1 << i)) != 0 && !SPCManifest::IsTagSection(i)) {
+			return false;
+		}
+	}
+	return changed != 0;
+}
+
+static void test_xxh64()
+{
+	// reference values of the xxHash distribution
+	CHECK(Hash::XXH64("", 0) == 0xef46db3751d8e999ULL);
+	CHECK(Hash::XXH64("abc", 3) == 0x44bc2cf5ad770999ULL);
+	CHECK(Hash::XXH64("Nobody inspects the spammish repetition", 39) == 0xfbcea83c8a378bf1ULL);
+}
+
+static void test_tag_edits()
+{
+	// an untagged file, then the same file tagged, retagged and untagged again
+	SPCFile spc;
+	spc.regs.pc = 0x0400;
+	spc.ram[0x0400] = 0x2f;
+	spc.ram[0x0401] = 0xfe;
+	CHECK(spc.Save(TEST_SPC_FILENAME));
+
+	SPCManifest::Entry untagged;
+	CHECK(SPCManifest::Compute(TEST_SPC_FILENAME, untagged));
+
+	spc.SetStringTag(SPCFile::XID6_SONG_NAME, "Title");
+	CHECK(spc.Save(TEST_SPC_FILENAME));
+	SPCManifest::Entry tagged;
+	CHECK(SPCManifest::Compute(TEST_SPC_FILENAME, tagged));
+	CHECK(only_tag_sections(changed_sections(untagged, tagged)));
+	CHECK((changed_sections(untagged, tagged) & (1 << SPCManifest::SECTION_ID666)) != 0);
+
+	// a tag only xid6 can hold
+	spc.SetStringTag(SPCFile::XID6_OST_TITLE, "Soundtrack");
+	CHECK(spc.Save(TEST_SPC_FILENAME));
+	SPCManifest::Entry retagged;
+	CHECK(SPCManifest::Compute(TEST_SPC_FILENAME, retagged));
+	CHECK(only_tag_sections(changed_sections(tagged, retagged)));
+	CHECK((changed_sections(tagged, retagged) & (1 << SPCManifest::SECTION_XID6)) != 0);
+
+	spc.tags.clear();
+	CHECK(spc.Save(TEST_SPC_FILENAME));
+	SPCManifest::Entry untagged_again;
+	CHECK(SPCManifest::Compute(TEST_SPC_FILENAME, untagged_again));
+	CHECK(changed_sections(untagged, untagged_again) == 0);
+	CHECK(untagged.size == untagged_again.size);
+}
+
+static void test_damage()
+{
+	SPCFile spc;
+	CHECK(spc.Save(TEST_SPC_FILENAME));
+	SPCManifest::Entry before;
+	CHECK(SPCManifest::Compute(TEST_SPC_FILENAME, before));
+
+	spc.ram[0x1234] ^= 0x01;
+	CHECK(spc.Save(TEST_SPC_FILENAME));
+	SPCManifest::Entry after;
+	CHECK(SPCManifest::Compute(TEST_SPC_FILENAME, after));
+	CHECK(changed_sections(before, after) == (1 << SPCManifest::SECTION_RAM));
+
+	spc.ram[0x1234] ^= 0x01;
+	spc.regs.pc ^= 0x0100;
+	CHECK(spc.Save(TEST_SPC_FILENAME));
+	CHECK(SPCManifest::Compute(TEST_SPC_FILENAME, after));
+	CHECK(changed_sections(before, after) == (1 << SPCManifest::SECTION_HEADER));
+
+	// not an SPC file
+	FILE * fp = fopen(TEST_SPC_FILENAME, "wb");
+	CHECK(fp != NULL);
+	if (fp != NULL) {
+		fputs("not an SPC file\n", fp);
+		fclose(fp);
+	}
+	CHECK(!SPCManifest::Compute(TEST_SPC_FILENAME, after));
+}
+
+static void test_write_read()
+{
+	std::vector<SPCManifest::Entry> entries(2);
+	for (size_t i = 0; i < entries.size(); i++) {
+		entries[i].filename = (i == 0) ? "dir/a file.spc" : "b.spc";
+		entries[i].size = 0x10200 + i;
+		for (int j = 0; j < SPCManifest::SECTION_COUNT; j++) {
+			entries[i].hashes[j] = Hash::XXH64(&j, sizeof(j), i) | ((uint64_t)j << 60);
+		}
+	}
+	CHECK(SPCManifest::Write(TEST_MANIFEST_FILENAME, entries));
+
+	std::vector<SPCManifest::Entry> read_entries;
+	CHECK(SPCManifest::Read(TEST_MANIFEST_FILENAME, read_entries));
+	CHECK(read_entries.size() == entries.size());
+	for (size_t i = 0; i < read_entries.size() && i < entries.size(); i++) {
+		CHECK(read_entries[i].filename == entries[i].filename);
+		CHECK(read_entries[i].size == entries[i].size);
+		CHECK(memcmp(read_entries[i].hashes, entries[i].hashes, sizeof(entries[i].hashes)) == 0);
+	}
+}
+
+int main()
+{
+	test_xxh64();
+	test_tag_edits();
+	test_damage();
+	test_write_read();
+
+	remove(TEST_SPC_FILENAME);
+	remove(TEST_MANIFEST_FILENAME);
+
+	return check_result();
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "TagIndex.h"
+#include "check.h"
+
+#define TEST_INDEX_FILENAME     "test_tagindex.idx"
+
+struct TestFile {
+	const char * filename;
+	const char * values[TagIndex::FIELD_COUNT];		// title, game, artist, comment, soundtrack, copyright
+};
+
+static const TestFile TEST_FILES[] = {
+	{ "a/01.spc", { "Opening Theme", "Star Quest", "Composer One", "", "Star Quest OST", "Publisher" } },
+	{ "a/02.spc", { "Battle", "Star Quest", "Composer One", "boss battle", "Star Quest OST", "Publisher" } },
+	{ "b/01.spc", { "Title Screen", "Moon Racer", "Composer Two", "", "", "Other Publisher" } },
+	{ "b/02.spc", { "STAR ROAD", "Moon Racer", "Composer Two", "", "", "Other Publisher" } },
+	{ "c/01.spc", { "", "", "", "", "", "" } },
+};
+static const size_t TEST_FILE_COUNT = sizeof(TEST_FILES) / sizeof(TEST_FILES[0]);
+
+static bool contains_case_insensitive(const std::string & str, const std::string & pattern)
+{
+	std::string lower_str;
+	std::string lower_pattern;
+	for (size_t i = 0; i < str.size(); i++) {
+		lower_str += (char)tolower((unsigned char)str[i]);
+	}
+	for (size_t i = 0; i < pattern.size(); i++) {
+		lower_pattern += (char)tolower((unsigned char)pattern[i]);
+	}
+	return lower_str.find(lower_pattern) != std::string::npos;
+}
+
+static std::vector<uint32_t> search_naive(const std::string & pattern, TagIndex::Field field)
+{
+	std::vector<uint32_t> files;
+	for (uint32_t file = 0; file < TEST_FILE_COUNT; file++) {
+		bool found = false;
+		for (int i = 0; i < TagIndex::FIELD_COUNT; i++) {
+			if ((field == TagIndex::FIELD_ANY || field == i) && TEST_FILES[file].values[i][0] != '\0' &&
+				contains_case_insensitive(TEST_FILES[file].values[i], pattern)) {
+				found = true;
+			}
+		}
+		if (found) {
+			files.push_back(file);
+		}
+	}
+	return files;
+}
+
+static bool build_index()
+{
+	TagIndex::Builder builder;
+	for (size_t i = 0; i < TEST_FILE_COUNT; i++) {
+		std::string values[TagIndex::FIELD_COUNT];
+		for (int j = 0; j < TagIndex::FIELD_COUNT; j++) {
+			values[j] = TEST_FILES[i].values[j];
+		}
+		builder.Add(TEST_FILES[i].filename, values);
+	}
+
+	// shared strings are stored once, plus the empty string
+	CHECK(builder.GetFileCount() == TEST_FILE_COUNT);
+	CHECK(builder.GetStringCount() == 13);
+	return builder.Write(TEST_INDEX_FILENAME);
+}
+
+static void test_search(const TagIndex & index)
+{
+	CHECK(index.GetFileCount() == TEST_FILE_COUNT);
+	for (uint32_t file = 0; file < TEST_FILE_COUNT; file++) {
+		CHECK(index.GetFilename(file) == TEST_FILES[file].filename);
+	}
+
+	static const char * const patterns[] = {
+		"star", "STAR QUEST", "quest ost", "battle", "composer", "composer two", "moon",
+		"publisher", "other", "theme", "st", "s", "road", "xyz", "star  quest", "e s"
+	};
+	for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+		for (int field = 0; field <= TagIndex::FIELD_ANY; field++) {
+			std::vector<uint32_t> files;
+			index.Search(patterns[i], (TagIndex::Field)field, files);
+			if (files != search_naive(patterns[i], (TagIndex::Field)field)) {
+				fprintf(stderr, "%s:%d: search for \"%s\" in field %d differs\n", __FILE__, __LINE__, patterns[i], field);
+				num_failures++;
+			}
+		}
+	}
+
+	TagIndex::Field field;
+	CHECK(TagIndex::ParseField("artist", field) && field == TagIndex::FIELD_ARTIST);
+	CHECK(!TagIndex::ParseField("bogus", field));
+}
+
+static void test_fuzzy(const TagIndex & index)
+{
+	// a typo still finds the title, best match first
+	std::vector<std::pair<uint32_t, double> > files;
+	index.SearchFuzzy("Opening Thme", TagIndex::FIELD_TITLE, 0.5, files);
+	CHECK(!files.empty());
+	if (!files.empty()) {
+		CHECK(files[0].first == 0);
+		CHECK(files[0].second >= 0.5 && files[0].second < 1.0);
+	}
+	for (size_t i = 1; i < files.size(); i++) {
+		CHECK(files[i - 1].second >= files[i].second);
+	}
+
+	index.SearchFuzzy("star quest", TagIndex::FIELD_GAME, 1.0, files);
+	CHECK(files.size() == 2);
+
+	index.SearchFuzzy("qqqqqq", TagIndex::FIELD_ANY, 0.1, files);
+	CHECK(files.empty());
+}
+
+int main()
+{
+	CHECK(build_index());
+
+	TagIndex index;
+	CHECK(index.Open(TEST_INDEX_FILENAME));
+	test_search(index);
+	test_fuzzy(index);
+	index.Close();
+
+	remove(TEST_INDEX_FILENAME);
+
+	return check_result();
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "SPCFile.h"
+#include "check.h"
+
+static bool parse_ticks(const char * str, uint32_t & ticks)
+{
+	return SPCFile::ParseXID6Ticks(str, str + strlen(str), ticks);
+}
+
+static std::string format_ticks(uint32_t ticks)
+{
+	char str[SPCFile::XID6_TIME_STRING_MAX];
+	size_t len = SPCFile::FormatXID6Ticks(ticks, false, str);
+	return std::string(str, len);
+}
+
+static void test_apply_matches_import()
+{
+	std::map<std::string, std::string> psf_tags;
+	psf_tags["title"] = "Title";
+	psf_tags["artist"] = "Artist";
+	psf_tags["game"] = "Game";
+	psf_tags["year"] = "1995";
+	psf_tags["length"] = "1:02.5";
+	psf_tags["fade"] = "10";
+	psf_tags["track"] = "3b";
+	psf_tags["volume"] = "1.25";
+	psf_tags["created_at"] = "2001/02/03";
+
+	SPCFile::TagPatch patch;
+	CHECK(patch.Compile(psf_tags));
+	CHECK(!patch.IsEmpty());
+
+	// one compiled patch, applied to several files
+	SPCFile patched1;
+	SPCFile patched2;
+	patch.Apply(patched1);
+	patch.Apply(patched2);
+
+	SPCFile imported;
+	CHECK(imported.ImportPSFTag(psf_tags));
+
+	CHECK(patched1.ExportPSFTag(true) == imported.ExportPSFTag(true));
+	CHECK(patched2.ExportPSFTag(true) == imported.ExportPSFTag(true));
+	CHECK(patched1.GetStringTag(SPCFile::XID6_SONG_NAME) == "Title");
+	CHECK(patched1.GetIntegerTag(SPCFile::XID6_COPYRIGHT_YEAR) == 1995);
+	CHECK(patched1.GetIntegerTag(SPCFile::XID6_INTRO_LENGTH) == 62 * 64000 + 32000);
+	CHECK(patched1.GetIntegerTag(SPCFile::XID6_OST_TRACK_NUMBER) == ((3 << 8) | 'b'));
+	CHECK(patched1.GetIntegerTag(SPCFile::XID6_VOLUME) == 0x14000);
+}
+
+static void test_erase()
+{
+	SPCFile spc;
+	std::map<std::string, std::string> psf_tags;
+	psf_tags["title"] = "Title";
+	psf_tags["year"] = "1995";
+	psf_tags["intro"] = "5";
+	psf_tags["loop"] = "20";
+	psf_tags["loopcount"] = "2";
+	psf_tags["end"] = "3";
+	CHECK(spc.ImportPSFTag(psf_tags));
+	CHECK(spc.tags.size() == 6);
+
+	// empty values erase, and "length" replaces every length tag
+	std::map<std::string, std::string> erase_tags;
+	erase_tags["title"] = "";
+	erase_tags["year"] = "";
+	erase_tags["length"] = "";
+
+	SPCFile::TagPatch patch;
+	CHECK(patch.Compile(erase_tags));
+	patch.Apply(spc);
+	CHECK(spc.tags.empty());
+
+	// erasing a tag that is not there is not an error
+	patch.Apply(spc);
+	CHECK(spc.tags.empty());
+}
+
+static void test_errors()
+{
+	std::map<std::string, std::string> psf_tags;
+	psf_tags["title"] = "Title";
+	psf_tags["year"] = "199x";
+	psf_tags["fade"] = "1:xx";
+
+	SPCFile::TagPatch patch;
+	std::string messages;
+	CHECK(!patch.Compile(psf_tags, &messages));
+	CHECK(messages.find("year") != std::string::npos);
+	CHECK(messages.find("fade") != std::string::npos);
+
+	// malformed values are left out, the rest still applies
+	SPCFile spc;
+	patch.Apply(spc);
+	CHECK(spc.tags.size() == 1);
+	CHECK(spc.GetStringTag(SPCFile::XID6_SONG_NAME) == "Title");
+
+	// unknown names are only warned about
+	std::map<std::string, std::string> unknown_tags;
+	unknown_tags["bogus"] = "x";
+	SPCFile::TagPatch unknown_patch;
+	messages.clear();
+	CHECK(unknown_patch.Compile(unknown_tags, &messages));
+	CHECK(messages.find("bogus") != std::string::npos);
+	CHECK(unknown_patch.IsEmpty());
+
+	CHECK(SPCFile::IsPSFTagName("title"));
+	CHECK(SPCFile::IsPSFTagName("created_at"));
+	CHECK(!SPCFile::IsPSFTagName("bogus"));
+}
+
+static void test_volume_round_trip()
+{
+	// volume is exported with 6 decimals, finer than 1/65536 but not exact
+	static const uint32_t volumes[] = { 0, 1, 0x7fff, 0x10000, 0x12345, 0xabcdef, 0xffffffff };
+	for (size_t i = 0; i < sizeof(volumes) / sizeof(volumes[0]); i++) {
+		SPCFile spc;
+		spc.SetIntegerTag(SPCFile::XID6_VOLUME, volumes[i], 4);
+
+		SPCFile imported;
+		CHECK(imported.ImportPSFTag(spc.ExportPSFTag(true)));
+		CHECK((uint32_t)imported.GetIntegerTag(SPCFile::XID6_VOLUME) == volumes[i]);
+	}
+}
+
+static void test_track_round_trip()
+{
+	// with and without the letter suffix
+	static const char * const tracks[] = { "5", "3b", "255" };
+	for (size_t i = 0; i < sizeof(tracks) / sizeof(tracks[0]); i++) {
+		std::map<std::string, std::string> psf_tags;
+		psf_tags["track"] = tracks[i];
+
+		SPCFile spc;
+		CHECK(spc.ImportPSFTag(psf_tags));
+		std::map<std::string, std::string> exported = spc.ExportPSFTag(true);
+		CHECK(exported["track"] == tracks[i]);
+		CHECK(exported["track"].size() == strlen(tracks[i]));
+	}
+}
+
+static void test_binary_id666_lengths()
+{
+	SPCFile spc;
+	spc.SetStringTag(SPCFile::XID6_SONG_NAME, "Title");
+	std::vector<uint8_t> data;
+	spc.Serialize(data);
+
+	// binary ID666 with the largest song length and fade the fields can hold
+	memset(&data[0xa9], 0xff, 3);
+	memset(&data[0xac], 0xff, 4);
+	data[0xd2] = 0;
+
+	std::string messages;
+	SPCFile * loaded = SPCFile::LoadFromMemory(data.data(), data.size(), &messages);
+	CHECK(loaded != NULL);
+	if (loaded != NULL) {
+		CHECK(loaded->id666_format == SPCFile::ID666_BINARY);
+		CHECK((uint32_t)loaded->GetIntegerTag(SPCFile::XID6_INTRO_LENGTH) == 999 * 64000);
+		CHECK((uint32_t)loaded->GetIntegerTag(SPCFile::XID6_FADE_LENGTH) == 99999 * 64);
+		delete loaded;
+	}
+}
+
+static void test_id666_utf8_truncation()
+{
+	// "é" (2 bytes) and "あ" (3 bytes) straddling the end of the 32- and 16-byte fields
+	SPCFile spc;
+	spc.SetStringTag(SPCFile::XID6_SONG_NAME, std::string(31, 'a') + "\xc3\xa9");
+	spc.SetStringTag(SPCFile::XID6_GAME_NAME, std::string(30, 'a') + "\xe3\x81\x82");
+	spc.SetStringTag(SPCFile::XID6_DUMPER_NAME, std::string(14, 'a') + "\xc3\xa9");
+	spc.SetStringTag(SPCFile::XID6_COMMENT, std::string(29, 'a') + "\xe3\x81\x82");
+	std::vector<uint8_t> data;
+	spc.Serialize(data);
+
+	CHECK(memcmp(&data[0x2e], std::string(31, 'a').c_str(), 32) == 0);
+	CHECK(memcmp(&data[0x4e], std::string(30, 'a').c_str(), 31) == 0 && data[0x6d] == 0);
+	CHECK(memcmp(&data[0x6e], (std::string(14, 'a') + "\xc3\xa9").data(), 16) == 0);
+	CHECK(memcmp(&data[0x7e], (std::string(29, 'a') + "\xe3\x81\x82").data(), 32) == 0);
+}
+
+static void test_time_strings()
+{
+	uint32_t ticks;
+	CHECK(parse_ticks("", ticks) && ticks == 0);
+	CHECK(parse_ticks("1", ticks) && ticks == 64000);
+	CHECK(parse_ticks("0.5", ticks) && ticks == 32000);
+	CHECK(parse_ticks(".5", ticks) && ticks == 32000);
+	CHECK(parse_ticks("1:00", ticks) && ticks == 60 * 64000);
+	CHECK(parse_ticks("1:02:03.25", ticks) && ticks == 3723 * 64000 + 16000);
+	CHECK(parse_ticks("0.0000156249", ticks) && ticks == 1);
+
+	CHECK(!parse_ticks("abc", ticks));
+	CHECK(!parse_ticks("1:2:3:4", ticks));
+	CHECK(!parse_ticks(".", ticks));
+	CHECK(!parse_ticks("1.2.3", ticks));
+	CHECK(!parse_ticks("-1", ticks));
+	CHECK(!parse_ticks("99999999", ticks));
+
+	CHECK(format_ticks(0) == "0");
+	CHECK(format_ticks(64000) == "1");
+	CHECK(format_ticks(32000) == "0.5");
+	CHECK(format_ticks(60 * 64000) == "1:00");
+	CHECK(format_ticks(3723 * 64000 + 16000) == "1:02:03.25");
+
+	// every tick value survives the round trip
+	for (uint64_t value = 0; value <= UINT32_MAX; value += 9973) {
+		std::string str = format_ticks((uint32_t)value);
+		if (!parse_ticks(str.c_str(), ticks) || ticks != (uint32_t)value) {
+			fprintf(stderr, "%s:%d: %u does not round-trip (\"%s\")\n", __FILE__, __LINE__, (unsigned int)value, str.c_str());
+			num_failures++;
+			break;
+		}
+	}
+	CHECK(parse_ticks(format_ticks(UINT32_MAX).c_str(), ticks) && ticks == UINT32_MAX);
+}
+
+int main()
+{
+	test_apply_matches_import();
+	test_erase();
+	test_errors();
+	test_volume_round_trip();
+	test_track_round_trip();
+	test_binary_id666_lengths();
+	test_id666_utf8_truncation();
+	test_time_strings();
+
+	return check_result();
+}
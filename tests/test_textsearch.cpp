@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "TagGrep.h"
+#include "TextEncoding.h"
+#include "check.h"
+
+static uint32_t seed = 2024;
+
+static uint32_t random_number(uint32_t range)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % range;
+}
+
+static char ascii_lower(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+static bool find_case_insensitive_naive(const std::string & text, const std::string & pattern)
+{
+	for (size_t offset = 0; offset + pattern.size() <= text.size(); offset++) {
+		size_t i = 0;
+		while (i < pattern.size() && ascii_lower(text[offset + i]) == pattern[i]) {
+			i++;
+		}
+		if (i == pattern.size()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool is_valid_utf8_naive(const std::string & str)
+{
+	size_t i = 0;
+	while (i < str.size()) {
+		size_t length = TextEncoding::UTF8SequenceLength((const uint8_t *)str.data() + i, str.size() - i);
+		if (length == 0) {
+			return false;
+		}
+		i += length;
+	}
+	return true;
+}
+
+static void test_find_case_insensitive()
+{
+	// letters of both cases, the characters next to A-Z and Z-a, and high bytes whose
+	// low 7 bits are letters, so a case fold that ignores the sign bit would show
+	static const char alphabet[] = { 'a', 'A', 'b', 'B', 'z', 'Z', '@', '[', '`', '{',
+		(char)0xc1, (char)0xe1, (char)0xda, (char)0x80, (char)0xff };
+	const size_t alphabet_size = sizeof(alphabet);
+
+	for (size_t pattern_size = 1; pattern_size <= 5; pattern_size++) {
+		// around the last position the 16-byte loop can compare, and past it into the tail
+		const size_t block_end = 16 + pattern_size - 1;
+		for (size_t text_size = 0; text_size <= block_end + 20; text_size++) {
+			for (int round = 0; round < 40; round++) {
+				std::string pattern(pattern_size, '\0');
+				for (size_t i = 0; i < pattern_size; i++) {
+					pattern[i] = ascii_lower(alphabet[random_number(alphabet_size)]);
+				}
+
+				std::string text(text_size, '\0');
+				for (size_t i = 0; i < text_size; i++) {
+					text[i] = alphabet[random_number(alphabet_size)];
+				}
+
+				// half of the texts get the pattern with random case somewhere, often at the end
+				if (round % 2 == 0 && text_size >= pattern_size) {
+					size_t offset = (round % 4 == 0) ? text_size - pattern_size : random_number((uint32_t)(text_size - pattern_size + 1));
+					for (size_t i = 0; i < pattern_size; i++) {
+						char c = pattern[i];
+						if (c >= 'a' && c <= 'z' && random_number(2) != 0) {
+							c = (char)(c - ('a' - 'A'));
+						}
+						text[offset + i] = c;
+					}
+				}
+
+				bool expected = find_case_insensitive_naive(text, pattern);
+				bool actual = TagGrep::FindCaseInsensitive(text.data(), text.size(), pattern.data(), pattern.size());
+				if (expected != actual) {
+					fprintf(stderr, "mismatch for pattern size %d, text size %d\n", (int)pattern_size, (int)text_size);
+					CHECK(false);
+				}
+			}
+		}
+	}
+
+	CHECK(TagGrep::FindCaseInsensitive("abc", 3, "", 0));
+	CHECK(!TagGrep::FindCaseInsensitive("", 0, "a", 1));
+}
+
+static void test_is_valid_utf8()
+{
+	// placed after ASCII runs of every length across the first two 16-byte blocks
+	static const char * const sequences[] = {
+		"\xc3\xa9",				// valid 2 bytes
+		"\xe3\x81\x82",			// valid 3 bytes
+		"\xf0\x9f\x8e\xb5",		// valid 4 bytes
+		"\x80",					// stray continuation byte
+		"\xc0\xaf",				// overlong
+		"\xed\xa0\x80",			// surrogate
+		"\xf4\x90\x80\x80",		// above U+10FFFF
+		"\xe3\x81",				// truncated
+		"\xff",
+	};
+	const size_t num_sequences = sizeof(sequences) / sizeof(sequences[0]);
+
+	for (size_t prefix_size = 0; prefix_size <= 40; prefix_size++) {
+		for (size_t seq = 0; seq < num_sequences; seq++) {
+			for (size_t suffix_size = 0; suffix_size <= 20; suffix_size++) {
+				std::string str(prefix_size, 'a');
+				str += sequences[seq];
+				str.append(suffix_size, 'b');
+
+				if (TextEncoding::IsValidUTF8(str.data(), str.size()) != is_valid_utf8_naive(str)) {
+					fprintf(stderr, "mismatch for sequence %d after %d bytes, %d after\n", (int)seq, (int)prefix_size, (int)suffix_size);
+					CHECK(false);
+				}
+			}
+
+			// a sequence cut off by the end of the string
+			std::string str(prefix_size, 'a');
+			str += sequences[seq];
+			str.resize(str.size() - 1);
+			CHECK(TextEncoding::IsValidUTF8(str.data(), str.size()) == is_valid_utf8_naive(str));
+		}
+	}
+
+	for (size_t size = 0; size <= 64; size++) {
+		std::string str(size, 'a');
+		CHECK(TextEncoding::IsValidUTF8(str.data(), str.size()));
+	}
+}
+
+int main()
+{
+	test_find_case_insensitive();
+	test_is_valid_utf8();
+
+	return check_result();
+}